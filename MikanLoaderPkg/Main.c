@@ -4,23 +4,18 @@
 #include  <Library/PrintLib.h>
 #include  <Library/MemoryAllocationLib.h>
 #include  <Library/BaseMemoryLib.h>
+#include  <Library/BaseLib.h>
 #include  <Protocol/LoadedImage.h>
 #include  <Protocol/SimpleFileSystem.h>
 #include  <Protocol/DiskIo2.h>
 #include  <Protocol/BlockIo.h>
 #include  <Protocol/PciRootBridgeIo.h>
 #include  <Guid/FileInfo.h>
+#include  <Guid/Acpi.h>
 #include  "frame_buffer_config.hpp"
 #include  "elf.hpp"
-
-struct MemoryMap {
-  UINTN buffer_size;
-  VOID* buffer;
-  UINTN map_size;
-  UINTN map_key;
-  UINTN descriptor_size;
-  UINT32 descriptor_version;
-};
+#include  "boot_timeline.hpp"
+#include  "memory_map.hpp"
 
 EFI_STATUS GetMemoryMap(struct MemoryMap* map) {
   if (map->buffer == NULL) {
@@ -219,6 +214,35 @@ void Halt(void) {
 #endif
 }
 
+#ifdef MIKANOS_BOOT_TIMELINE
+struct BootTimeline boot_timeline;
+
+UINT64 ReadBootCounter(void) {
+#ifdef MDE_CPU_X64
+  UINT32 lo, hi;
+  __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((UINT64)hi << 32) | lo;
+#endif
+#ifdef MDE_CPU_AARCH64
+  UINT64 value;
+  __asm__ volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(value) : : "memory");
+  return value;
+#endif
+}
+
+void MarkBootPhase(CHAR8* name) {
+  if (boot_timeline.num_entries >= BOOT_TIMELINE_MAX_ENTRIES) {
+    return;
+  }
+  struct BootTimelineEntry* entry =
+    &boot_timeline.entries[boot_timeline.num_entries++];
+  entry->ticks = ReadBootCounter();
+  AsciiStrCpyS(entry->name, sizeof(entry->name), name);
+}
+#else
+#define MarkBootPhase(name)
+#endif
+
 void CalcLoadAddressRange(Elf64_Ehdr* ehdr, UINT64* first, UINT64* last) {
   Elf64_Phdr* phdr = (Elf64_Phdr*)((UINT64)ehdr + ehdr->e_phoff);
   *first = MAX_UINT64;
@@ -248,6 +272,7 @@ EFI_STATUS EFIAPI UefiMain(
     EFI_SYSTEM_TABLE* system_table) {
   EFI_STATUS status;
 
+  MarkBootPhase("loader: entry");
   Print(L"Hello, Mikan World!\n");
 
   CHAR8 memmap_buf[4096 * 4];
@@ -257,6 +282,7 @@ EFI_STATUS EFIAPI UefiMain(
     Print(L"failed to get memory map: %r\n", status);
     Halt();
   }
+  MarkBootPhase("loader: get memmap");
 
   EFI_FILE_PROTOCOL* root_dir;
   status = OpenRootDir(image_handle, &root_dir);
@@ -284,6 +310,7 @@ EFI_STATUS EFIAPI UefiMain(
       Halt();
     }
   }
+  MarkBootPhase("loader: save memmap");
 
   EFI_GRAPHICS_OUTPUT_PROTOCOL* gop;
   status = OpenGOP(image_handle, &gop);
@@ -303,9 +330,11 @@ EFI_STATUS EFIAPI UefiMain(
       gop->Mode->FrameBufferSize);
 
   UINT8* frame_buffer = (UINT8*)gop->Mode->FrameBufferBase;
+  MarkBootPhase("loader: open gop");
   for (UINTN i = 0; i < gop->Mode->FrameBufferSize; ++i) {
     frame_buffer[i] = 255;
   }
+  MarkBootPhase("loader: fill frame buffer");
 
   // Get PCI information
   EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL* pci;
@@ -317,6 +346,7 @@ EFI_STATUS EFIAPI UefiMain(
   Print(L"PCI: Read:%08lx Write:%08lx\n",
       pci->Pci.Read,
       pci->Pci.Write);
+  MarkBootPhase("loader: open pci");
 
 
   EFI_FILE_PROTOCOL* kernel_file;
@@ -352,6 +382,7 @@ EFI_STATUS EFIAPI UefiMain(
     Print(L"error: %r", status);
     Halt();
   }
+  MarkBootPhase("loader: read kernel file");
 
   Elf64_Ehdr* kernel_ehdr = (Elf64_Ehdr*)kernel_buffer;
   UINT64 kernel_first_addr, kernel_last_addr;
@@ -366,6 +397,7 @@ EFI_STATUS EFIAPI UefiMain(
   }
 
   CopyLoadSegments(kernel_ehdr);
+  MarkBootPhase("loader: copy load segments");
   Print(L"Kernel: 0x%0lx - 0x%0lx\n", kernel_first_addr, kernel_last_addr);
 
   status = gBS->FreePool(kernel_buffer);
@@ -374,6 +406,23 @@ EFI_STATUS EFIAPI UefiMain(
     Halt();
   }
 
+  // ACPI のテーブルは ExitBootServices の後も残るので，RSDP のアドレスをそのまま渡す
+  VOID* acpi_table = NULL;
+  for (UINTN i = 0; i < gST->NumberOfTableEntries; ++i) {
+    if (CompareGuid(&gEfiAcpi20TableGuid,
+                    &gST->ConfigurationTable[i].VendorGuid)) {
+      acpi_table = gST->ConfigurationTable[i].VendorTable;
+      break;
+    }
+  }
+
+  // カーネルに渡すメモリマップにはカーネルを読み込んだ後の状態を反映させる
+  status = GetMemoryMap(&memmap);
+  if (EFI_ERROR(status)) {
+    Print(L"failed to get memory map: %r\n", status);
+    Halt();
+  }
+
   status = gBS->ExitBootServices(image_handle, memmap.map_key);
   if (EFI_ERROR(status)) {
     status = GetMemoryMap(&memmap);
@@ -388,6 +437,8 @@ EFI_STATUS EFIAPI UefiMain(
     }
   }
 
+  MarkBootPhase("loader: exit boot services");
+
   UINT64 entry_addr = *(UINT64*)(kernel_first_addr + 24);
 
   struct FrameBufferConfig config = {
@@ -409,9 +460,16 @@ EFI_STATUS EFIAPI UefiMain(
       Halt();
   }
 
-  typedef void EntryPointType(const struct FrameBufferConfig*);
+  typedef void EntryPointType(const struct FrameBufferConfig*,
+                              const struct BootTimeline*,
+                              const struct MemoryMap*,
+                              const VOID*);
   EntryPointType* entry_point = (EntryPointType*)entry_addr;
-  entry_point(&config);
+#ifdef MIKANOS_BOOT_TIMELINE
+  entry_point(&config, &boot_timeline, &memmap, acpi_table);
+#else
+  entry_point(&config, NULL, &memmap, acpi_table);
+#endif
 
   Print(L"All done\n");
 
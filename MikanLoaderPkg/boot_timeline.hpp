@@ -0,0 +1 @@
+../kernel/boot_timeline.hpp
\ No newline at end of file
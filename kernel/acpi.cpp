@@ -0,0 +1,82 @@
+/**
+ * @file acpi.cpp
+ *
+ * UEFI から受け取った ACPI のテーブルを探す．
+ */
+
+#include "acpi.hpp"
+
+#include <cstring>
+
+#include "logger.hpp"
+
+namespace {
+  /** @brief XSDT の本体はテーブルを指す 64 ビットの物理アドレスの並び． */
+  const acpi::DescriptionHeader* xsdt = nullptr;
+
+  uint8_t SumBytes(const void* data, size_t bytes) {
+    auto p = reinterpret_cast<const uint8_t*>(data);
+    uint8_t sum = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+      sum += p[i];
+    }
+    return sum;
+  }
+
+  size_t NumXSDTEntries() {
+    return (xsdt->length - sizeof(acpi::DescriptionHeader)) / sizeof(uint64_t);
+  }
+
+  const acpi::DescriptionHeader* XSDTEntry(size_t index) {
+    // 記述テーブルは 4 バイト境界にしか揃っていない
+    uint64_t addr;
+    memcpy(&addr, reinterpret_cast<const uint8_t*>(xsdt) + sizeof(acpi::DescriptionHeader) +
+           index * sizeof(uint64_t), sizeof(addr));
+    return reinterpret_cast<const acpi::DescriptionHeader*>(addr);
+  }
+}
+
+namespace acpi {
+  bool RSDP::IsValid() const {
+    if (strncmp(signature, "RSD PTR ", 8) != 0) {
+      return false;
+    }
+    if (revision < 2) {
+      return false;  // XSDT が無い
+    }
+    // checksum は先頭 20 バイト，extended_checksum は全体
+    return SumBytes(this, 20) == 0 && SumBytes(this, length) == 0;
+  }
+
+  bool DescriptionHeader::IsValid(const char* expected_signature) const {
+    return strncmp(signature, expected_signature, 4) == 0 &&
+      length >= sizeof(DescriptionHeader) && SumBytes(this, length) == 0;
+  }
+
+  Error Initialize(const RSDP* rsdp) {
+    xsdt = nullptr;
+    if (rsdp == nullptr || !rsdp->IsValid()) {
+      return MAKE_ERROR(Error::kInvalidDescriptor);
+    }
+    auto table = reinterpret_cast<const DescriptionHeader*>(rsdp->xsdt_address);
+    if (!table->IsValid("XSDT")) {
+      return MAKE_ERROR(Error::kInvalidDescriptor);
+    }
+    xsdt = table;
+    Log(kInfo, "acpi: XSDT at %p, %lu tables\n", xsdt, NumXSDTEntries());
+    return MAKE_ERROR(Error::kSuccess);
+  }
+
+  const DescriptionHeader* FindTable(const char* signature) {
+    if (xsdt == nullptr) {
+      return nullptr;
+    }
+    for (size_t i = 0; i < NumXSDTEntries(); ++i) {
+      auto table = XSDTEntry(i);
+      if (table->IsValid(signature)) {
+        return table;
+      }
+    }
+    return nullptr;
+  }
+}
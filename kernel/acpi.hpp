@@ -0,0 +1,57 @@
+/**
+ * @file acpi.hpp
+ *
+ * UEFI から受け取った ACPI のテーブルを探す．
+ *
+ * ローダは UEFI の構成テーブルにある ACPI 2.0 以降の RSDP をカーネルへ渡す．
+ * テーブルはブートサービスの外（ACPI Reclaim）に置かれ，カーネルは回収しないので，
+ * 物理アドレスのまま読んでよい．
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "error.hpp"
+
+namespace acpi {
+  /** @brief Root System Description Pointer（ACPI 2.0 以降の形）． */
+  struct [[gnu::packed]] RSDP {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    char reserved[3];
+
+    bool IsValid() const;
+  };
+
+  /** @brief すべての記述テーブルに共通する先頭部分． */
+  struct [[gnu::packed]] DescriptionHeader {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+
+    bool IsValid(const char* expected_signature) const;
+  };
+
+  /** @brief RSDP と XSDT を検証して覚える．
+   *
+   * rsdp が nullptr のとき，または壊れているときは Error::kInvalidDescriptor を返し，
+   * 以後の FindTable は nullptr を返す．
+   */
+  Error Initialize(const RSDP* rsdp);
+
+  /** @brief XSDT から signature（4 文字）のテーブルを探す．見つからなければ nullptr． */
+  const DescriptionHeader* FindTable(const char* signature);
+}
@@ -0,0 +1,42 @@
+/**************************************************************/
+/**
+    @file    context.hpp
+
+    @brief   タスク切り替えで保存するレジスタ．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __CONTEXT_HPP__
+#define __CONTEXT_HPP__
+
+#include <cstdint>
+
+/** @brief 関数呼び出しをまたいで保存される（callee-saved）レジスタ．
+ *
+ * タスクの切り替えは SwitchContext の呼び出しとして起きるので，
+ * これ以外のレジスタは呼び出し側が保存済み．context.S と配置を合わせること．
+ */
+struct TaskContext {
+  uint64_t x19_x28[10];
+  uint64_t fp, lr, sp;
+  uint64_t reserved;
+  uint64_t d8_d15[8];
+};
+static_assert(sizeof(TaskContext) == 176, "keep in sync with context.S");
+
+/** @brief 現在のレジスタを current_ctx に保存し，next_ctx のレジスタで実行を再開する． */
+extern "C" void SwitchContext(TaskContext* next_ctx, TaskContext* current_ctx);
+
+/** @brief 最初に切り替えられたとき，スタック stack_top の上で entry から実行するよう ctx を作る． */
+inline void InitTaskContext(TaskContext& ctx, uint64_t stack_top, void (*entry)()) {
+  ctx = TaskContext{};
+  ctx.lr = reinterpret_cast<uint64_t>(entry);
+  ctx.sp = stack_top & ~static_cast<uint64_t>(0xf);
+}
+
+#endif /* __CONTEXT_HPP__ */
@@ -0,0 +1,63 @@
+/**************************************************************/
+/**
+    @file    counter.hpp
+
+    @brief   汎用タイマの仮想カウンタ（CNTVCT_EL0）．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __COUNTER_HPP__
+#define __COUNTER_HPP__
+
+#include <cstdint>
+
+#include "sysreg.hpp"
+
+/** @brief カウンタの周波数（Hz）． */
+inline uint64_t CounterFrequency() {
+  uint64_t value;
+  __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(value));
+  return value;
+}
+
+/** @brief カウンタを使えるようにする．
+ *
+ * 汎用タイマはファームウェアが設定済みなので，WaitForCounterEvent が
+ * 10 マイクロ秒程度ごとに起きるようイベントストリームだけを有効にする．
+ * イベントはカウンタのビット EVNTI が変化するたび，つまり 2^(EVNTI+1) カウントごとに起きる．
+ */
+inline void InitializeCounter() {
+  const uint64_t period = CounterFrequency() / 100000;
+  uint64_t evnti = 0;
+  while (evnti < 15 && (2ull << evnti) < period) {
+    ++evnti;
+  }
+
+  const uint64_t mask = 0xfcu;  // EVNTI | EVNTDIR | EVNTEN
+  const uint64_t value = (evnti << 4) | (1u << 2);
+  if (CurrentEL() == 2) {
+    WRITE_SYSREG(cnthctl_el2, (READ_SYSREG(cnthctl_el2) & ~mask) | value);
+  } else {
+    WRITE_SYSREG(cntkctl_el1, (READ_SYSREG(cntkctl_el1) & ~mask) | value);
+  }
+  InstructionBarrier();
+}
+
+/** @brief カウンタの現在値を読む．先行する命令を追い越さないよう ISB を挟む． */
+inline uint64_t ReadCounter() {
+  uint64_t value;
+  __asm__ volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(value) : : "memory");
+  return value;
+}
+
+/** @brief 次のイベント（イベントストリームか割り込み）まで CPU を休ませる． */
+inline void WaitForCounterEvent() {
+  __asm__ volatile("wfe" : : : "memory");
+}
+
+#endif /* __COUNTER_HPP__ */
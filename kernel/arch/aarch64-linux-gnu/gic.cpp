@@ -0,0 +1,275 @@
+/**************************************************************/
+/**
+    @file    gic.cpp
+
+    @brief   QEMU virt マシンの割り込みコントローラ（GICv2 / GICv3）．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "gic.hpp"
+
+#include "iofunc.hpp"
+#include "paging.hpp"
+#include "smp.hpp"
+#include "sysreg.hpp"
+
+namespace {
+  const uint64_t kGICDBase = 0x08000000;  // ディストリビュータ
+  const uint64_t kGICCBase = 0x08010000;  // GICv2 の CPU インタフェース
+  const uint64_t kGICRBase = 0x080a0000;  // GICv3 のリディストリビュータ
+
+  const uint64_t kGICD_CTLR       = 0x0000;
+  const uint64_t kGICD_TYPER      = 0x0004;
+  const uint64_t kGICD_IGROUPR    = 0x0080;
+  const uint64_t kGICD_ISENABLER  = 0x0100;
+  const uint64_t kGICD_ICENABLER  = 0x0180;
+  const uint64_t kGICD_IPRIORITYR = 0x0400;
+  const uint64_t kGICD_ITARGETSR  = 0x0800;
+  const uint64_t kGICD_ICFGR      = 0x0c00;
+  const uint64_t kGICD_SGIR       = 0x0f00;
+  const uint64_t kGICD_IROUTER    = 0x6000;
+  const uint64_t kGICD_PIDR2      = 0xffe8;
+
+  const uint64_t kGICC_CTLR = 0x0000;
+  const uint64_t kGICC_PMR  = 0x0004;
+  const uint64_t kGICC_IAR  = 0x000c;
+  const uint64_t kGICC_EOIR = 0x0010;
+
+  const uint64_t kGICR_CTLR   = 0x0000;
+  const uint64_t kGICR_TYPER  = 0x0008;
+  const uint64_t kGICR_WAKER  = 0x0014;
+  const uint64_t kGICR_SGI    = 0x10000;  // SGI と PPI を扱うフレーム
+  const uint64_t kGICR_Stride = 0x20000;
+  /** @brief 写しておくリディストリビュータの数．CPU 1 個に 1 つずつ． */
+  const int kGICRFrames = kMaxCPUs;
+
+  const uint32_t kGICD_CTLR_RWP = 1u << 31;
+  const uint32_t kGICR_WAKER_ProcessorSleep = 1u << 1;
+  const uint32_t kGICR_WAKER_ChildrenAsleep = 1u << 2;
+  const uint64_t kGICR_TYPER_Last = 1u << 4;
+
+  const uint8_t kDefaultPriority = 0xa0;
+
+  int gic_version = 0;
+  uint32_t num_interrupts = 0;
+
+  /* 以下は CurrentCPUIndex() の番号で引く．MPIDR の Aff0 はクラスタごとに重なる． */
+  /** @brief CPU ごとのリディストリビュータ（GICv3）．SGI と PPI はここで設定する． */
+  uint64_t redist_base[kMaxCPUs];
+  /** @brief CPU ごとの MPIDR（GICv3）．SGI の宛先に使う． */
+  uint64_t cpu_mpidr[kMaxCPUs];
+  /** @brief CPU ごとの CPU インタフェースを表すビット（GICv2）．SGI と SPI の宛先に使う． */
+  uint8_t cpu_interface_mask[kMaxCPUs];
+
+  void SetBit(uint64_t base, uint32_t intid) {
+    io_write32(base + 4 * (intid / 32), 1u << (intid % 32));
+  }
+
+  void WriteByte(uint64_t base, uint32_t intid, uint8_t value) {
+    const uint64_t reg = base + (intid & ~3u);
+    const int shift = 8 * (intid % 4);
+    io_write32(reg, (io_read32(reg) & ~(0xffu << shift)) | (value << shift));
+  }
+
+  void WriteField2(uint64_t base, uint32_t intid, uint32_t value) {
+    const uint64_t reg = base + 4 * (intid / 16);
+    const int shift = 2 * (intid % 16);
+    io_write32(reg, (io_read32(reg) & ~(3u << shift)) | (value << shift));
+  }
+
+  void WaitForDistributor() {
+    while (io_read32(kGICDBase + kGICD_CTLR) & kGICD_CTLR_RWP);
+  }
+
+  /** @brief SGI と PPI（INTID < 32）の設定先．GICv2 では CPU ごとにバンクされたディストリビュータ． */
+  uint64_t PrivateBase() {
+    if (gic_version == 3) {
+      return redist_base[CurrentCPUIndex()] + kGICR_SGI;
+    }
+    return kGICDBase;
+  }
+
+  /** @brief 写してあるフレームから mpidr の CPU のリディストリビュータを探す．無ければ 0． */
+  uint64_t FindRedistributor(uint64_t mpidr) {
+    const uint32_t affinity =
+      (mpidr & 0xffffffu) | (((mpidr >> 32) & 0xffu) << 24);
+    for (int i = 0; i < kGICRFrames; ++i) {
+      const uint64_t base = kGICRBase + i * kGICR_Stride;
+      const uint64_t typer = io_read32(base + kGICR_TYPER) |
+        (static_cast<uint64_t>(io_read32(base + kGICR_TYPER + 4)) << 32);
+      if ((typer >> 32) == affinity) {
+        return base;
+      }
+      if (typer & kGICR_TYPER_Last) {
+        break;
+      }
+    }
+    return 0;
+  }
+}
+
+Error InitializeGIC() {
+  // ディストリビュータと CPU インタフェース，CPU kGICRFrames 個分のリディストリビュータ
+  if (auto err = MapMMIO(kGICDBase, 0x20000)) {
+    return err;
+  }
+  if (auto err = MapMMIO(kGICRBase, kGICRFrames * kGICR_Stride)) {
+    return err;
+  }
+
+  const uint32_t arch_rev = (io_read32(kGICDBase + kGICD_PIDR2) >> 4) & 0xfu;
+  if (arch_rev == 1 || arch_rev == 2) {
+    gic_version = 2;
+  } else if (arch_rev == 3 || arch_rev == 4) {
+    gic_version = 3;
+  } else {
+    return MAKE_ERROR(Error::kNoInterruptController);
+  }
+
+  num_interrupts = 32 * ((io_read32(kGICDBase + kGICD_TYPER) & 0x1fu) + 1);
+  if (num_interrupts > kGICMaxInterrupts) {
+    num_interrupts = kGICMaxInterrupts;
+  }
+
+  io_write32(kGICDBase + kGICD_CTLR, 0);
+  WaitForDistributor();
+  // SPI はすべて無効にし，グループ 1（セキュリティ拡張が無ければ IRQ として通知される）にする
+  for (uint32_t intid = 32; intid < num_interrupts; intid += 32) {
+    io_write32(kGICDBase + kGICD_ICENABLER + intid / 8, ~0u);
+    io_write32(kGICDBase + kGICD_IGROUPR + intid / 8, ~0u);
+  }
+  if (gic_version == 3) {
+    // ARE_S | ARE_NS を先に立ててから各グループを有効にする
+    io_write32(kGICDBase + kGICD_CTLR, (1u << 4) | (1u << 5));
+    WaitForDistributor();
+    io_write32(kGICDBase + kGICD_CTLR, (1u << 4) | (1u << 5) | 0x3u);
+  } else {
+    io_write32(kGICDBase + kGICD_CTLR, 0x3u);
+  }
+  WaitForDistributor();
+
+  return InitializeGICCPUInterface();
+}
+
+Error InitializeGICCPUInterface() {
+  const int cpu = CurrentCPUIndex();
+  if (gic_version == 3) {
+    const uint64_t mpidr = READ_SYSREG(mpidr_el1);
+    const uint64_t base = FindRedistributor(mpidr);
+    if (base == 0) {
+      return MAKE_ERROR(Error::kNoInterruptController);
+    }
+    redist_base[cpu] = base;
+    cpu_mpidr[cpu] = mpidr;
+
+    io_write32(base + kGICR_WAKER,
+               io_read32(base + kGICR_WAKER) & ~kGICR_WAKER_ProcessorSleep);
+    while (io_read32(base + kGICR_WAKER) & kGICR_WAKER_ChildrenAsleep);
+    io_write32(base + kGICR_SGI + kGICD_ICENABLER, ~0u);
+    io_write32(base + kGICR_SGI + kGICD_IGROUPR, ~0u);
+
+    // システムレジスタで CPU インタフェースを操作する
+    if (CurrentEL() == 2) {
+      WRITE_SYSREG(S3_4_C12_C9_5, READ_SYSREG(S3_4_C12_C9_5) | 0x9u);  // ICC_SRE_EL2: Enable | SRE
+    }
+    WRITE_SYSREG(S3_0_C12_C12_5, READ_SYSREG(S3_0_C12_C12_5) | 0x1u);  // ICC_SRE_EL1: SRE
+    InstructionBarrier();
+    WRITE_SYSREG(S3_0_C4_C6_0, 0xff);   // ICC_PMR_EL1
+    WRITE_SYSREG(S3_0_C12_C12_4, 0);    // ICC_CTLR_EL1: EOImode = 0
+    WRITE_SYSREG(S3_0_C12_C12_7, 1);    // ICC_IGRPEN1_EL1
+    InstructionBarrier();
+  } else {
+    // ITARGETSR0..7 は読んだ CPU 自身のインタフェースを表す値を返す
+    cpu_interface_mask[cpu] = io_read32(kGICDBase + kGICD_ITARGETSR) & 0xffu;
+    io_write32(kGICDBase + kGICD_ICENABLER, ~0u);
+    io_write32(kGICDBase + kGICD_IGROUPR, ~0u);
+    io_write32(kGICCBase + kGICC_PMR, 0xff);
+    io_write32(kGICCBase + kGICC_CTLR, 0x3u);  // EnableGrp0 | EnableGrp1
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+int GICVersion() {
+  return gic_version;
+}
+
+void GICEnableInterrupt(uint32_t intid, bool edge) {
+  if (gic_version == 0 || intid >= kGICMaxInterrupts) {
+    return;
+  }
+
+  const uint64_t base = intid < 32 ? PrivateBase() : kGICDBase;
+  WriteByte(base + kGICD_IPRIORITYR, intid, kDefaultPriority);
+  if (intid >= 16) {  // SGI のトリガは固定
+    WriteField2(base + kGICD_ICFGR, intid, edge ? 2u : 0u);
+  }
+  if (intid >= 32) {
+    if (gic_version == 3) {
+      const uint64_t mpidr = READ_SYSREG(mpidr_el1);
+      const uint64_t route = (mpidr & 0xffffffu) | (((mpidr >> 32) & 0xffu) << 32);
+      io_write32(kGICDBase + kGICD_IROUTER + 8 * intid, route & 0xffffffffu);
+      io_write32(kGICDBase + kGICD_IROUTER + 8 * intid + 4, route >> 32);
+    } else {
+      WriteByte(kGICDBase + kGICD_ITARGETSR, intid, cpu_interface_mask[CurrentCPUIndex()]);
+    }
+  }
+  SetBit(base + kGICD_ISENABLER, intid);
+}
+
+void GICDisableInterrupt(uint32_t intid) {
+  if (gic_version == 0 || intid >= kGICMaxInterrupts) {
+    return;
+  }
+  const uint64_t base = intid < 32 ? PrivateBase() : kGICDBase;
+  SetBit(base + kGICD_ICENABLER, intid);
+}
+
+uint32_t GICAcknowledge() {
+  if (gic_version == 3) {
+    return READ_SYSREG(S3_0_C12_C12_0);  // ICC_IAR1_EL1
+  }
+  return io_read32(kGICCBase + kGICC_IAR);
+}
+
+uint32_t GICInterruptId(uint32_t ack) {
+  if (gic_version == 3) {
+    return ack & 0xffffffu;
+  }
+  return ack & 0x3ffu;
+}
+
+void GICEndOfInterrupt(uint32_t ack) {
+  if (gic_version == 3) {
+    WRITE_SYSREG(S3_0_C12_C12_1, ack);  // ICC_EOIR1_EL1
+  } else {
+    io_write32(kGICCBase + kGICC_EOIR, ack);
+  }
+}
+
+void GICSendSGI(uint32_t intid, int cpu) {
+  if (cpu < 0 || cpu >= kMaxCPUs) {
+    return;
+  }
+  // 宛先の CPU が読むデータを書き終えてから割り込みを送る
+  __asm__ volatile("dsb ishst" : : : "memory");
+  if (gic_version == 3) {
+    const uint64_t mpidr = cpu_mpidr[cpu];
+    const uint64_t aff0 = mpidr & 0xfu;
+    const uint64_t value = (((mpidr >> 32) & 0xffu) << 48) |  // Aff3
+                           (((mpidr >> 16) & 0xffu) << 32) |  // Aff2
+                           ((intid & 0xfu) << 24) |
+                           (((mpidr >> 8) & 0xffu) << 16) |   // Aff1
+                           (1u << aff0);                      // TargetList
+    WRITE_SYSREG(S3_0_C12_C11_5, value);  // ICC_SGI1R_EL1
+    InstructionBarrier();
+  } else if (gic_version == 2) {
+    const uint32_t mask = cpu_interface_mask[cpu];
+    io_write32(kGICDBase + kGICD_SGIR, (mask << 16) | (intid & 0xfu));
+  }
+}
@@ -0,0 +1,72 @@
+/**************************************************************/
+/**
+    @file    gic.hpp
+
+    @brief   QEMU virt マシンの割り込みコントローラ（GICv2 / GICv3）．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __GIC_HPP__
+#define __GIC_HPP__
+
+#include <cstdint>
+
+#include "error.hpp"
+
+/** @brief 割り込み番号（INTID）の上限．SPI はこれ未満のものだけ扱う． */
+const uint32_t kGICMaxInterrupts = 256;
+
+/** @brief 割り当てられた割り込みが無いときに GICAcknowledge が返す値． */
+const uint32_t kGICSpuriousInterrupt = 1023;
+
+/** @brief ディストリビュータのバージョンを調べ，ディストリビュータと
+ * 現在の CPU のインタフェースを有効にする．
+ */
+Error InitializeGIC();
+
+/** @brief 現在の CPU のインタフェース（GICv3 ではリディストリビュータも）を有効にする．
+ *
+ * InitializeGIC が起動した CPU について呼ぶので，ほかの CPU だけが呼べばよい．
+ * CPU ごとの設定は CurrentCPUIndex() の番号で覚えるので，InitializeSMP の後に呼ぶ．
+ * 写してあるリディストリビュータに現在の CPU のものが無ければ
+ * Error::kNoInterruptController を返す．
+ */
+Error InitializeGICCPUInterface();
+
+/** @brief GIC のアーキテクチャのバージョン（2 または 3）．見つからなければ 0． */
+int GICVersion();
+
+/** @brief 割り込み intid を優先度 0xa0 で有効にし，SPI なら現在の CPU へ配送する．
+ *
+ * @param edge  エッジトリガなら true，レベルトリガなら false．
+ */
+void GICEnableInterrupt(uint32_t intid, bool edge);
+
+/** @brief 割り込み intid を無効にする． */
+void GICDisableInterrupt(uint32_t intid);
+
+/** @brief 発生中の割り込みを受け付ける．
+ *
+ * 戻り値は GICEndOfInterrupt にそのまま渡す．GICv2 の SGI では送信元の CPU 番号を含むので，
+ * 割り込み番号は GICInterruptId で取り出す．
+ */
+uint32_t GICAcknowledge();
+
+/** @brief GICAcknowledge の戻り値から INTID を取り出す． */
+uint32_t GICInterruptId(uint32_t ack);
+
+/** @brief GICAcknowledge で受け付けた割り込みの処理を終える． */
+void GICEndOfInterrupt(uint32_t ack);
+
+/** @brief CPU 番号 cpu（CurrentCPUIndex() の番号）の CPU にソフトウェア生成割り込み（SGI）intid を送る．
+ *
+ * 宛先の CPU で InitializeGICCPUInterface が済んでいること．
+ */
+void GICSendSGI(uint32_t intid, int cpu);
+
+#endif /* __GIC_HPP__ */
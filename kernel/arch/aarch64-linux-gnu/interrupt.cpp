@@ -0,0 +1,139 @@
+/**************************************************************/
+/**
+    @file    interrupt.cpp
+
+    @brief   例外ベクタと割り込みハンドラの登録．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "interrupt.hpp"
+
+#include "format.hpp"
+#include "gic.hpp"
+#include "halt.hpp"
+#include "memory_manager.hpp"
+#include "sysreg.hpp"
+#include "uart.hpp"
+
+extern "C" char exception_vectors_el1[];
+extern "C" char exception_vectors_el2[];
+
+namespace {
+  struct HandlerEntry {
+    InterruptHandler handler;
+    void* arg;
+  };
+
+  HandlerEntry handlers[kGICMaxInterrupts];
+
+  const uint64_t kHCR_FMO = 1u << 3;
+  const uint64_t kHCR_IMO = 1u << 4;
+  const uint64_t kHCR_AMO = 1u << 5;
+
+  enum ExceptionType {
+    kSynchronous = 0,
+    kIRQ = 1,
+    kFIQ = 2,
+    kSError = 3,
+  };
+
+  void DispatchInterrupts() {
+    for (;;) {
+      const uint32_t ack = GICAcknowledge();
+      const uint32_t intid = GICInterruptId(ack);
+      if (intid >= 1020 && intid <= 1023) {  // 特別な INTID（保留中の割り込みなし）
+        return;
+      }
+      if (intid < kGICMaxInterrupts && handlers[intid].handler) {
+        handlers[intid].handler(intid, handlers[intid].arg);
+      }
+      GICEndOfInterrupt(ack);
+    }
+  }
+
+  /** @brief 回復できない例外の情報を UART へ直接書いて止まる．
+   *
+   * ログのリングはメインループでしか掃き出されないので使わない．
+   */
+  [[noreturn]] void Panic(const ExceptionFrame* frame, uint64_t kind) {
+    uint64_t esr, far;
+    if (CurrentEL() == 2) {
+      esr = READ_SYSREG(esr_el2);
+      far = READ_SYSREG(far_el2);
+    } else {
+      esr = READ_SYSREG(esr_el1);
+      far = READ_SYSREG(far_el1);
+    }
+
+    char buf[160];
+    BufferSink sink{buf, sizeof(buf)};
+    Format(sink, "\nunhandled exception: kind=%lu ESR=%08lx ELR=%016lx FAR=%016lx SPSR=%08lx\n",
+           kind, esr, frame->elr, far, frame->spsr);
+    UARTWrite(buf, sink.Length());
+    UARTFlush();
+    while (1) halt();
+  }
+}
+
+extern "C" void HandleException(ExceptionFrame* frame, uint64_t kind) {
+  switch (kind & 3) {
+  case kIRQ:
+  case kFIQ:
+    DispatchInterrupts();
+    return;
+  default:
+    Panic(frame, kind);
+  }
+}
+
+namespace {
+  void SetVectorBase() {
+    if (CurrentEL() == 2) {
+      WRITE_SYSREG(vbar_el2, reinterpret_cast<uint64_t>(exception_vectors_el2));
+      // EL2 で動いているときは物理割り込みを EL2 で受け取る
+      WRITE_SYSREG(hcr_el2, READ_SYSREG(hcr_el2) | kHCR_FMO | kHCR_IMO | kHCR_AMO);
+    } else {
+      WRITE_SYSREG(vbar_el1, reinterpret_cast<uint64_t>(exception_vectors_el1));
+    }
+    InstructionBarrier();
+  }
+}
+
+Error InitializeInterrupt() {
+  SetVectorBase();
+  // もう UEFI の例外ベクタへは飛ばない
+  ReleaseFirmwareCode();
+  if (auto err = InitializeGIC()) {
+    return err;
+  }
+  EnableInterrupts();
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error InitializeSecondaryInterrupt() {
+  SetVectorBase();
+  return InitializeGICCPUInterface();
+}
+
+Error SetInterruptHandler(uint32_t intid, InterruptHandler handler, void* arg,
+                          bool edge) {
+  if (intid >= kGICMaxInterrupts) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+  if (GICVersion() == 0) {
+    return MAKE_ERROR(Error::kNoInterruptController);
+  }
+
+  const uint64_t daif = READ_SYSREG(daif);
+  DisableInterrupts();
+  handlers[intid] = {handler, arg};
+  WRITE_SYSREG(daif, daif);
+  GICEnableInterrupt(intid, edge);
+  return MAKE_ERROR(Error::kSuccess);
+}
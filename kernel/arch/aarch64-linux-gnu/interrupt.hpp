@@ -0,0 +1,70 @@
+/**************************************************************/
+/**
+    @file    interrupt.hpp
+
+    @brief   例外ベクタと割り込みハンドラの登録．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __INTERRUPT_HPP__
+#define __INTERRUPT_HPP__
+
+#include <cstdint>
+
+#include "error.hpp"
+
+/** @brief exception.S が例外の入口でスタックに保存するレジスタ． */
+struct ExceptionFrame {
+  uint64_t x[31];
+  uint64_t elr, spsr, fpsr, fpcr;
+  uint64_t reserved;
+  __uint128_t q[32];
+};
+static_assert(sizeof(ExceptionFrame) == 800, "keep in sync with exception.S");
+
+/** @brief 割り込みハンドラ．割り込みの受付と終了は呼び出し側が行う． */
+using InterruptHandler = void (*)(uint32_t intid, void* arg);
+
+/** @brief 例外ベクタを登録し，割り込みコントローラを初期化して IRQ を受け付ける．
+ *
+ * ブート CPU から呼ぶ．UEFI の例外ベクタのために残していたメモリは空きに戻す．
+ */
+Error InitializeInterrupt();
+
+/** @brief 2 つ目以降の CPU で例外ベクタと CPU インタフェースを設定する．
+ *
+ * InitializeInterrupt の後に，その CPU の上で呼ぶ．IRQ はマスクしたまま戻る．
+ * その CPU のリディストリビュータが見つからなければ Error::kNoInterruptController を返す．
+ */
+Error InitializeSecondaryInterrupt();
+
+/** @brief 割り込み intid のハンドラを登録し，その割り込みを有効にする．
+ *
+ * @param edge  エッジトリガなら true，レベルトリガなら false．
+ */
+Error SetInterruptHandler(uint32_t intid, InterruptHandler handler, void* arg,
+                          bool edge);
+
+inline void DisableInterrupts() {
+  __asm__ volatile("msr daifset, #2" : : : "memory");
+}
+
+inline void EnableInterrupts() {
+  __asm__ volatile("msr daifclr, #2" : : : "memory");
+}
+
+/** @brief 割り込みが来るまで CPU を止める．
+ *
+ * IRQ がマスクされたままでも保留中の割り込みがあれば戻るので，
+ * DisableInterrupts の後で待つ条件を確かめてから呼べば取りこぼさない．
+ */
+inline void WaitForInterrupt() {
+  __asm__ volatile("wfi" : : : "memory");
+}
+
+#endif /* __INTERRUPT_HPP__ */
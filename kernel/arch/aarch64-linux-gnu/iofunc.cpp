@@ -16,7 +16,7 @@
 
 #include "iofunc.hpp"
 
-extern int printk(const char* format, ...);
+#include "logger.hpp"
 
 extern "C" {
     void io_write32(uint64_t address, uint32_t data)
@@ -0,0 +1,399 @@
+/**************************************************************/
+/**
+    @file    paging.cpp
+
+    @brief   ページテーブルの管理．
+
+    UEFI（ArmVirtQemu）は 4 KiB 粒度で物理アドレスと同じ仮想アドレスへ写す
+    変換テーブルを，ブートサービスの領域に置いている．
+    カーネルは起動後に UEFI と同じ形（粒度と段数）の自前の変換テーブルへ切り替え，
+    メモリの種類ごとに MAIR の属性を使い分ける．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "paging.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "frame_buffer_config.hpp"
+#include "logger.hpp"
+#include "memory_manager.hpp"
+#include "memory_map.hpp"
+#include "sysreg.hpp"
+
+namespace {
+  const uint64_t kDescriptorTypeMask = 3;
+  const uint64_t kDescriptorTable = 3;  // レベル 0〜2 で次の変換テーブルを指す
+  const uint64_t kOutputAddressMask = 0x0000fffffffff000;
+
+  /** @brief TCR が決める TTBR0 の変換テーブルの形．4 KiB 粒度のときだけ意味を持つ． */
+  struct TableGeometry {
+    int va_bits;         // 仮想アドレスのビット数（64 - T0SZ）
+    int start_level;     // TTBR0 が指すテーブルの段
+    size_t num_entries;  // 最初のテーブルのエントリ数
+  };
+
+  uint64_t CurrentTCR() {
+    return CurrentEL() == 2 ? READ_SYSREG(tcr_el2) : READ_SYSREG(tcr_el1);
+  }
+
+  bool IsGranule4KiB(uint64_t tcr) {
+    return ((tcr >> 14) & 3) == 0;  // TG0
+  }
+
+  TableGeometry GeometryFromTCR(uint64_t tcr) {
+    // 1 段で 9 ビットずつ解決し，最後の 12 ビットはページ内オフセット
+    const int va_bits = 64 - (tcr & 0x3f);  // T0SZ
+    const int levels = (va_bits - 12 + 8) / 9;
+    return {va_bits, 4 - levels, size_t{1} << (va_bits - 12 - 9 * (levels - 1))};
+  }
+
+  void ReserveTable(BitmapMemoryManager& memory_manager,
+                    uint64_t table_addr, int level, size_t num_entries) {
+    memory_manager.MarkAllocated(FrameID{table_addr / kBytesPerFrame}, 1);
+    if (level == 3) {
+      return;
+    }
+
+    auto table = reinterpret_cast<const uint64_t*>(table_addr);
+    for (size_t i = 0; i < num_entries; ++i) {
+      if ((table[i] & kDescriptorTypeMask) == kDescriptorTable) {
+        ReserveTable(memory_manager, table[i] & kOutputAddressMask, level + 1, 512);
+      }
+    }
+  }
+}
+
+void ReserveFirmwareMemory(BitmapMemoryManager& memory_manager, const MemoryMap& memory_map) {
+  const uint64_t tcr = CurrentTCR();
+  const uint64_t ttbr0 = CurrentEL() == 2 ? READ_SYSREG(ttbr0_el2) : READ_SYSREG(ttbr0_el1);
+  const uint64_t vbar = CurrentEL() == 2 ? READ_SYSREG(vbar_el2) : READ_SYSREG(vbar_el1);
+
+  ReserveFirmwareCode(memory_manager, memory_map, vbar);
+
+  if (!IsGranule4KiB(tcr)) {
+    Log(kWarn, "translation granule is not 4 KiB, page tables are not reserved\n");
+    return;
+  }
+
+  const auto geometry = GeometryFromTCR(tcr);
+  ReserveTable(memory_manager, ttbr0 & kOutputAddressMask,
+               geometry.start_level, geometry.num_entries);
+}
+
+namespace {
+  /* MAIR の属性番号．0〜3 は UEFI（ArmPkg）と同じ並びにしておき，
+   * 切り替えの途中で UEFI の変換テーブルの属性の意味が変わらないようにする．
+   */
+  const uint64_t kAttrDeviceNGnRnE = 0;
+  const uint64_t kAttrNormalNC = 1;
+  const uint64_t kAttrNormalWT = 2;
+  const uint64_t kAttrNormalWB = 3;
+  const uint64_t kAttrDeviceNGnRE = 4;
+  const uint64_t kMAIR =
+    (0x00ull << (8 * kAttrDeviceNGnRnE)) |
+    (0x44ull << (8 * kAttrNormalNC)) |
+    (0xbbull << (8 * kAttrNormalWT)) |
+    (0xffull << (8 * kAttrNormalWB)) |
+    (0x04ull << (8 * kAttrDeviceNGnRE));
+
+  const uint64_t kDescriptorBlock = 1;  // レベル 1, 2 のブロック
+  const uint64_t kDescriptorPage = 3;   // レベル 3 のページ
+  const uint64_t kDescriptorValid = 1;
+  const uint64_t kAttrIndexShift = 2;
+  const uint64_t kAP1 = 1ull << 6;           // EL2 の変換では RES1
+  const uint64_t kInnerShareable = 3ull << 8;
+  const uint64_t kAccessFlag = 1ull << 10;
+  const uint64_t kPXN = 1ull << 53;          // EL1 の変換だけ．EL2 では RES0
+  const uint64_t kUXN = 1ull << 54;          // EL2 の変換では XN
+
+  const int kEntriesPerTable = 512;
+
+  /** @brief UEFI の TCR から読んだテーブルの形．カーネルのテーブルも同じ形で作る． */
+  TableGeometry geometry;
+  uint64_t* root_table = nullptr;
+  /** @brief UEFI の TCR が想定外でカーネルのテーブルを作れず，UEFI のテーブルを使い続けるなら真． */
+  bool firmware_tables = false;
+  /** @brief root_table が TTBR0 に設定されていれば真．以後の書き換えは TLB を意識する． */
+  bool tables_active = false;
+
+  /** @brief level の 1 エントリが写す大きさ．レベル 1 で 1 GiB，2 で 2 MiB，3 で 4 KiB． */
+  uint64_t EntryBytes(int level) {
+    return uint64_t{1} << (12 + 9 * (3 - level));
+  }
+
+  size_t EntryIndex(uint64_t addr, int level) {
+    return (addr >> (12 + 9 * (3 - level))) & (kEntriesPerTable - 1);
+  }
+
+  uint64_t LeafAttributes(MemoryAttribute attribute) {
+    const bool el2 = CurrentEL() == 2;
+    uint64_t bits = kAccessFlag | (el2 ? kAP1 : 0);
+    const uint64_t no_exec = el2 ? kUXN : kUXN | kPXN;
+    switch (attribute) {
+    case MemoryAttribute::kNormal:
+      bits |= (kAttrNormalWB << kAttrIndexShift) | kInnerShareable;
+      break;
+    case MemoryAttribute::kWriteCombining:
+      bits |= (kAttrNormalNC << kAttrIndexShift) | kInnerShareable | no_exec;
+      break;
+    case MemoryAttribute::kDevice:
+      bits |= (kAttrDeviceNGnRE << kAttrIndexShift) | no_exec;
+      break;
+    }
+    return bits;
+  }
+
+  void InvalidateTLB() {
+    if (CurrentEL() == 2) {
+      __asm__ volatile("dsb ishst\n\ttlbi alle2is\n\tdsb ish\n\tisb" : : : "memory");
+    } else {
+      __asm__ volatile("dsb ishst\n\ttlbi vmalle1is\n\tdsb ish\n\tisb" : : : "memory");
+    }
+  }
+
+  WithError<uint64_t*> NewTable() {
+    auto [ frame, err ] = memory_manager->Allocate(1);
+    if (err) {
+      return { nullptr, err };
+    }
+    auto table = reinterpret_cast<uint64_t*>(frame.Frame());
+    memset(table, 0, kBytesPerFrame);
+    return { table, MAKE_ERROR(Error::kSuccess) };
+  }
+
+  void FreeTable(uint64_t* table, int level) {
+    if (level < 3) {
+      for (int i = 0; i < kEntriesPerTable; ++i) {
+        if ((table[i] & kDescriptorTypeMask) == kDescriptorTable) {
+          FreeTable(reinterpret_cast<uint64_t*>(table[i] & kOutputAddressMask), level + 1);
+        }
+      }
+    }
+    memory_manager->Free(FrameID{reinterpret_cast<uintptr_t>(table) / kBytesPerFrame}, 1);
+  }
+
+  /** @brief 有効なエントリを書き換えるときは一度無効にして TLB から追い出す（break-before-make）． */
+  void WriteEntry(uint64_t* entry, uint64_t value) {
+    if (tables_active && (*entry & kDescriptorValid)) {
+      *entry = 0;
+      InvalidateTLB();
+    }
+    *entry = value;
+  }
+
+  Error MapRange(uint64_t* table, int level, uint64_t addr, uint64_t end, uint64_t attributes) {
+    const uint64_t entry_bytes = EntryBytes(level);
+    while (addr < end) {
+      uint64_t* entry = &table[EntryIndex(addr, level)];
+      const uint64_t next = std::min((addr & ~(entry_bytes - 1)) + entry_bytes, end);
+
+      // レベル 0 にはブロックを置けない
+      if (level >= 1 && next - addr == entry_bytes) {
+        const uint64_t desc = addr | attributes | (level == 3 ? kDescriptorPage : kDescriptorBlock);
+        if (*entry != desc) {
+          const uint64_t old = *entry;
+          WriteEntry(entry, desc);
+          if (level < 3 && (old & kDescriptorTypeMask) == kDescriptorTable) {
+            FreeTable(reinterpret_cast<uint64_t*>(old & kOutputAddressMask), level + 1);
+          }
+        }
+        addr = next;
+        continue;
+      }
+
+      uint64_t* next_table;
+      if ((*entry & kDescriptorTypeMask) == kDescriptorTable) {
+        next_table = reinterpret_cast<uint64_t*>(*entry & kOutputAddressMask);
+      } else {
+        auto [ t, err ] = NewTable();
+        if (err) {
+          return err;
+        }
+        next_table = t;
+        if (*entry & kDescriptorValid) {
+          // ブロックを分割する．残りの部分は元のブロックと同じ写し方を保つ
+          const uint64_t old_base = *entry & kOutputAddressMask;
+          const uint64_t old_attributes = *entry & ~(kOutputAddressMask | kDescriptorTypeMask);
+          const uint64_t type = level + 1 == 3 ? kDescriptorPage : kDescriptorBlock;
+          for (int i = 0; i < kEntriesPerTable; ++i) {
+            next_table[i] = (old_base + i * EntryBytes(level + 1)) | old_attributes | type;
+          }
+        }
+        __asm__ volatile("dsb ishst" : : : "memory");
+        WriteEntry(entry, reinterpret_cast<uint64_t>(next_table) | kDescriptorTable);
+      }
+      if (auto err = MapRange(next_table, level + 1, addr, next, attributes)) {
+        return err;
+      }
+      addr = next;
+    }
+    return MAKE_ERROR(Error::kSuccess);
+  }
+
+  bool IsRAM(MemoryType type) {
+    switch (type) {
+    case MemoryType::kEfiLoaderCode:
+    case MemoryType::kEfiLoaderData:
+    case MemoryType::kEfiBootServicesCode:
+    case MemoryType::kEfiBootServicesData:
+    case MemoryType::kEfiRuntimeServicesCode:
+    case MemoryType::kEfiRuntimeServicesData:
+    case MemoryType::kEfiConventionalMemory:
+    case MemoryType::kEfiACPIReclaimMemory:
+    case MemoryType::kEfiACPIMemoryNVS:
+    case MemoryType::kEfiPersistentMemory:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  struct Range {
+    uint64_t begin, end;
+  };
+
+  /** @brief RAM の範囲．隣り合う記述子をまとめてから写し，大きなブロックを使えるようにする． */
+  std::array<Range, 256> ram_ranges;
+
+  Error MapRAM(const MemoryMap& memory_map) {
+    size_t num_ranges = 0;
+    const auto base = reinterpret_cast<uintptr_t>(memory_map.buffer);
+    for (uintptr_t iter = base; iter < base + memory_map.map_size;
+         iter += memory_map.descriptor_size) {
+      auto& desc = *reinterpret_cast<const MemoryDescriptor*>(iter);
+      const auto type = static_cast<MemoryType>(desc.type);
+      const uint64_t end = desc.physical_start + desc.number_of_pages * kUEFIPageSize;
+      if (type == MemoryType::kEfiMemoryMappedIO) {
+        if (auto err = MapMemory(desc.physical_start, end - desc.physical_start,
+                                 MemoryAttribute::kDevice)) {
+          return err;
+        }
+      } else if (IsRAM(type)) {
+        if (num_ranges == ram_ranges.size()) {
+          return MAKE_ERROR(Error::kFull);
+        }
+        ram_ranges[num_ranges++] = {desc.physical_start, end};
+      }
+    }
+
+    std::sort(ram_ranges.begin(), ram_ranges.begin() + num_ranges,
+              [](const Range& a, const Range& b) { return a.begin < b.begin; });
+    for (size_t i = 0; i < num_ranges;) {
+      Range r = ram_ranges[i++];
+      while (i < num_ranges && ram_ranges[i].begin <= r.end) {
+        r.end = std::max(r.end, ram_ranges[i++].end);
+      }
+      if (auto err = MapMemory(r.begin, r.end - r.begin, MemoryAttribute::kNormal)) {
+        return err;
+      }
+    }
+    return MAKE_ERROR(Error::kSuccess);
+  }
+
+  /** @brief [addr, addr + size) のデータキャッシュを PoC まで書き戻して無効にする． */
+  void CleanInvalidateToPoC(uint64_t addr, uint64_t size) {
+    const uint64_t line = 4u << ((READ_SYSREG(ctr_el0) >> 16) & 0xf);  // DminLine
+    for (uint64_t p = addr & ~(line - 1); p < addr + size; p += line) {
+      __asm__ volatile("dc civac, %0" : : "r"(p) : "memory");
+    }
+    __asm__ volatile("dsb sy" : : : "memory");
+  }
+
+  /** @brief TTBR0 をカーネルのテーブルに切り替える．
+   *
+   * MMU を有効にしたまま切り替えるので，TCR（粒度，T0SZ，テーブルを辿るときの
+   * キャッシュ属性）は UEFI の設定をそのまま使い，テーブルの形を新旧で揃える．
+   * MAIR の属性番号 0〜3 は UEFI と同じ意味なので先に書き換えてよい．
+   * TTBR0 を書いてから TLB を無効にするまでは古い変換が残りうるが，
+   * 新旧のテーブルは実行中のコードとデータを同じアドレスと属性で写している．
+   */
+  void SwitchTables() {
+    const auto ttbr0 = reinterpret_cast<uint64_t>(root_table);
+    __asm__ volatile("dsb ish" : : : "memory");
+    if (CurrentEL() == 2) {
+      WRITE_SYSREG(mair_el2, kMAIR);
+      InstructionBarrier();
+      WRITE_SYSREG(ttbr0_el2, ttbr0);
+    } else {
+      WRITE_SYSREG(mair_el1, kMAIR);
+      InstructionBarrier();
+      WRITE_SYSREG(ttbr0_el1, ttbr0);
+    }
+    InstructionBarrier();
+    InvalidateTLB();
+    tables_active = true;
+  }
+
+  /** @brief UEFI の TCR のままカーネルのテーブルを使えるなら geometry を設定して真を返す． */
+  bool SetupGeometry() {
+    const uint64_t tcr = CurrentTCR();
+    // IRGN0 と ORGN0 がライトバックでなければ，テーブルへの書き込みをキャッシュから追い出す必要がある
+    const uint64_t irgn0 = (tcr >> 8) & 3, orgn0 = (tcr >> 10) & 3;
+    if (!IsGranule4KiB(tcr) || (irgn0 != 1 && irgn0 != 3) || (orgn0 != 1 && orgn0 != 3)) {
+      return false;
+    }
+    geometry = GeometryFromTCR(tcr);
+    return true;
+  }
+}
+
+Error InitializePaging(const MemoryMap& memory_map,
+                       const FrameBufferConfig& frame_buffer_config) {
+  if (!SetupGeometry()) {
+    firmware_tables = true;
+    return MAKE_ERROR(Error::kNotImplemented);
+  }
+  if (auto err = MapRAM(memory_map)) {
+    return err;
+  }
+
+  const uint64_t fb_base = reinterpret_cast<uintptr_t>(frame_buffer_config.frame_buffer);
+  const uint64_t fb_size = uint64_t{4} * frame_buffer_config.pixels_per_scan_line *
+    frame_buffer_config.vertical_resolution;
+  if (fb_size > 0) {
+    // UEFI がキャッシュ可能で写していた場合に備え，汚れた行が後から書き戻されないようにする
+    CleanInvalidateToPoC(fb_base, fb_size);
+    if (auto err = MapMemory(fb_base, fb_size, MemoryAttribute::kWriteCombining)) {
+      return err;
+    }
+  }
+
+  SwitchTables();
+  Log(kInfo, "paging: kernel page tables at %p\n", root_table);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error MapMemory(uint64_t base, uint64_t size, MemoryAttribute attribute) {
+  if (firmware_tables) {
+    return MAKE_ERROR(Error::kSuccess);  // UEFI は MMIO の領域もすべて写している
+  }
+  if (root_table == nullptr) {
+    if (!SetupGeometry()) {
+      return MAKE_ERROR(Error::kNotImplemented);
+    }
+    auto [ t, err ] = NewTable();
+    if (err) {
+      return err;
+    }
+    root_table = t;
+  }
+
+  const uint64_t begin = base & ~(kBytesPerFrame - 1);
+  const uint64_t end = (base + size + kBytesPerFrame - 1) & ~(kBytesPerFrame - 1);
+  if (size == 0 || end > (uint64_t{1} << geometry.va_bits)) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+  auto err = MapRange(root_table, geometry.start_level, begin, end, LeafAttributes(attribute));
+  __asm__ volatile("dsb ishst\n\tisb" : : : "memory");
+  return err;
+}
@@ -0,0 +1,66 @@
+/**************************************************************/
+/**
+    @file    paging.hpp
+
+    @brief   ページテーブルの管理．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __PAGING_HPP__
+#define __PAGING_HPP__
+
+#include <cstdint>
+
+#include "error.hpp"
+
+class BitmapMemoryManager;
+struct MemoryMap;
+struct FrameBufferConfig;
+
+/** @brief ブートサービスの領域にあってカーネルがまだ使っているものを使用中にする．
+ *
+ * カーネルは InitializePaging で切り替えるまで UEFI が作った TTBR0 のページテーブルで動くので，
+ * その変換テーブルのページを回収しないようにする．
+ * InitializeInterrupt で自前の例外ベクタを設定するまでは VBAR が UEFI のベクタを指すので，
+ * そのコードも ReleaseFirmwareCode を呼ぶまで使用中にする．
+ */
+void ReserveFirmwareMemory(BitmapMemoryManager& memory_manager, const MemoryMap& memory_map);
+
+/** @brief ページテーブルで写すときのメモリの種類． */
+enum class MemoryAttribute {
+  kNormal,          // RAM．ライトバックでキャッシュする．
+  kWriteCombining,  // フレームバッファ．キャッシュせず，書き込みはまとめてよい．
+  kDevice,          // MMIO．Device-nGnRE で，アクセスの順序と回数を保つ．
+};
+
+/** @brief カーネルのページテーブルを作って切り替える．
+ *
+ * メモリマップの RAM をライトバック，MMIO を Device-nGnRE，
+ * フレームバッファを Normal Non-cacheable で，物理アドレスと同じ仮想アドレスへ写す．
+ * 揃っていれば 1 GiB や 2 MiB のブロックで写し，TLB の消費を抑える．
+ * それ以外の MMIO は使う前に MapMMIO で写すこと．
+ * テーブルの形（粒度と T0SZ）は UEFI の TCR に合わせ，TCR は書き換えない．
+ * TCR が 4 KiB 粒度でないなどで合わせられなければ Error::kNotImplemented を返し，
+ * UEFI のテーブルを使い続ける．そのとき MapMemory は何もしない．
+ */
+Error InitializePaging(const MemoryMap& memory_map,
+                       const FrameBufferConfig& frame_buffer_config);
+
+/** @brief [base, base + size) を attribute で物理アドレスと同じ仮想アドレスへ写す．
+ *
+ * すでに写した範囲と重なってもよく，重なった部分は attribute で上書きする．
+ * ロックを持たないので，ブート CPU からだけ呼ぶこと．
+ */
+Error MapMemory(uint64_t base, uint64_t size, MemoryAttribute attribute);
+
+/** @brief デバイスのレジスタ [base, base + size) を Device-nGnRE で写す． */
+inline Error MapMMIO(uint64_t base, uint64_t size) {
+  return MapMemory(base, size, MemoryAttribute::kDevice);
+}
+
+#endif /* __PAGING_HPP__ */
@@ -9,7 +9,8 @@
 
 #include "iofunc.hpp"
 
-extern int printk(const char* format, ...);
+#include "logger.hpp"
+#include "paging.hpp"
 
 namespace {
   using namespace pci;
@@ -174,6 +175,10 @@ namespace pci {
 
   Error ScanAllBus() {
     num_device = 0;
+    // ECAM はバス 1 つにつき 1 MiB の構成空間を持つ
+    if (auto err = MapMMIO(EcamBaseAddress, 256 * 1024 * 1024)) {
+      return err;
+    }
 
     auto header_type = ReadHeaderType(0, 0, 0);
     if (IsSingleFunctionDevice(header_type)) {
@@ -223,4 +228,17 @@ namespace pci {
       MAKE_ERROR(Error::kSuccess)
     };
   }
+
+  WithError<uint32_t> GetInterruptId(const Device& dev) {
+    const uint8_t pin = (ReadConfReg(dev, 0x3c) >> 8) & 0xffu;
+    if (pin == 0 || pin > 4 || dev.bus != 0) {
+      return {0, MAKE_ERROR(Error::kNoPCIInterrupt)};
+    }
+
+    // QEMU virt はホストブリッジの INTA#..INTD# を SPI 3..6 に接続し，
+    // スロット番号でスウィズルする．ブリッジ配下のデバイスはまだ扱わない．
+    const uint32_t kFirstINTxSPI = 3;
+    const uint32_t spi = kFirstINTxSPI + (pin - 1 + dev.device) % 4;
+    return {32 + spi, MAKE_ERROR(Error::kSuccess)};
+  }
 }
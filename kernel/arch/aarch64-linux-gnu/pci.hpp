@@ -16,6 +16,7 @@ typedef uint64_t pci_adrs_t;
 #define  PCI_COMMAND_IO         0x1
 #define  PCI_COMMAND_MEMORY     0x2
 #define  PCI_COMMAND_MASTER     0x4
+#define  PCI_COMMAND_INTX_DISABLE 0x400
 
 namespace pci {
   /** @brief CONFIG_ADDRESS レジスタの IO ポートアドレス */
@@ -118,4 +119,11 @@ namespace pci {
   }
 
   WithError<uint64_t> ReadBar(Device& device, unsigned int bar_index);
+
+  /** @brief デバイスの INTx 割り込みが届く割り込みコントローラ上の番号を返す
+   *
+   * 割り込みピンレジスタ（0x3d）が 0 なら INTx を使わないデバイスなので
+   * Error::kNoPCIInterrupt を返す．
+   */
+  WithError<uint32_t> GetInterruptId(const Device& dev);
 }
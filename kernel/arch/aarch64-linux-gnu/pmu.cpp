@@ -0,0 +1,151 @@
+/**************************************************************/
+/**
+    @file    pmu.cpp
+
+    @brief   性能監視ユニット（PMUv3）のサイクルカウンタとイベントカウンタ．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "pmu.hpp"
+
+#include <algorithm>
+
+#include "sysreg.hpp"
+
+namespace {
+  const uint64_t kPMCREnable = 1u << 0;
+  const uint64_t kPMCREventReset = 1u << 1;
+  const uint64_t kPMCRCycleReset = 1u << 2;
+  const uint64_t kPMCRLongCycle = 1u << 6;
+  const uint64_t kPMCycleCounter = 1u << 31;
+  // EL1 に加えて EL2 でも数える．カーネルが EL2 で動く場合がある．
+  const uint64_t kPMFilterNSH = 1u << 27;
+
+  struct EventName {
+    uint16_t event;
+    const char* name;
+  };
+  const EventName kEventNames[] = {
+    {0x03, "L1D_REFILL"},
+    {0x04, "L1D_ACCESS"},
+    {0x08, "INST"},
+    {0x10, "BR_MISPRED"},
+    {0x11, "CYCLES"},
+    {0x13, "MEM_ACCESS"},
+    {0x16, "L2D_ACCESS"},
+    {0x17, "L2D_REFILL"},
+  };
+
+  const uint16_t kDefaultEvents[] = {0x08, 0x04, 0x03, 0x10};
+
+  bool available = false;
+  int num_counters = 0;
+  uint64_t implemented_events = 0;  // PMCEID1_EL0:PMCEID0_EL0
+  int num_events = 0;
+  uint16_t events[kPMUMaxEvents];
+
+  bool IsImplemented(uint16_t event) {
+    return event < 64 && ((implemented_events >> event) & 1);
+  }
+}
+
+bool InitializePMU() {
+  const uint64_t pmuver = (READ_SYSREG(id_aa64dfr0_el1) >> 8) & 0xfu;
+  if (pmuver == 0 || pmuver == 0xf) {
+    return false;
+  }
+
+  const uint64_t pmcr = READ_SYSREG(pmcr_el0);
+  num_counters = (pmcr >> 11) & 0x1fu;
+  implemented_events = (READ_SYSREG(pmceid1_el0) << 32) |
+                       (READ_SYSREG(pmceid0_el0) & 0xffffffffu);
+
+  WRITE_SYSREG(pmccfiltr_el0, kPMFilterNSH);
+  WRITE_SYSREG(pmcr_el0, pmcr | kPMCRLongCycle | kPMCRCycleReset |
+                         kPMCREventReset | kPMCREnable);
+  available = true;
+
+  if (!PMUSetEvents(kDefaultEvents,
+                    std::min<int>(num_counters, kPMUMaxEvents))) {
+    PMUSetEvents(nullptr, 0);
+  }
+  return true;
+}
+
+bool PMUAvailable() {
+  return available;
+}
+
+bool PMUSetEvents(const uint16_t* new_events, int n) {
+  if (!available || n > num_counters || n > kPMUMaxEvents) {
+    return false;
+  }
+
+  WRITE_SYSREG(pmcntenclr_el0, ~0u);
+  for (int i = 0; i < n; ++i) {
+    events[i] = new_events[i];
+    WRITE_SYSREG(pmselr_el0, i);
+    __asm__ volatile("isb");
+    WRITE_SYSREG(pmxevtyper_el0, kPMFilterNSH | new_events[i]);
+    WRITE_SYSREG(pmxevcntr_el0, 0);
+  }
+  num_events = n;
+  WRITE_SYSREG(pmcntenset_el0, kPMCycleCounter | ((1u << n) - 1));
+  __asm__ volatile("isb");
+  return true;
+}
+
+int PMUNumEvents() {
+  return num_events;
+}
+
+const char* PMUEventName(int i) {
+  if (i < 0 || i >= num_events || !IsImplemented(events[i])) {
+    return nullptr;
+  }
+  for (const auto& e : kEventNames) {
+    if (e.event == events[i]) {
+      return e.name;
+    }
+  }
+  return "EVENT";
+}
+
+void PMUStart() {
+  if (available) {
+    WRITE_SYSREG(pmcr_el0, READ_SYSREG(pmcr_el0) | kPMCREnable);
+    __asm__ volatile("isb");
+  }
+}
+
+void PMUStop() {
+  if (available) {
+    WRITE_SYSREG(pmcr_el0, READ_SYSREG(pmcr_el0) & ~kPMCREnable);
+    __asm__ volatile("isb");
+  }
+}
+
+void PMURead(PMUSample& sample) {
+  if (!available) {
+    sample = PMUSample{};
+    return;
+  }
+
+  __asm__ volatile("isb" : : : "memory");
+  sample.cycles = READ_SYSREG(pmccntr_el0);
+  for (int i = 0; i < kPMUMaxEvents; ++i) {
+    if (i < num_events) {
+      WRITE_SYSREG(pmselr_el0, i);
+      __asm__ volatile("isb");
+      sample.events[i] = READ_SYSREG(pmxevcntr_el0);
+    } else {
+      sample.events[i] = 0;
+    }
+  }
+}
@@ -0,0 +1,60 @@
+/**************************************************************/
+/**
+    @file    pmu.hpp
+
+    @brief   性能監視ユニット（PMUv3）のサイクルカウンタとイベントカウンタ．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __PMU_HPP__
+#define __PMU_HPP__
+
+#include <cstdint>
+
+/** @brief 1 つのカウンタグループで同時に数えるイベントの最大数． */
+const int kPMUMaxEvents = 4;
+
+/** @brief ある時点のカウンタの値．イベントカウンタは 32 ビットで一周する． */
+struct PMUSample {
+  uint64_t cycles;
+  uint32_t events[kPMUMaxEvents];
+};
+
+/** @brief PMU を検出し，サイクルカウンタと既定のイベントで数え始める．
+ *
+ * 既定のイベントは命令数，L1D アクセス，L1D リフィル，分岐予測ミス．
+ * PMU が無ければ false を返し，以降の読み出しは 0 を返す．
+ */
+bool InitializePMU();
+
+/** @brief PMU が使えるなら true． */
+bool PMUAvailable();
+
+/** @brief カウンタグループのイベントを events[0..n) に変更する．
+ *
+ * 実装されていないイベントのカウンタは 0 のままになる．
+ * n が使えるカウンタの数を超えたら false を返し，何も変更しない．
+ */
+bool PMUSetEvents(const uint16_t* events, int n);
+
+/** @brief カウンタグループのイベント数． */
+int PMUNumEvents();
+
+/** @brief カウンタグループの i 番目のイベントの名前．実装されていなければ nullptr． */
+const char* PMUEventName(int i);
+
+/** @brief すべてのカウンタを動かす． */
+void PMUStart();
+
+/** @brief すべてのカウンタを止める．値は保持される． */
+void PMUStop();
+
+/** @brief サイクルカウンタとカウンタグループの現在値を読む． */
+void PMURead(PMUSample& sample);
+
+#endif /* __PMU_HPP__ */
@@ -0,0 +1,112 @@
+/**************************************************************/
+/**
+    @file    psci.cpp
+
+    @brief   PSCI（Power State Coordination Interface）の呼び出し．
+
+    呼び出し方（SMC か HVC か）は ACPI の FADT の ARM ブートフラグに従う．
+    FADT が無ければ，EL1 で動いているときはハイパーバイザ（QEMU の virt なら QEMU 自身）へ HVC で，
+    EL2 で動いているときはセキュアモニタへ SMC で呼び出すと推測する．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "psci.hpp"
+
+#include <cstring>
+
+#include "acpi.hpp"
+#include "logger.hpp"
+#include "sysreg.hpp"
+
+namespace {
+  const uint32_t kPSCI_VERSION = 0x84000000;
+  const uint32_t kPSCI_CPU_ON64 = 0xc4000003;
+
+  /* FADT の ARM_BOOT_ARCH（ACPI 5.1 以降） */
+  const size_t kFADTArmBootArchOffset = 129;
+  const uint16_t kArmBootArchPSCICompliant = 1u << 0;
+  const uint16_t kArmBootArchPSCIUseHVC = 1u << 1;
+
+  enum class Conduit {
+    kNone,  // PSCI を使えない
+    kSMC,
+    kHVC,
+  };
+
+  Conduit conduit = Conduit::kNone;
+
+  /** @brief FADT から呼び出し方を決める．FADT に ARM ブートフラグが無ければ偽． */
+  bool ConduitFromFADT(Conduit& result) {
+    auto fadt = acpi::FindTable("FACP");
+    if (fadt == nullptr ||
+        fadt->length < kFADTArmBootArchOffset + sizeof(uint16_t)) {
+      return false;
+    }
+    uint16_t flags;
+    memcpy(&flags, reinterpret_cast<const uint8_t*>(fadt) + kFADTArmBootArchOffset,
+           sizeof(flags));
+    if ((flags & kArmBootArchPSCICompliant) == 0) {
+      result = Conduit::kNone;
+    } else {
+      result = (flags & kArmBootArchPSCIUseHVC) ? Conduit::kHVC : Conduit::kSMC;
+    }
+    return true;
+  }
+
+  int64_t PSCICall(uint64_t function, uint64_t arg0, uint64_t arg1, uint64_t arg2) {
+    if (conduit == Conduit::kNone) {
+      return kPSCINotSupported;
+    }
+
+    register uint64_t x0 asm("x0") = function;
+    register uint64_t x1 asm("x1") = arg0;
+    register uint64_t x2 asm("x2") = arg1;
+    register uint64_t x3 asm("x3") = arg2;
+    // SMCCC 1.0 では x4..x17 が壊れてもよい
+    if (conduit == Conduit::kSMC) {
+      __asm__ volatile("smc #0"
+                       : "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3)
+                       :
+                       : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                         "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    } else {
+      __asm__ volatile("hvc #0"
+                       : "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3)
+                       :
+                       : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                         "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    }
+    return static_cast<int64_t>(x0);
+  }
+}
+
+void InitializePSCI() {
+  const Conduit guess = CurrentEL() == 2 ? Conduit::kSMC : Conduit::kHVC;
+  if (!ConduitFromFADT(conduit)) {
+    Log(kInfo, "psci: no ARM boot flags in the FADT, using %s\n",
+        guess == Conduit::kSMC ? "SMC" : "HVC");
+    conduit = guess;
+  } else if (conduit == Conduit::kHVC && CurrentEL() == 2) {
+    // FADT は EL1 の OS から見た呼び出し方．EL2 の HVC は自分自身に戻ってしまう
+    Log(kWarn, "psci: FADT asks for HVC but the kernel runs at EL2, using SMC\n");
+    conduit = Conduit::kSMC;
+  } else if (conduit == Conduit::kNone) {
+    Log(kWarn, "psci: FADT says the platform is not PSCI compliant\n");
+  }
+}
+
+int64_t PSCIVersion() {
+  const int64_t version = PSCICall(kPSCI_VERSION, 0, 0, 0);
+  // 32 ビットの NOT_SUPPORTED（0xffffffff）が返ることもある
+  return static_cast<int32_t>(version);
+}
+
+int64_t PSCICPUOn(uint64_t target_mpidr, uint64_t entry, uint64_t context_id) {
+  return static_cast<int32_t>(PSCICall(kPSCI_CPU_ON64, target_mpidr, entry, context_id));
+}
@@ -0,0 +1,45 @@
+/**************************************************************/
+/**
+    @file    psci.hpp
+
+    @brief   PSCI（Power State Coordination Interface）の呼び出し．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __PSCI_HPP__
+#define __PSCI_HPP__
+
+#include <cstdint>
+
+const int64_t kPSCISuccess = 0;
+const int64_t kPSCINotSupported = -1;
+const int64_t kPSCIInvalidParameters = -2;
+const int64_t kPSCIDenied = -3;
+const int64_t kPSCIAlreadyOn = -4;
+const int64_t kPSCIOnPending = -5;
+const int64_t kPSCIInternalFailure = -6;
+const int64_t kPSCINotPresent = -7;
+
+/** @brief PSCI の呼び出し方（SMC か HVC か）を決める．
+ *
+ * ACPI の FADT の ARM ブートフラグを使い，無ければ例外レベルから推測する．
+ * acpi::Initialize の後，ほかの関数より先に呼ぶ．
+ */
+void InitializePSCI();
+
+/** @brief PSCI のバージョン（上位 16 ビットがメジャー，下位がマイナー）．使えなければ負． */
+int64_t PSCIVersion();
+
+/** @brief MPIDR が target_mpidr の CPU を起動し，物理アドレス entry から実行させる．
+ *
+ * 起動した CPU は呼び出し元と同じ例外レベルで，MMU とキャッシュが無効な状態で
+ * x0 = context_id として entry から実行を始める．
+ */
+int64_t PSCICPUOn(uint64_t target_mpidr, uint64_t entry, uint64_t context_id);
+
+#endif /* __PSCI_HPP__ */
@@ -0,0 +1,307 @@
+/**************************************************************/
+/**
+    @file    smp.cpp
+
+    @brief   2 つ目以降の CPU の起動と，CPU 間の関数呼び出し．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "smp.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+#include "acpi.hpp"
+#include "counter.hpp"
+#include "gic.hpp"
+#include "halt.hpp"
+#include "interrupt.hpp"
+#include "logger.hpp"
+#include "psci.hpp"
+#include "queue.hpp"
+#include "sysreg.hpp"
+#include "timer.hpp"
+
+extern "C" char secondary_entry[];
+extern "C" char secondary_entry_end[];
+
+/** @brief secondary.S に渡す起動パラメータ．MMU が無効な CPU から読まれる． */
+struct SecondaryBoot {
+  uint64_t mair, tcr, ttbr0, sctlr;
+  uint64_t cptr;       // EL1 なら CPACR_EL1，EL2 なら CPTR_EL2
+  uint64_t stack_top;
+  uint64_t cpu;        // SecondaryMain に渡す CPUInfo*
+};
+static_assert(offsetof(SecondaryBoot, cptr) == 32 && offsetof(SecondaryBoot, cpu) == 48,
+              "keep in sync with secondary.S");
+
+namespace {
+  struct CPUCall {
+    CPUFunc func;
+    void* arg;
+  };
+
+  struct CPUInfo {
+    int index = 0;
+    uint64_t mpidr = 0;
+    std::atomic<bool> online{false};
+    /** @brief ほかの CPU からの呼び出し．送り元の CPU ごとに分けて単一生産者にする． */
+    SPSCQueue<CPUCall, 16> inbox[kMaxCPUs];
+  };
+
+  const size_t kSecondaryStackBytes = 32 * 1024;
+  const uint64_t kMPIDRAffinityMask = 0xff00ffffffu;
+
+  CPUInfo cpus[kMaxCPUs];
+  alignas(64) SecondaryBoot boot_params[kMaxCPUs];
+  alignas(16) uint8_t cpu_stacks[kMaxCPUs][kSecondaryStackBytes];
+  std::atomic<int> num_cpus{1};
+
+  void SetCurrentCPU(CPUInfo* cpu) {
+    if (CurrentEL() == 2) {
+      WRITE_SYSREG(tpidr_el2, reinterpret_cast<uint64_t>(cpu));
+    } else {
+      WRITE_SYSREG(tpidr_el1, reinterpret_cast<uint64_t>(cpu));
+    }
+  }
+
+  CPUInfo& CurrentCPUInfo() {
+    const uint64_t p = CurrentEL() == 2 ? READ_SYSREG(tpidr_el2) : READ_SYSREG(tpidr_el1);
+    return *reinterpret_cast<CPUInfo*>(p);
+  }
+
+  /** @brief キャッシュを通さずに読まれるデータを PoC まで書き戻す． */
+  void CleanToPoC(const void* p, size_t size) {
+    const uint64_t line = 4u << ((READ_SYSREG(ctr_el0) >> 16) & 0xfu);  // DminLine
+    const uint64_t end = reinterpret_cast<uint64_t>(p) + size;
+    for (uint64_t addr = reinterpret_cast<uint64_t>(p) & ~(line - 1); addr < end; addr += line) {
+      __asm__ volatile("dc cvac, %0" : : "r"(addr) : "memory");
+    }
+    __asm__ volatile("dsb sy" : : : "memory");
+  }
+
+  /** @brief QEMU virt が index 番目の CPU に割り当てる MPIDR．
+   *
+   * GICv2 なら 8 個，GICv3 なら 16 個ずつのクラスタ（Aff1）に分けられる．
+   * MADT が無いときの推測にだけ使う．
+   */
+  uint64_t VirtCPUAffinity(int index) {
+    const int cluster_size = GICVersion() == 3 ? 16 : 8;
+    return (static_cast<uint64_t>(index / cluster_size) << 8) | (index % cluster_size);
+  }
+
+  const uint8_t kMADTGICC = 0x0b;
+  const size_t kMADTEntriesOffset = 44;  // 記述テーブルの先頭，割り込みコントローラのアドレス，フラグ
+  const size_t kGICCFlagsOffset = 12;
+  const size_t kGICCMPIDROffset = 68;    // ACPI 5.1 以降の GICC にだけある
+  const uint32_t kGICCEnabled = 1;
+
+  /** @brief MADT の GICC から起動できる CPU の MPIDR を最大 max_cpus 個集める．
+   *
+   * @return 集めた数．MADT が無いか GICC に MPIDR が無ければ 0．
+   */
+  int ReadMADTAffinities(uint64_t* mpidrs, int max_cpus) {
+    auto madt = acpi::FindTable("APIC");
+    if (madt == nullptr) {
+      return 0;
+    }
+
+    auto bytes = reinterpret_cast<const uint8_t*>(madt);
+    int num = 0;
+    for (size_t offset = kMADTEntriesOffset; offset + 2 <= madt->length && num < max_cpus;) {
+      const uint8_t type = bytes[offset];
+      const uint8_t length = bytes[offset + 1];
+      if (length < 2 || offset + length > madt->length) {
+        break;
+      }
+      if (type == kMADTGICC && length >= kGICCMPIDROffset + sizeof(uint64_t)) {
+        // エントリは自然な境界に揃っていない
+        uint32_t flags;
+        uint64_t mpidr;
+        memcpy(&flags, bytes + offset + kGICCFlagsOffset, sizeof(flags));
+        memcpy(&mpidr, bytes + offset + kGICCMPIDROffset, sizeof(mpidr));
+        if (flags & kGICCEnabled) {
+          mpidrs[num++] = mpidr & kMPIDRAffinityMask;
+        }
+      }
+      offset += length;
+    }
+    return num;
+  }
+
+  /** @brief SGI は WFI から起こすためだけに使う．呼び出しはアイドルループで実行する． */
+  void IPIHandler(uint32_t intid, void* arg) {
+  }
+
+  [[noreturn]] void IdleLoop() {
+    while (1) {
+      // 確認から WFI までの間に来た SGI を取りこぼさないよう IRQ を止めて調べる
+      DisableInterrupts();
+      if (!HasPendingCPUCalls()) {
+        WaitForInterrupt();
+      }
+      EnableInterrupts();
+      RunPendingCPUCalls();
+    }
+  }
+}
+
+extern "C" void SecondaryMain(void* arg) {
+  auto cpu = static_cast<CPUInfo*>(arg);
+  SetCurrentCPU(cpu);
+  InitializeCounter();
+  if (auto err = InitializeSecondaryInterrupt()) {
+    // SGI を受け取れないので online にせず止まる．起動側はタイムアウトする
+    Log(kError, "CPU %d: InitializeSecondaryInterrupt: %s\n", cpu->index, err.Name());
+    while (1) halt();
+  }
+  GICEnableInterrupt(kIPIInterruptId, true);
+  cpu->online.store(true, std::memory_order_release);
+  EnableInterrupts();
+  IdleLoop();
+}
+
+void InitializeSMP() {
+  cpus[0].index = 0;
+  cpus[0].mpidr = READ_SYSREG(mpidr_el1) & kMPIDRAffinityMask;
+  cpus[0].online.store(true, std::memory_order_relaxed);
+  SetCurrentCPU(&cpus[0]);
+}
+
+int StartSecondaryCPUs() {
+  if (GICVersion() == 0) {
+    return NumCPUs();  // SGI を送れない
+  }
+  InitializePSCI();
+  const int64_t version = PSCIVersion();
+  if (version < 0) {
+    Log(kWarn, "PSCI is not available: %ld\n", version);
+    return NumCPUs();
+  }
+  if (auto err = SetInterruptHandler(kIPIInterruptId, IPIHandler, nullptr, true)) {
+    Log(kWarn, "SetInterruptHandler(IPI): %s\n", err.Name());
+    return NumCPUs();
+  }
+
+  const bool el2 = CurrentEL() == 2;
+  SecondaryBoot boot_template{};
+  if (el2) {
+    boot_template.mair = READ_SYSREG(mair_el2);
+    boot_template.tcr = READ_SYSREG(tcr_el2);
+    boot_template.ttbr0 = READ_SYSREG(ttbr0_el2);
+    boot_template.sctlr = READ_SYSREG(sctlr_el2);
+    boot_template.cptr = READ_SYSREG(cptr_el2);
+  } else {
+    boot_template.mair = READ_SYSREG(mair_el1);
+    boot_template.tcr = READ_SYSREG(tcr_el1);
+    boot_template.ttbr0 = READ_SYSREG(ttbr0_el1);
+    boot_template.sctlr = READ_SYSREG(sctlr_el1);
+    boot_template.cptr = READ_SYSREG(cpacr_el1);
+  }
+  CleanToPoC(secondary_entry, secondary_entry_end - secondary_entry);
+
+  // MADT に載っている CPU を起動する．無ければ QEMU virt の並びを推測し，
+  // CPU_ON が CPU は無いと答えるところまで試す
+  uint64_t mpidrs[kMaxCPUs + 1];
+  int num_mpidrs = ReadMADTAffinities(mpidrs, kMaxCPUs + 1);
+  const bool guessed = num_mpidrs == 0;
+  if (guessed) {
+    Log(kWarn, "no GICC with MPIDR in the MADT, assuming the QEMU virt CPU layout\n");
+    for (int i = 0; i < kMaxCPUs; ++i) {
+      mpidrs[i] = VirtCPUAffinity(i);
+    }
+    num_mpidrs = kMaxCPUs;
+  }
+
+  const uint64_t kOnlineTimeout = 100 * 1000;  // マイクロ秒
+  for (int i = 0; i < num_mpidrs && NumCPUs() < kMaxCPUs; ++i) {
+    const uint64_t mpidr = mpidrs[i];
+    if (mpidr == cpus[0].mpidr) {
+      continue;
+    }
+
+    const int index = NumCPUs();
+    CPUInfo& cpu = cpus[index];
+    cpu.index = index;
+    cpu.mpidr = mpidr;
+
+    SecondaryBoot& boot = boot_params[index];
+    boot = boot_template;
+    boot.stack_top = reinterpret_cast<uint64_t>(cpu_stacks[index] + kSecondaryStackBytes);
+    boot.cpu = reinterpret_cast<uint64_t>(&cpu);
+    CleanToPoC(&boot, sizeof(boot));
+
+    const int64_t ret = PSCICPUOn(mpidr, reinterpret_cast<uint64_t>(secondary_entry),
+                                  reinterpret_cast<uint64_t>(&boot));
+    if (guessed && (ret == kPSCIInvalidParameters || ret == kPSCINotPresent)) {
+      Log(kInfo, "CPU_ON(%lx): %ld, assuming no more CPUs\n", mpidr, ret);
+      break;
+    }
+    if (ret != kPSCISuccess) {
+      Log(kWarn, "CPU_ON(%lx): %ld\n", mpidr, ret);
+      continue;
+    }
+    if (auto err = WaitUntil([&cpu] {
+          return cpu.online.load(std::memory_order_acquire); }, kOnlineTimeout)) {
+      // 遅れて動き出すかもしれないので，この CPU の領域は再利用しない
+      Log(kWarn, "CPU %lx did not come online\n", mpidr);
+      break;
+    }
+    num_cpus.store(index + 1, std::memory_order_release);
+  }
+  return NumCPUs();
+}
+
+int NumCPUs() {
+  return num_cpus.load(std::memory_order_acquire);
+}
+
+int CurrentCPUIndex() {
+  return CurrentCPUInfo().index;
+}
+
+Error RunOnCPU(int cpu, CPUFunc func, void* arg) {
+  if (cpu < 0 || cpu >= NumCPUs()) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+  const int self = CurrentCPUIndex();
+  if (cpu == self) {
+    func(arg);
+    return MAKE_ERROR(Error::kSuccess);
+  }
+
+  const uint64_t daif = READ_SYSREG(daif);
+  DisableInterrupts();
+  const bool pushed = cpus[cpu].inbox[self].Push(CPUCall{func, arg});
+  WRITE_SYSREG(daif, daif);
+  if (!pushed) {
+    return MAKE_ERROR(Error::kFull);
+  }
+  GICSendSGI(kIPIInterruptId, cpu);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+bool HasPendingCPUCalls() {
+  for (auto& inbox : CurrentCPUInfo().inbox) {
+    if (!inbox.Empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RunPendingCPUCalls() {
+  CPUCall call;
+  for (auto& inbox : CurrentCPUInfo().inbox) {
+    while (inbox.Pop(call)) {
+      call.func(call.arg);
+    }
+  }
+}
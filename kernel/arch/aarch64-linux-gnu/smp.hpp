@@ -0,0 +1,60 @@
+/**************************************************************/
+/**
+    @file    smp.hpp
+
+    @brief   2 つ目以降の CPU の起動と，CPU 間の関数呼び出し．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __SMP_HPP__
+#define __SMP_HPP__
+
+#include <cstdint>
+
+#include "error.hpp"
+
+/** @brief 扱う CPU の最大数． */
+const int kMaxCPUs = 8;
+
+/** @brief CPU 間の呼び出しを知らせる SGI の番号． */
+const uint32_t kIPIInterruptId = 1;
+
+using CPUFunc = void (*)(void* arg);
+
+/** @brief 起動した CPU の上で呼び，その CPU を 0 番として登録する． */
+void InitializeSMP();
+
+/** @brief PSCI で 2 つ目以降の CPU を起動する．InitializeInterrupt の後に呼ぶ．
+ *
+ * 起動した CPU は割り込みを待つアイドルループに入り，RunOnCPU で頼まれた関数を実行する．
+ *
+ * @return 動いている CPU の数（起動した CPU を含む）
+ */
+int StartSecondaryCPUs();
+
+/** @brief 動いている CPU の数． */
+int NumCPUs();
+
+/** @brief 現在の CPU の番号（0 から NumCPUs() - 1）． */
+int CurrentCPUIndex();
+
+/** @brief CPU cpu で func(arg) を実行させる．完了は待たない．
+ *
+ * 現在の CPU を指定すればその場で呼ぶ．ほかの CPU の呼び出しはその CPU の
+ * アイドルループ（0 番の CPU ではアイドルタスクの RunPendingCPUCalls）で実行される．
+ * 割り込みハンドラからは呼ばない．
+ */
+Error RunOnCPU(int cpu, CPUFunc func, void* arg);
+
+/** @brief ほかの CPU から現在の CPU へ頼まれた関数があれば真． */
+bool HasPendingCPUCalls();
+
+/** @brief ほかの CPU から現在の CPU へ頼まれた関数をすべて実行する． */
+void RunPendingCPUCalls();
+
+#endif /* __SMP_HPP__ */
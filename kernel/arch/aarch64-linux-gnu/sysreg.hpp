@@ -0,0 +1,33 @@
+/**************************************************************/
+/**
+    @file    sysreg.hpp
+
+    @brief   システムレジスタの読み書き．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __SYSREG_HPP__
+#define __SYSREG_HPP__
+
+#include <cstdint>
+
+#define READ_SYSREG(name) ({ \
+  uint64_t v; __asm__ volatile("mrs %0, " #name : "=r"(v)); v; })
+#define WRITE_SYSREG(name, v) \
+  __asm__ volatile("msr " #name ", %0" : : "r"(static_cast<uint64_t>(v)))
+
+/** @brief 現在の例外レベル（1 または 2）． */
+inline int CurrentEL() {
+  return (READ_SYSREG(CurrentEL) >> 2) & 3;
+}
+
+inline void InstructionBarrier() {
+  __asm__ volatile("isb" : : : "memory");
+}
+
+#endif /* __SYSREG_HPP__ */
@@ -0,0 +1,51 @@
+/**************************************************************/
+/**
+    @file    timer_device.cpp
+
+    @brief   汎用タイマの仮想タイマ（CNTV）による周期割り込み．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "timer_device.hpp"
+
+#include "counter.hpp"
+#include "sysreg.hpp"
+
+namespace {
+  const uint64_t kCNTV_CTL_Enable = 1u << 0;
+
+  uint64_t timer_interval = 0;
+}
+
+Error StartTimerDevice(uint64_t interval) {
+  if (interval == 0) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+  timer_interval = interval;
+  WRITE_SYSREG(cntv_cval_el0, ReadCounter() + interval);
+  WRITE_SYSREG(cntv_ctl_el0, kCNTV_CTL_Enable);
+  InstructionBarrier();
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+void AcknowledgeTimerDevice() {
+  // 比較値を一定間隔で進めて周期がずれないようにする．取り残されたら現在時刻から数え直す
+  const uint64_t now = ReadCounter();
+  uint64_t next = READ_SYSREG(cntv_cval_el0) + timer_interval;
+  if (next <= now) {
+    next = now + timer_interval;
+  }
+  WRITE_SYSREG(cntv_cval_el0, next);
+  InstructionBarrier();
+}
+
+void StopTimerDevice() {
+  WRITE_SYSREG(cntv_ctl_el0, 0);
+  InstructionBarrier();
+}
@@ -0,0 +1,33 @@
+/**************************************************************/
+/**
+    @file    timer_device.hpp
+
+    @brief   汎用タイマの仮想タイマ（CNTV）による周期割り込み．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __TIMER_DEVICE_HPP__
+#define __TIMER_DEVICE_HPP__
+
+#include <cstdint>
+
+#include "error.hpp"
+
+/** @brief 仮想タイマの割り込み番号（PPI 11）．レベルトリガ． */
+const uint32_t kTimerDeviceInterruptId = 27;
+
+/** @brief interval カウントごとに割り込みを発生させる． */
+Error StartTimerDevice(uint64_t interval);
+
+/** @brief 割り込みハンドラから呼び，次の割り込みの時刻を設定する． */
+void AcknowledgeTimerDevice();
+
+/** @brief 割り込みを止める．StartTimerDevice で再開できる． */
+void StopTimerDevice();
+
+#endif /* __TIMER_DEVICE_HPP__ */
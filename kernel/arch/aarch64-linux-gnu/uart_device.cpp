@@ -0,0 +1,49 @@
+/**************************************************************/
+/**
+    @file    uart_device.cpp
+
+    @brief   QEMU virt マシンの PL011 UART．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include <cstdint>
+
+#include "iofunc.hpp"
+#include "paging.hpp"
+#include "uart_device.hpp"
+
+namespace {
+  const uint64_t kPL011Base = 0x09000000;
+
+  const uint64_t kUARTDR = kPL011Base + 0x00;  // データレジスタ
+  const uint64_t kUARTFR = kPL011Base + 0x18;  // フラグレジスタ
+  const uint64_t kUARTCR = kPL011Base + 0x30;  // 制御レジスタ
+
+  const uint32_t kFRTxFull = 1u << 5;
+  const uint32_t kCRUARTEnable = 1u << 0;
+  const uint32_t kCRTxEnable = 1u << 8;
+}
+
+Error InitializeUARTDevice() {
+  if (auto err = MapMMIO(kPL011Base, 0x1000)) {
+    return err;
+  }
+  // ボーレートなどはファームウェアの設定をそのまま使う
+  io_write32(kUARTCR, io_read32(kUARTCR) | kCRUARTEnable | kCRTxEnable);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+size_t UARTDeviceWrite(const char* s, size_t len) {
+  size_t n = 0;
+  while (n < len && (io_read32(kUARTFR) & kFRTxFull) == 0) {
+    io_write32(kUARTDR, static_cast<uint8_t>(s[n]));
+    ++n;
+  }
+  return n;
+}
@@ -0,0 +1,30 @@
+/**************************************************************/
+/**
+    @file    uart_device.hpp
+
+    @brief   UART の送信 FIFO を直接操作する関数．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __UART_DEVICE_HPP__
+#define __UART_DEVICE_HPP__
+
+#include <cstddef>
+
+#include "error.hpp"
+
+/** @brief ログ出力に使う UART を送信可能な状態にする．失敗したら UART に触れてはならない． */
+Error InitializeUARTDevice();
+
+/** @brief 送信 FIFO が待たずに受け付けるだけ s から書き込む．
+ *
+ * @return 書き込んだバイト数．FIFO が一杯なら 0．
+ */
+size_t UARTDeviceWrite(const char* s, size_t len);
+
+#endif /* __UART_DEVICE_HPP__ */
@@ -18,3 +18,50 @@ IoIn32:
     mov dx, di    ; dx = addr
     in eax, dx
     ret
+
+global IoOut8  ; void IoOut8(uint16_t addr, uint8_t data);
+IoOut8:
+    mov dx, di    ; dx = addr
+    mov al, sil   ; al = data
+    out dx, al
+    ret
+
+global IoIn8  ; uint8_t IoIn8(uint16_t addr);
+IoIn8:
+    mov dx, di    ; dx = addr
+    in al, dx
+    ret
+
+global SwitchContext  ; void SwitchContext(TaskContext* next_ctx, TaskContext* current_ctx);
+SwitchContext:
+    mov [rsi + 0x08], rbx
+    mov [rsi + 0x10], rbp
+    mov [rsi + 0x18], r12
+    mov [rsi + 0x20], r13
+    mov [rsi + 0x28], r14
+    mov [rsi + 0x30], r15
+    stmxcsr [rsi + 0x38]
+    fnstcw [rsi + 0x3c]
+    mov [rsi + 0x00], rsp  ; 戻り先のアドレスはスタックの先頭にある
+
+    mov rsp, [rdi + 0x00]
+    mov rbx, [rdi + 0x08]
+    mov rbp, [rdi + 0x10]
+    mov r12, [rdi + 0x18]
+    mov r13, [rdi + 0x20]
+    mov r14, [rdi + 0x28]
+    mov r15, [rdi + 0x30]
+    ldmxcsr [rdi + 0x38]
+    fldcw [rdi + 0x3c]
+    ret
+
+extern kernel_main_stack
+extern KernelMainNewStack
+
+global KernelMain
+KernelMain:
+    mov rsp, kernel_main_stack + 1024 * 1024  ; ローダのスタックは回収されるので切り替える
+    call KernelMainNewStack
+.fin:
+    hlt
+    jmp .fin
@@ -0,0 +1,45 @@
+/**************************************************************/
+/**
+    @file    context.hpp
+
+    @brief   タスク切り替えで保存するレジスタ．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __CONTEXT_HPP__
+#define __CONTEXT_HPP__
+
+#include <cstdint>
+
+/** @brief 関数呼び出しをまたいで保存される（callee-saved）レジスタ．
+ *
+ * 戻り先のアドレスは rsp の指す先に置かれている．asmfunc.asm と配置を合わせること．
+ */
+struct TaskContext {
+  uint64_t rsp, rbx, rbp, r12, r13, r14, r15;
+  uint32_t mxcsr;
+  uint16_t fpu_cw;
+  uint16_t reserved;
+};
+static_assert(sizeof(TaskContext) == 64, "keep in sync with asmfunc.asm");
+
+/** @brief 現在のレジスタを current_ctx に保存し，next_ctx のレジスタで実行を再開する． */
+extern "C" void SwitchContext(TaskContext* next_ctx, TaskContext* current_ctx);
+
+/** @brief 最初に切り替えられたとき，スタック stack_top の上で entry から実行するよう ctx を作る． */
+inline void InitTaskContext(TaskContext& ctx, uint64_t stack_top, void (*entry)()) {
+  ctx = TaskContext{};
+  // SwitchContext の ret で entry へ飛んだとき，関数の入口の規約どおり rsp + 8 が 16 の倍数になる
+  auto sp = reinterpret_cast<uint64_t*>((stack_top & ~static_cast<uint64_t>(0xf)) - 16);
+  *sp = reinterpret_cast<uint64_t>(entry);
+  ctx.rsp = reinterpret_cast<uint64_t>(sp);
+  ctx.mxcsr = 0x1f80;   // すべての浮動小数点例外をマスク
+  ctx.fpu_cw = 0x037f;
+}
+
+#endif /* __CONTEXT_HPP__ */
@@ -0,0 +1,69 @@
+/**************************************************************/
+/**
+    @file    counter.cpp
+
+    @brief   タイムスタンプカウンタ（TSC）の周波数を求める．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "counter.hpp"
+
+#include "asmfunc.h"
+
+namespace {
+  uint64_t tsc_frequency = 0;
+
+  void CPUID(uint32_t leaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d) {
+    __asm__ volatile("cpuid"
+                     : "=a"(a), "=b"(b), "=c"(c), "=d"(d)
+                     : "a"(leaf), "c"(0));
+  }
+
+  /** @brief CPUID leaf 0x15 から TSC の周波数を求める．分からなければ 0． */
+  uint64_t FrequencyFromCPUID() {
+    uint32_t a, b, c, d;
+    CPUID(0, a, b, c, d);
+    if (a < 0x15) {
+      return 0;
+    }
+    CPUID(0x15, a, b, c, d);
+    if (a == 0 || b == 0 || c == 0) {
+      return 0;
+    }
+    return static_cast<uint64_t>(c) * b / a;
+  }
+
+  /** @brief PIT のチャネル 2 で 10 ミリ秒を測り，その間に進んだ TSC から周波数を求める． */
+  uint64_t FrequencyFromPIT() {
+    const uint32_t kPITFrequency = 1193182;
+    const uint16_t kCount = kPITFrequency / 100;
+
+    // ゲートを開き，スピーカーへの出力は止める
+    IoOut8(0x61, (IoIn8(0x61) & ~0x02u) | 0x01u);
+    IoOut8(0x43, 0xb0);  // チャネル 2，下位・上位バイト，モード 0
+    IoOut8(0x42, kCount & 0xffu);
+    IoOut8(0x42, kCount >> 8);
+
+    const uint64_t start = ReadCounter();
+    while ((IoIn8(0x61) & 0x20u) == 0);
+    const uint64_t end = ReadCounter();
+    return (end - start) * kPITFrequency / kCount;
+  }
+}
+
+void InitializeCounter() {
+  tsc_frequency = FrequencyFromCPUID();
+  if (tsc_frequency == 0) {
+    tsc_frequency = FrequencyFromPIT();
+  }
+}
+
+uint64_t CounterFrequency() {
+  return tsc_frequency;
+}
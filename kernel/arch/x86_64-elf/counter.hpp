@@ -0,0 +1,37 @@
+/**************************************************************/
+/**
+    @file    counter.hpp
+
+    @brief   タイムスタンプカウンタ（TSC）．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __COUNTER_HPP__
+#define __COUNTER_HPP__
+
+#include <cstdint>
+
+/** @brief TSC の周波数を求める．CPUID で分からなければ PIT で較正する． */
+void InitializeCounter();
+
+/** @brief カウンタの現在値を読む． */
+inline uint64_t ReadCounter() {
+  uint32_t lo, hi;
+  __asm__ volatile("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+  return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+
+/** @brief カウンタの周波数（Hz）．InitializeCounter の後で有効になる． */
+uint64_t CounterFrequency();
+
+/** @brief ポーリングの合間に呼ぶ．x86_64 にはイベントストリームが無いので pause で代用する． */
+inline void WaitForCounterEvent() {
+  __asm__ volatile("pause" : : : "memory");
+}
+
+#endif /* __COUNTER_HPP__ */
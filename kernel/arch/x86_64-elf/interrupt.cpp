@@ -0,0 +1,24 @@
+/**************************************************************/
+/**
+    @file    interrupt.cpp
+
+    @brief   割り込みハンドラの登録．x86_64 では未実装．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "interrupt.hpp"
+
+Error InitializeInterrupt() {
+  return MAKE_ERROR(Error::kNotImplemented);
+}
+
+Error SetInterruptHandler(uint32_t intid, InterruptHandler handler, void* arg,
+                          bool edge) {
+  return MAKE_ERROR(Error::kNotImplemented);
+}
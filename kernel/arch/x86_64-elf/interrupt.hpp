@@ -0,0 +1,34 @@
+/**************************************************************/
+/**
+    @file    interrupt.hpp
+
+    @brief   割り込みハンドラの登録．x86_64 では未実装で，
+             呼び出し側はポーリングで動く．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __INTERRUPT_HPP__
+#define __INTERRUPT_HPP__
+
+#include <cstdint>
+
+#include "error.hpp"
+
+using InterruptHandler = void (*)(uint32_t intid, void* arg);
+
+/** @brief 常に Error::kNotImplemented を返す． */
+Error InitializeInterrupt();
+
+Error SetInterruptHandler(uint32_t intid, InterruptHandler handler, void* arg,
+                          bool edge);
+
+inline void DisableInterrupts() {}
+inline void EnableInterrupts() {}
+inline void WaitForInterrupt() {}
+
+#endif /* __INTERRUPT_HPP__ */
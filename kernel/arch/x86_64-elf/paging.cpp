@@ -0,0 +1,98 @@
+/**************************************************************/
+/**
+    @file    paging.cpp
+
+    @brief   ページテーブルの管理．
+
+    UEFI は 4 段のページテーブルで物理アドレスと同じ仮想アドレスへ写している．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "paging.hpp"
+
+#include <cstdint>
+
+#include "memory_manager.hpp"
+#include "memory_map.hpp"
+
+namespace {
+  const uint64_t kPresent = 1;
+  const uint64_t kPageSize = 1 << 7;  // PDPT と PD で 1 GiB / 2 MiB ページを表す
+  const uint64_t kAddressMask = 0x000ffffffffff000;
+
+  struct [[gnu::packed]] DescriptorTableRegister {
+    uint16_t limit;
+    uint64_t base;
+  };
+
+  /** @brief 64 ビットモードの IDT のゲート記述子． */
+  struct [[gnu::packed]] InterruptDescriptor {
+    uint16_t offset_low;
+    uint16_t segment_selector;
+    uint8_t ist;
+    uint8_t type_attr;  // 最上位ビットが P
+    uint16_t offset_middle;
+    uint32_t offset_high;
+    uint32_t reserved;
+  };
+
+  void ReserveRange(BitmapMemoryManager& memory_manager, uint64_t addr, uint64_t size) {
+    const uint64_t first = addr / kBytesPerFrame;
+    const uint64_t last = (addr + size - 1) / kBytesPerFrame;
+    memory_manager.MarkAllocated(FrameID{first}, last - first + 1);
+  }
+
+  /** @brief level は PML4 を 4，ページテーブルを 1 として数える． */
+  void ReserveTable(BitmapMemoryManager& memory_manager, uint64_t table_addr, int level) {
+    memory_manager.MarkAllocated(FrameID{table_addr / kBytesPerFrame}, 1);
+    if (level == 1) {
+      return;
+    }
+
+    auto table = reinterpret_cast<const uint64_t*>(table_addr);
+    for (int i = 0; i < 512; ++i) {
+      if ((table[i] & kPresent) == 0 || (level < 4 && (table[i] & kPageSize))) {
+        continue;
+      }
+      ReserveTable(memory_manager, table[i] & kAddressMask, level - 1);
+    }
+  }
+}
+
+void ReserveFirmwareMemory(BitmapMemoryManager& memory_manager, const MemoryMap& memory_map) {
+  uint64_t cr3;
+  __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+  ReserveTable(memory_manager, cr3 & kAddressMask, 4);
+
+  DescriptorTableRegister gdtr, idtr;
+  __asm__ volatile("sgdt %0" : "=m"(gdtr));
+  __asm__ volatile("sidt %0" : "=m"(idtr));
+  ReserveRange(memory_manager, gdtr.base, gdtr.limit + 1);
+  ReserveRange(memory_manager, idtr.base, idtr.limit + 1);
+
+  // カーネルは IDT を設定しないので，例外は UEFI のハンドラへ飛ぶ
+  auto idt = reinterpret_cast<const InterruptDescriptor*>(idtr.base);
+  for (size_t i = 0; i < (idtr.limit + 1u) / sizeof(InterruptDescriptor); ++i) {
+    if ((idt[i].type_attr & 0x80) == 0) {
+      continue;
+    }
+    const uint64_t handler = idt[i].offset_low |
+      (uint64_t{idt[i].offset_middle} << 16) | (uint64_t{idt[i].offset_high} << 32);
+    ReserveFirmwareCode(memory_manager, memory_map, handler);
+  }
+}
+
+Error InitializePaging(const MemoryMap& memory_map,
+                       const FrameBufferConfig& frame_buffer_config) {
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error MapMemory(uint64_t base, uint64_t size, MemoryAttribute attribute) {
+  return MAKE_ERROR(Error::kSuccess);
+}
@@ -0,0 +1,59 @@
+/**************************************************************/
+/**
+    @file    paging.hpp
+
+    @brief   ページテーブルの管理．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __PAGING_HPP__
+#define __PAGING_HPP__
+
+#include <cstdint>
+
+#include "error.hpp"
+
+class BitmapMemoryManager;
+struct MemoryMap;
+struct FrameBufferConfig;
+
+/** @brief ブートサービスの領域にあってカーネルがまだ使っているものを使用中にする．
+ *
+ * カーネルは UEFI が作った CR3 のページテーブルと GDT・IDT で動き続けるので，
+ * それらのページと，IDT のゲートが指すハンドラのコードを回収しないようにする．
+ * ハンドラのコードは ReleaseFirmwareCode で空きに戻せる．
+ */
+void ReserveFirmwareMemory(BitmapMemoryManager& memory_manager, const MemoryMap& memory_map);
+
+/** @brief ページテーブルで写すときのメモリの種類． */
+enum class MemoryAttribute {
+  kNormal,          // RAM．ライトバックでキャッシュする．
+  kWriteCombining,  // フレームバッファ．キャッシュせず，書き込みはまとめてよい．
+  kDevice,          // MMIO．キャッシュしない．
+};
+
+/** @brief カーネルのページテーブルを用意する．
+ *
+ * x86_64 では UEFI のページテーブルが物理アドレス空間全体を写していて，
+ * MMIO のキャッシュ属性は MTRR で決まるので，そのまま使い続ける．
+ */
+Error InitializePaging(const MemoryMap& memory_map,
+                       const FrameBufferConfig& frame_buffer_config);
+
+/** @brief [base, base + size) を attribute で物理アドレスと同じ仮想アドレスへ写す．
+ *
+ * UEFI のページテーブルですでに写っているので何もしない．
+ */
+Error MapMemory(uint64_t base, uint64_t size, MemoryAttribute attribute);
+
+/** @brief デバイスのレジスタ [base, base + size) を写す． */
+inline Error MapMMIO(uint64_t base, uint64_t size) {
+  return MapMemory(base, size, MemoryAttribute::kDevice);
+}
+
+#endif /* __PAGING_HPP__ */
@@ -197,4 +197,13 @@ namespace pci {
       MAKE_ERROR(Error::kSuccess)
     };
   }
+
+  WithError<uint32_t> GetInterruptId(const Device& dev) {
+    const uint8_t pin = (ReadConfReg(dev, 0x3c) >> 8) & 0xffu;
+    if (pin == 0 || pin > 4) {
+      return {0, MAKE_ERROR(Error::kNoPCIInterrupt)};
+    }
+    // I/O APIC への INTx の経路付けはまだ実装していない
+    return {0, MAKE_ERROR(Error::kNotImplemented)};
+  }
 }
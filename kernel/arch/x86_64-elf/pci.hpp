@@ -14,6 +14,7 @@
 #define  PCI_COMMAND_IO         0x1
 #define  PCI_COMMAND_MEMORY     0x2
 #define  PCI_COMMAND_MASTER     0x4
+#define  PCI_COMMAND_INTX_DISABLE 0x400
 
 namespace pci {
   /** @brief CONFIG_ADDRESS レジスタの IO ポートアドレス */
@@ -100,4 +101,12 @@ namespace pci {
   }
 
   WithError<uint64_t> ReadBar(Device& device, unsigned int bar_index);
+
+  /** @brief デバイスの INTx 割り込みが届く割り込みコントローラ上の番号を返す
+   *
+   * 割り込みピンレジスタ（0x3d）が 0 なら INTx を使わないデバイスなので
+   * Error::kNoPCIInterrupt を返す．I/O APIC への経路付けは未実装なので，
+   * INTx を使うデバイスには Error::kNotImplemented を返す．
+   */
+  WithError<uint32_t> GetInterruptId(const Device& dev);
 }
@@ -0,0 +1,45 @@
+/**************************************************************/
+/**
+    @file    pmu.cpp
+
+    @brief   性能監視カウンタ．x86_64 では未実装で，常に使えない．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "pmu.hpp"
+
+bool InitializePMU() {
+  return false;
+}
+
+bool PMUAvailable() {
+  return false;
+}
+
+bool PMUSetEvents(const uint16_t* events, int n) {
+  return false;
+}
+
+int PMUNumEvents() {
+  return 0;
+}
+
+const char* PMUEventName(int i) {
+  return nullptr;
+}
+
+void PMUStart() {
+}
+
+void PMUStop() {
+}
+
+void PMURead(PMUSample& sample) {
+  sample = PMUSample{};
+}
@@ -0,0 +1,46 @@
+/**************************************************************/
+/**
+    @file    smp.cpp
+
+    @brief   2 つ目以降の CPU の起動と，CPU 間の関数呼び出し．
+             x86_64 では未実装で，起動した CPU だけで動く．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "smp.hpp"
+
+void InitializeSMP() {
+}
+
+int StartSecondaryCPUs() {
+  return 1;
+}
+
+int NumCPUs() {
+  return 1;
+}
+
+int CurrentCPUIndex() {
+  return 0;
+}
+
+Error RunOnCPU(int cpu, CPUFunc func, void* arg) {
+  if (cpu != 0) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+  func(arg);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+bool HasPendingCPUCalls() {
+  return false;
+}
+
+void RunPendingCPUCalls() {
+}
@@ -0,0 +1,42 @@
+/**************************************************************/
+/**
+    @file    smp.hpp
+
+    @brief   2 つ目以降の CPU の起動と，CPU 間の関数呼び出し．
+             x86_64 では未実装で，起動した CPU だけで動く．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __SMP_HPP__
+#define __SMP_HPP__
+
+#include <cstdint>
+
+#include "error.hpp"
+
+const int kMaxCPUs = 1;
+
+using CPUFunc = void (*)(void* arg);
+
+void InitializeSMP();
+
+/** @brief 常に 1 を返す． */
+int StartSecondaryCPUs();
+
+int NumCPUs();
+int CurrentCPUIndex();
+
+/** @brief cpu が 0 ならその場で func(arg) を呼ぶ． */
+Error RunOnCPU(int cpu, CPUFunc func, void* arg);
+
+/** @brief ほかの CPU から現在の CPU へ頼まれた関数があれば真． */
+bool HasPendingCPUCalls();
+
+void RunPendingCPUCalls();
+
+#endif /* __SMP_HPP__ */
@@ -0,0 +1,25 @@
+/**************************************************************/
+/**
+    @file    timer_device.cpp
+
+    @brief   周期割り込みのタイマ．x86_64 では未実装．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include "timer_device.hpp"
+
+Error StartTimerDevice(uint64_t interval) {
+  return MAKE_ERROR(Error::kNotImplemented);
+}
+
+void AcknowledgeTimerDevice() {
+}
+
+void StopTimerDevice() {
+}
@@ -0,0 +1,30 @@
+/**************************************************************/
+/**
+    @file    timer_device.hpp
+
+    @brief   周期割り込みのタイマ．x86_64 では未実装．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+#ifndef __TIMER_DEVICE_HPP__
+#define __TIMER_DEVICE_HPP__
+
+#include <cstdint>
+
+#include "error.hpp"
+
+const uint32_t kTimerDeviceInterruptId = 0;
+
+/** @brief 常に Error::kNotImplemented を返す． */
+Error StartTimerDevice(uint64_t interval);
+
+void AcknowledgeTimerDevice();
+
+void StopTimerDevice();
+
+#endif /* __TIMER_DEVICE_HPP__ */
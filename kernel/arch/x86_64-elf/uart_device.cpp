@@ -0,0 +1,55 @@
+/**************************************************************/
+/**
+    @file    uart_device.cpp
+
+    @brief   COM1 の 16550 互換 UART．
+
+
+    Copyright 2020 Yabe.Kazuhiro
+
+***************************************************************
+
+*/
+/**************************************************************/
+
+#include <cstdint>
+
+#include "asmfunc.h"
+#include "uart_device.hpp"
+
+namespace {
+  const uint16_t kCOM1 = 0x3f8;
+
+  const uint16_t kTHR = kCOM1 + 0;  // 送信保持レジスタ（DLAB = 1 で除数の下位）
+  const uint16_t kIER = kCOM1 + 1;  // 割り込み許可レジスタ（DLAB = 1 で除数の上位）
+  const uint16_t kFCR = kCOM1 + 2;  // FIFO 制御レジスタ
+  const uint16_t kLCR = kCOM1 + 3;  // ライン制御レジスタ
+  const uint16_t kMCR = kCOM1 + 4;  // モデム制御レジスタ
+  const uint16_t kLSR = kCOM1 + 5;  // ラインステータスレジスタ
+
+  const uint8_t kLSRTxEmpty = 1u << 5;
+  const size_t kTxFIFOSize = 16;
+}
+
+Error InitializeUARTDevice() {
+  IoOut8(kIER, 0x00);  // 割り込みは使わない
+  IoOut8(kLCR, 0x80);  // DLAB = 1
+  IoOut8(kTHR, 0x01);  // 115200 bps
+  IoOut8(kIER, 0x00);
+  IoOut8(kLCR, 0x03);  // 8N1, DLAB = 0
+  IoOut8(kFCR, 0xc7);  // FIFO を有効にしてクリアする
+  IoOut8(kMCR, 0x03);  // DTR, RTS
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+size_t UARTDeviceWrite(const char* s, size_t len) {
+  // 16550 は FIFO の空き数を教えてくれないので，空になったときに FIFO の深さまで書く
+  if ((IoIn8(kLSR) & kLSRTxEmpty) == 0) {
+    return 0;
+  }
+  const size_t n = len < kTxFIFOSize ? len : kTxFIFOSize;
+  for (size_t i = 0; i < n; ++i) {
+    IoOut8(kTHR, static_cast<uint8_t>(s[i]));
+  }
+  return n;
+}
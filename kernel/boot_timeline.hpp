@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+/* ブートローダからカーネルへ渡す起動時間の記録．
+ * MikanLoaderPkg からも C として読み込まれる．
+ */
+
+#define BOOT_TIMELINE_MAX_ENTRIES 32
+#define BOOT_TIMELINE_NAME_LEN 32
+
+struct BootTimelineEntry {
+  char name[BOOT_TIMELINE_NAME_LEN];
+  /* カーネルと共通のカウンタの値（aarch64 は CNTVCT_EL0，x86_64 は TSC）． */
+  uint64_t ticks;
+};
+
+struct BootTimeline {
+  uint32_t num_entries;
+  struct BootTimelineEntry entries[BOOT_TIMELINE_MAX_ENTRIES];
+};
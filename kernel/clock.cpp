@@ -0,0 +1,36 @@
+/**
+ * @file clock.cpp
+ *
+ * 単調増加するカウンタによる時刻の計測．
+ */
+
+#include "clock.hpp"
+
+namespace {
+  uint64_t clock_frequency = 0;
+}
+
+void InitializeClock() {
+  InitializeCounter();
+  clock_frequency = CounterFrequency();
+}
+
+uint64_t ClockFrequency() {
+  return clock_frequency;
+}
+
+uint64_t TicksToNanoseconds(uint64_t ticks) {
+  if (clock_frequency == 0) {
+    return 0;
+  }
+  // 64 ビットで溢れないよう秒とその端数に分けて換算する
+  const uint64_t sec = ticks / clock_frequency;
+  const uint64_t rem = ticks % clock_frequency;
+  return sec * 1000000000 + rem * 1000000000 / clock_frequency;
+}
+
+uint64_t MicrosecondsToTicks(uint64_t us) {
+  const uint64_t sec = us / 1000000;
+  const uint64_t rem = us % 1000000;
+  return sec * clock_frequency + rem * clock_frequency / 1000000;
+}
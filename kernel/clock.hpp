@@ -0,0 +1,33 @@
+/**
+ * @file clock.hpp
+ *
+ * 単調増加するカウンタによる時刻の計測．
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "counter.hpp"
+
+/** @brief カウンタの周波数を求め，時刻の換算を使えるようにする． */
+void InitializeClock();
+
+/** @brief 起動後に単調増加するカウンタの現在値． */
+inline uint64_t ClockTicks() {
+  return ReadCounter();
+}
+
+/** @brief カウンタの周波数（Hz）． */
+uint64_t ClockFrequency();
+
+/** @brief カウンタの値の差 ticks をナノ秒に換算する． */
+uint64_t TicksToNanoseconds(uint64_t ticks);
+
+/** @brief カウンタの値の差 ticks をマイクロ秒に換算する． */
+inline uint64_t TicksToMicroseconds(uint64_t ticks) {
+  return TicksToNanoseconds(ticks) / 1000;
+}
+
+/** @brief マイクロ秒 us をカウンタの値の差に換算する． */
+uint64_t MicrosecondsToTicks(uint64_t us);
@@ -6,42 +6,97 @@
 
 #include "console.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include "font.hpp"
+#include "profile.hpp"
 
 Console::Console(PixelWriter& writer,
     const PixelColor& fg_color, const PixelColor& bg_color)
     : writer_{writer}, fg_color_{fg_color}, bg_color_{bg_color},
-      buffer_{}, cursor_row_{0}, cursor_column_{0} {
+      rows_{std::min(kMaxRows, writer.Height() / 16)},
+      columns_{std::min(kMaxColumns, writer.Width() / 8)},
+      buffer_{}, dirty_{}, cursor_row_{0}, cursor_column_{0},
+      pending_scroll_{0} {
 }
 
 void Console::PutString(const char* s) {
   while (*s) {
     if (*s == '\n') {
       Newline();
-    } else if (cursor_column_ < kColumns - 1) {
-      WriteAscii(writer_, 8 * cursor_column_, 16 * cursor_row_, *s, fg_color_);
-      buffer_[cursor_row_][cursor_column_] = *s;
+    } else if (cursor_column_ < columns_) {
+      if (buffer_[cursor_row_][cursor_column_] != *s) {
+        buffer_[cursor_row_][cursor_column_] = *s;
+        MarkCell(cursor_row_, cursor_column_);
+      }
       ++cursor_column_;
     }
     ++s;
   }
 }
 
+void Console::Flush() {
+  PMU_SCOPE("Console::Flush");
+  if (pending_scroll_ > 0) {
+    // 描画済みの画素をまとめて上へずらし，新しく現れた行だけを塗る
+    const int n = pending_scroll_;
+    if (n < rows_) {
+      writer_.MoveRows(0, 16 * n, 16 * (rows_ - n));
+    }
+    FillRectangle(writer_, {0, 16 * (rows_ - n)}, {8 * columns_, 16 * n}, bg_color_);
+    pending_scroll_ = 0;
+  }
+
+  char line[kMaxColumns + 1];
+  for (int row = 0; row < rows_; ++row) {
+    int column = 0;
+    while (column < columns_) {
+      if (dirty_[row][column / 32] == 0) {
+        column = (column / 32 + 1) * 32;
+        continue;
+      }
+      if (!IsDirty(row, column)) {
+        ++column;
+        continue;
+      }
+
+      // 連続する変更セルを 1 回の WriteString で描く
+      const int start = column;
+      for (; column < columns_ && IsDirty(row, column); ++column) {
+        const char c = buffer_[row][column];
+        line[column - start] = c ? c : ' ';
+      }
+      line[column - start] = '\0';
+      WriteString(writer_, 8 * start, 16 * row, line, fg_color_, bg_color_);
+    }
+    memset(dirty_[row], 0, sizeof(dirty_[row]));
+  }
+}
+
 void Console::Newline() {
+  PMU_SCOPE("Console::Newline");
   cursor_column_ = 0;
-  if (cursor_row_ < kRows - 1) {
+  if (cursor_row_ < rows_ - 1) {
     ++cursor_row_;
-  } else {
-    for (int y = 0; y < 16 * kRows; ++y) {
-      for (int x = 0; x < 8 * kColumns; ++x) {
-        writer_.Write(x, y, bg_color_);
+    return;
+  }
+
+  memmove(buffer_[0], buffer_[1], (rows_ - 1) * sizeof(buffer_[0]));
+  memmove(dirty_[0], dirty_[1], (rows_ - 1) * sizeof(dirty_[0]));
+  memset(buffer_[rows_ - 1], 0, sizeof(buffer_[0]));
+  memset(dirty_[rows_ - 1], 0, sizeof(dirty_[0]));
+
+  if (pending_scroll_ < rows_) {
+    ++pending_scroll_;
+    if (pending_scroll_ == rows_) {
+      // 画面上の画素はすべて流れ去るので，残っている文字をすべて描き直す
+      for (int row = 0; row < rows_; ++row) {
+        for (int column = 0; column < columns_; ++column) {
+          if (buffer_[row][column]) {
+            MarkCell(row, column);
+          }
+        }
       }
     }
-    for (int row = 0; row < kRows - 1; ++row) {
-      memcpy(buffer_[row], buffer_[row + 1], kColumns + 1);
-      WriteString(writer_, 0, 16 * row, buffer_[row], fg_color_);
-    }
-    memset(buffer_[kRows - 1], 0, kColumns + 1);
   }
 }
@@ -1,20 +1,45 @@
+/**
+ * @file console.hpp
+ *
+ * コンソール描画のプログラムを集めたファイル．
+ */
+
 #pragma once
 
 #include "graphics.hpp"
 
 class Console {
  public:
-  static const int kRows = 25, kColumns = 80;
+  /** @brief 扱える最大の行数と桁数．実際の大きさは描画先の解像度から決める． */
+  static const int kMaxRows = 128, kMaxColumns = 256;
 
   Console(PixelWriter& writer,
       const PixelColor& fg_color, const PixelColor& bg_color);
+  /** @brief 文字列をバッファに書き込む．画面への反映は Flush で行う． */
   void PutString(const char* s);
+  /** @brief 溜まっているスクロールと変更されたセルを画面に反映する． */
+  void Flush();
+
+  int Rows() const { return rows_; }
+  int Columns() const { return columns_; }
 
  private:
+  static const int kDirtyWords = kMaxColumns / 32;
+
   void Newline();
+  void MarkCell(int row, int column) {
+    dirty_[row][column / 32] |= 1u << (column % 32);
+  }
+  bool IsDirty(int row, int column) const {
+    return (dirty_[row][column / 32] >> (column % 32)) & 1u;
+  }
 
   PixelWriter& writer_;
   const PixelColor fg_color_, bg_color_;
-  char buffer_[kRows][kColumns + 1];
+  const int rows_, columns_;
+  char buffer_[kMaxRows][kMaxColumns + 1];
+  uint32_t dirty_[kMaxRows][kDirtyWords];
   int cursor_row_, cursor_column_;
+  /** @brief まだ画面に反映していないスクロールの行数．rows_ を上限とする． */
+  int pending_scroll_;
 };
@@ -0,0 +1,110 @@
+/**
+ * @file drawing_bench.cpp
+ *
+ * 描画関数の速さを測るベンチマーク．
+ */
+
+#include "drawing_bench.hpp"
+
+#include <new>
+
+#include "clock.hpp"
+#include "font.hpp"
+#include "logger.hpp"
+
+namespace {
+  const int kWidth = 640, kHeight = 480;
+  const int kIterations = 16;
+  const char kText[] = "The quick brown fox jumps over the lazy dog 0123456789";
+  const int kTextLen = sizeof(kText) - 1;
+
+  /** @brief 仮想関数 Write で 1 画素ずつ塗る．スパン導入前の FillRectangle と同じ． */
+  void FillRectanglePerPixel(PixelWriter& writer, const Vector2D<int>& pos,
+                             const Vector2D<int>& size, const PixelColor& c) {
+    for (int dy = 0; dy < size.y; ++dy) {
+      for (int dx = 0; dx < size.x; ++dx) {
+        writer.Write(pos.x + dx, pos.y + dy, c);
+      }
+    }
+  }
+
+  /** @brief 仮想関数 Write で 1 画素ずつ文字列を描く．スパン導入前の WriteString と同じ． */
+  void WriteStringPerPixel(PixelWriter& writer, int x, int y, const char* s,
+                           const PixelColor& fg, const PixelColor& bg) {
+    for (int i = 0; s[i] != '\0'; ++i) {
+      const uint8_t* font = GetFont(s[i]);
+      for (int dy = 0; dy < 16; ++dy) {
+        for (int dx = 0; dx < 8; ++dx) {
+          const bool on = font && ((font[dy] << dx) & 0x80u);
+          writer.Write(x + 8 * i + dx, y + dy, on ? fg : bg);
+        }
+      }
+    }
+  }
+
+  template <class F>
+  uint64_t Measure(F&& f) {
+    const uint64_t start = ClockTicks();
+    for (int i = 0; i < kIterations; ++i) {
+      f(i);
+    }
+    return TicksToNanoseconds(ClockTicks() - start) / kIterations;
+  }
+
+  void Report(const char* name, uint64_t span_ns, uint64_t per_pixel_ns) {
+    printk("%-24s span %8u ns, per-pixel %8u ns (x%u.%02u)\n",
+           name, span_ns, per_pixel_ns,
+           span_ns ? per_pixel_ns / span_ns : 0,
+           span_ns ? per_pixel_ns * 100 / span_ns % 100 : 0);
+  }
+
+  void Run(PixelWriter& writer) {
+    const PixelColor colors[2] = {{45, 118, 237}, {255, 255, 255}};
+    const PixelColor fg = {255, 255, 255}, bg = {0, 0, 0};
+
+    const uint64_t fill_span = Measure([&](int i) {
+      FillRectangle(writer, {0, 0}, {kWidth, kHeight}, colors[i & 1]);
+    });
+    const uint64_t fill_pixel = Measure([&](int i) {
+      FillRectanglePerPixel(writer, {0, 0}, {kWidth, kHeight}, colors[i & 1]);
+    });
+    Report("FillRectangle 640x480", fill_span, fill_pixel);
+
+    // 1 行分の文字列を画面の高さいっぱいに描く
+    const uint64_t text_span = Measure([&](int) {
+      for (int y = 0; y + 16 <= kHeight; y += 16) {
+        WriteString(writer, 0, y, kText, fg, bg);
+      }
+    });
+    const uint64_t text_pixel = Measure([&](int) {
+      for (int y = 0; y + 16 <= kHeight; y += 16) {
+        WriteStringPerPixel(writer, 0, y, kText, fg, bg);
+      }
+    });
+    Report("WriteString 30 lines", text_span, text_pixel);
+  }
+}
+
+void BenchmarkDrawing(PixelFormat format) {
+  static_assert(8 * kTextLen <= kWidth, "kText must fit in one line");
+  auto buf = new(std::nothrow) uint8_t[4 * kWidth * kHeight];
+  if (buf == nullptr) {
+    Log(kWarn, "BenchmarkDrawing: no memory\n");
+    return;
+  }
+  const FrameBufferConfig config{buf, kWidth, kWidth, kHeight, format};
+
+  switch (format) {
+    case kPixelRGBResv8BitPerColor: {
+      RGBResv8BitPerColorPixelWriter writer{config};
+      Run(writer);
+      break;
+    }
+    case kPixelBGRResv8BitPerColor: {
+      BGRResv8BitPerColorPixelWriter writer{config};
+      Run(writer);
+      break;
+    }
+  }
+  delete[] buf;
+}
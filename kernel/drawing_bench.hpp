@@ -0,0 +1,15 @@
+/**
+ * @file drawing_bench.hpp
+ *
+ * 描画関数の速さを測るベンチマーク．
+ */
+
+#pragma once
+
+#include "graphics.hpp"
+
+/** @brief FillRectangle と WriteString を，スパン単位の描画と画素ごとの Write で比べる．
+ *
+ * 画面には描かず，format と同じ画素形式の作業用バッファに描く．結果は printk で表示する．
+ */
+void BenchmarkDrawing(PixelFormat format);
@@ -26,6 +26,11 @@ class Error {
     kInvalidPhase,
     kUnknownXHCISpeedID,
     kNoWaiter,
+    kUnknownPixelFormat,
+    kNoInterruptController,
+    kNoPCIInterrupt,
+    kTimeout,
+    kNoSuchTask,
     kLastOfCode,  // この列挙子は常に最後に配置する
   };
 
@@ -51,6 +56,11 @@ class Error {
     "kInvalidPhase",
     "kUnknownXHCISpeedID",
     "kNoWaiter",
+    "kUnknownPixelFormat",
+    "kNoInterruptController",
+    "kNoPCIInterrupt",
+    "kTimeout",
+    "kNoSuchTask",
   };
   static_assert(Error::Code::kLastOfCode == code_names_.size());
 
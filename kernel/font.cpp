@@ -6,6 +6,8 @@
 
 #include "font.hpp"
 
+#include <cstring>
+
 extern const uint8_t _binary_hankaku_bin_start;
 extern const uint8_t _binary_hankaku_bin_end;
 extern const uint8_t _binary_hankaku_bin_size;
@@ -18,22 +20,154 @@ const uint8_t* GetFont(char c) {
   return &_binary_hankaku_bin_start + index;
 }
 
+namespace {
+  /** @brief フォントの 1 行分（最上位ビットが左端）を WriteSpanMasked 用の
+   * マスク（最下位ビットが左端）に変換する．
+   */
+  uint32_t GlyphRowMask(uint8_t bits) {
+    bits = (bits & 0xf0u) >> 4 | (bits & 0x0fu) << 4;
+    bits = (bits & 0xccu) >> 2 | (bits & 0x33u) << 2;
+    bits = (bits & 0xaau) >> 1 | (bits & 0x55u) << 1;
+    return bits;
+  }
+}
+
+namespace {
+  /** @brief Pack 済みの画素値 pixel で 1 文字を描く． */
+  void WriteGlyph(PixelWriter& writer, int x, int y, const uint8_t* font,
+                  const uint32_t (&pixels)[8]) {
+    for (int dy = 0; dy < 16; ++dy) {
+      if (font[dy]) {
+        writer.WriteSpanMasked(x, y + dy, pixels, GlyphRowMask(font[dy]), 8);
+      }
+    }
+  }
+
+  void FillGlyphPixels(uint32_t (&pixels)[8], uint32_t pixel) {
+    for (auto& p : pixels) {
+      p = pixel;
+    }
+  }
+}
+
 void WriteAscii(PixelWriter& writer, int x, int y, char c, const PixelColor& color) {
   const uint8_t* font = GetFont(c);
   if (font == nullptr) {
     return;
   }
-  for (int dy = 0; dy < 16; ++dy) {
-    for (int dx = 0; dx < 8; ++dx) {
-      if ((font[dy] << dx) & 0x80u) {
-        writer.Write(x + dx, y + dy, color);
+  uint32_t pixels[8];
+  FillGlyphPixels(pixels, writer.Pack(color));
+  WriteGlyph(writer, x, y, font, pixels);
+  writer.MarkDirty({{x, y}, {8, 16}});
+}
+
+void WriteString(PixelWriter& writer, int x, int y, const char* s, const PixelColor& color) {
+  uint32_t pixels[8];
+  FillGlyphPixels(pixels, writer.Pack(color));
+  int len = 0;
+  for (; s[len] != '\0'; ++len) {
+    if (const uint8_t* font = GetFont(s[len])) {
+      WriteGlyph(writer, x + 8 * len, y, font, pixels);
+    }
+  }
+  writer.MarkDirty({{x, y}, {8 * len, 16}});
+}
+
+namespace {
+  /** @brief 前景色と背景色を Pack 済みの画素に展開したグリフ． */
+  struct GlyphCacheEntry {
+    bool valid;
+    char c;
+    PixelFormat format;
+    uint32_t fg, bg;
+    uint32_t pixels[16][8];
+  };
+
+  /** @brief (文字，前景色，背景色，画素形式) をキーとするダイレクトマップ方式のキャッシュ．
+   *
+   * 色の組が同じなら異なる文字は異なるエントリに入るように添字を決める．
+   * そのため WriteString が 1 回の呼び出しで得たエントリ同士が追い出し合うことはない．
+   */
+  const int kGlyphCacheSize = 256;
+  GlyphCacheEntry glyph_cache[kGlyphCacheSize];
+
+  unsigned int GlyphCacheIndex(char c, uint32_t fg, uint32_t bg) {
+    uint32_t h = fg * 0x9e3779b1u ^ bg * 0x85ebca6bu;
+    h ^= h >> 16;
+    return (static_cast<uint8_t>(c) + h) % kGlyphCacheSize;
+  }
+
+  /** @brief c のグリフを展開済みの画素で返す．フォントが無ければ nullptr． */
+  const GlyphCacheEntry* LookupGlyph(PixelFormat format, char c,
+                                     uint32_t fg, uint32_t bg) {
+    auto& entry = glyph_cache[GlyphCacheIndex(c, fg, bg)];
+    if (entry.valid && entry.c == c && entry.format == format &&
+        entry.fg == fg && entry.bg == bg) {
+      return &entry;
+    }
+
+    const uint8_t* font = GetFont(c);
+    if (font == nullptr) {
+      return nullptr;
+    }
+    for (int dy = 0; dy < 16; ++dy) {
+      for (int dx = 0; dx < 8; ++dx) {
+        entry.pixels[dy][dx] = ((font[dy] << dx) & 0x80u) ? fg : bg;
       }
     }
+    entry.c = c;
+    entry.format = format;
+    entry.fg = fg;
+    entry.bg = bg;
+    entry.valid = true;
+    return &entry;
   }
 }
 
-void WriteString(PixelWriter& writer, int x, int y, const char* s, const PixelColor& color) {
-  for (int i = 0; s[i] != '\0'; ++i) {
-    WriteAscii(writer, x + 8 * i, y, s[i], color);
+void WriteAscii(PixelWriter& writer, int x, int y, char c,
+                const PixelColor& fg, const PixelColor& bg) {
+  const uint32_t bg_pixel = writer.Pack(bg);
+  auto glyph = LookupGlyph(writer.Format(), c, writer.Pack(fg), bg_pixel);
+  for (int dy = 0; dy < 16; ++dy) {
+    // フォントの無い文字は WriteString と同じく背景だけを描く
+    if (glyph) {
+      writer.WriteSpan(x, y + dy, glyph->pixels[dy], 8);
+    } else {
+      writer.FillSpan(x, y + dy, 8, bg_pixel);
+    }
+  }
+  writer.MarkDirty({{x, y}, {8, 16}});
+}
+
+void WriteString(PixelWriter& writer, int x, int y, const char* s,
+                 const PixelColor& fg, const PixelColor& bg) {
+  // 1 度に描く文字数．走査線 1 本分の画素をスタック上に組み立てる．
+  const int kChunk = 64;
+  const int start_x = x;
+
+  const uint32_t fg_pixel = writer.Pack(fg), bg_pixel = writer.Pack(bg);
+
+  const GlyphCacheEntry* glyphs[kChunk];
+  uint32_t row[8 * kChunk];
+  while (*s) {
+    int n = 0;
+    for (; n < kChunk && s[n]; ++n) {
+      glyphs[n] = LookupGlyph(writer.Format(), s[n], fg_pixel, bg_pixel);
+    }
+    for (int dy = 0; dy < 16; ++dy) {
+      for (int i = 0; i < n; ++i) {
+        if (glyphs[i]) {
+          memcpy(&row[8 * i], glyphs[i]->pixels[dy], sizeof(glyphs[i]->pixels[dy]));
+        } else {
+          for (int dx = 0; dx < 8; ++dx) {
+            row[8 * i + dx] = bg_pixel;
+          }
+        }
+      }
+      writer.WriteSpan(x, y + dy, row, 8 * n);
+    }
+    x += 8 * n;
+    s += n;
   }
+  writer.MarkDirty({{start_x, y}, {x - start_x, 16}});
 }
@@ -3,5 +3,23 @@
 #include <cstdint>
 #include "graphics.hpp"
 
+/** @brief 文字 c のフォント（1 行 1 バイトで 16 行）を返す．無ければ nullptr． */
+const uint8_t* GetFont(char c);
+
+/** @brief 文字 c を色 color で描く．文字の背景は描かない（透過）． */
 void WriteAscii(PixelWriter& writer, int x, int y, char c, const PixelColor& color);
+/** @brief 文字列 s を色 color で描く．文字の背景は描かない（透過）． */
 void WriteString(PixelWriter& writer, int x, int y, const char* s, const PixelColor& color);
+
+/** @brief 文字 c を前景色 fg，背景色 bg で 8x16 画素の矩形として描く．
+ *
+ * 展開済みのグリフをキャッシュから取り出し，16 回の行コピーで描く．
+ */
+void WriteAscii(PixelWriter& writer, int x, int y, char c,
+                const PixelColor& fg, const PixelColor& bg);
+/** @brief 文字列 s を前景色 fg，背景色 bg で描く．
+ *
+ * 複数の文字をまとめて 1 走査線ずつ描く．
+ */
+void WriteString(PixelWriter& writer, int x, int y, const char* s,
+                 const PixelColor& fg, const PixelColor& bg);
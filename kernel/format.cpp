@@ -0,0 +1,183 @@
+/**
+ * @file format.cpp
+ *
+ * printf 互換の書式文字列を使う，型安全で小さな書式化関数．
+ */
+
+#include "format.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+  /** @brief 書き込んだバイト数を数えながら sink に書き込む． */
+  class CountingWriter {
+   public:
+    CountingWriter(FormatSink& sink) : sink_{sink}, count_{0} {}
+
+    void Write(const char* s, size_t len) {
+      if (len > 0) {
+        sink_.Write(s, len);
+        count_ += len;
+      }
+    }
+
+    void Pad(char c, int n) {
+      static const char kSpaces[] = "                ";
+      static const char kZeros[]  = "0000000000000000";
+      const char* pad = c == '0' ? kZeros : kSpaces;
+      while (n > 0) {
+        const int len = n < 16 ? n : 16;
+        Write(pad, len);
+        n -= len;
+      }
+    }
+
+    size_t Count() const { return count_; }
+
+   private:
+    FormatSink& sink_;
+    size_t count_;
+  };
+
+  struct Spec {
+    bool zero_pad = false;
+    bool left = false;
+    int width = 0;
+    char conversion = '\0';
+  };
+
+  void WriteField(CountingWriter& w, const Spec& spec,
+                  const char* prefix, const char* body, int body_len) {
+    const int prefix_len = strlen(prefix);
+    const int pad = spec.width - prefix_len - body_len;
+    if (spec.left) {
+      w.Write(prefix, prefix_len);
+      w.Write(body, body_len);
+      w.Pad(' ', pad);
+    } else if (spec.zero_pad) {
+      w.Write(prefix, prefix_len);
+      w.Pad('0', pad);
+      w.Write(body, body_len);
+    } else {
+      w.Pad(' ', pad);
+      w.Write(prefix, prefix_len);
+      w.Write(body, body_len);
+    }
+  }
+
+  void WriteNumber(CountingWriter& w, const Spec& spec,
+                   uint64_t value, bool negative, const char* prefix) {
+    const char* digits = spec.conversion == 'X' ?
+      "0123456789ABCDEF" : "0123456789abcdef";
+    const unsigned int base =
+      (spec.conversion == 'x' || spec.conversion == 'X' ||
+       spec.conversion == 'p') ? 16 : 10;
+
+    char buf[20];
+    int i = sizeof(buf);
+    do {
+      buf[--i] = digits[value % base];
+      value /= base;
+    } while (value > 0);
+    WriteField(w, spec, negative ? "-" : prefix, &buf[i], sizeof(buf) - i);
+  }
+
+  void WriteArg(CountingWriter& w, const Spec& spec, const FormatArg& arg) {
+    const char* prefix = spec.conversion == 'p' ? "0x" : "";
+    switch (arg.GetKind()) {
+    case FormatArg::kNone:
+      break;
+    case FormatArg::kString: {
+      const char* s = arg.String() ? arg.String() : "(null)";
+      WriteField(w, spec, "", s, strlen(s));
+      break;
+    }
+    case FormatArg::kChar:
+    case FormatArg::kSigned:
+    case FormatArg::kUnsigned:
+      if (spec.conversion == 'c' ||
+          (arg.GetKind() == FormatArg::kChar && spec.conversion == 's')) {
+        const char c = arg.Unsigned();
+        WriteField(w, spec, "", &c, 1);
+      } else if (arg.GetKind() == FormatArg::kSigned &&
+                 (spec.conversion == 'd' || spec.conversion == 'i')) {
+        const int64_t v = arg.Signed();
+        WriteNumber(w, spec, v < 0 ? -static_cast<uint64_t>(v) : v, v < 0, "");
+      } else {
+        WriteNumber(w, spec, arg.Bits(), false, prefix);
+      }
+      break;
+    case FormatArg::kPointer:
+      WriteNumber(w, spec, arg.Unsigned(), false, prefix);
+      break;
+    }
+  }
+}
+
+void BufferSink::Write(const char* s, size_t len) {
+  if (len_ + 1 >= size_) {
+    return;
+  }
+  const size_t n = std::min(len, size_ - 1 - len_);
+  memcpy(&buf_[len_], s, n);
+  len_ += n;
+  buf_[len_] = '\0';
+}
+
+size_t FormatArgs(FormatSink& sink, const char* format,
+                  const FormatArg* args, size_t num_args) {
+  CountingWriter w{sink};
+  size_t next_arg = 0;
+
+  while (*format) {
+    // 変換指定までの文字列はまとめて書き込む
+    const char* literal = format;
+    while (*format && *format != '%') {
+      ++format;
+    }
+    w.Write(literal, format - literal);
+    if (*format == '\0') {
+      break;
+    }
+
+    const char* spec_begin = format++;
+    Spec spec;
+    for (;; ++format) {
+      if (*format == '0') {
+        spec.zero_pad = true;
+      } else if (*format == '-') {
+        spec.left = true;
+      } else {
+        break;
+      }
+    }
+    while ('0' <= *format && *format <= '9') {
+      spec.width = spec.width * 10 + (*format - '0');
+      ++format;
+    }
+    while (*format == 'l' || *format == 'h' || *format == 'z') {
+      ++format;
+    }
+
+    spec.conversion = *format;
+    switch (spec.conversion) {
+    case '%':
+      w.Write("%", 1);
+      ++format;
+      break;
+    case 'd': case 'i': case 'u': case 'x': case 'X':
+    case 'p': case 's': case 'c':
+      if (next_arg < num_args) {
+        WriteArg(w, spec, args[next_arg++]);
+      }
+      ++format;
+      break;
+    default:
+      // 解釈できない変換指定はそのまま書き出す
+      w.Write(spec_begin, format - spec_begin);
+      break;
+    }
+  }
+  return w.Count();
+}
@@ -0,0 +1,107 @@
+/**
+ * @file format.hpp
+ *
+ * printf 互換の書式文字列を使う，型安全で小さな書式化関数．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/** @brief 書式化した文字列の書き込み先． */
+class FormatSink {
+ public:
+  virtual ~FormatSink() = default;
+  /** @brief s の先頭 len バイトを書き込む．s は NUL 終端していない． */
+  virtual void Write(const char* s, size_t len) = 0;
+};
+
+/** @brief 固定長の配列に NUL 終端して書き込む．入りきらない分は捨てる． */
+class BufferSink : public FormatSink {
+ public:
+  BufferSink(char* buf, size_t size) : buf_{buf}, size_{size}, len_{0} {
+    if (size_ > 0) {
+      buf_[0] = '\0';
+    }
+  }
+  void Write(const char* s, size_t len) override;
+  size_t Length() const { return len_; }
+
+ private:
+  char* buf_;
+  size_t size_, len_;
+};
+
+/** @brief 型の情報を保ったまま書式化関数に渡す引数． */
+class FormatArg {
+ public:
+  enum Kind {
+    kNone,
+    kSigned,
+    kUnsigned,
+    kChar,
+    kString,
+    kPointer,
+  };
+
+  FormatArg() : kind_{kNone}, size_{0}, u_{0} {}
+  FormatArg(char c) : kind_{kChar}, size_{1}, u_{static_cast<uint8_t>(c)} {}
+  FormatArg(bool b) : kind_{kUnsigned}, size_{1}, u_{b} {}
+  FormatArg(const char* s) : kind_{kString}, size_{sizeof(s)}, s_{s} {}
+  FormatArg(char* s) : kind_{kString}, size_{sizeof(s)}, s_{s} {}
+
+  template <typename T,
+            std::enable_if_t<std::is_integral_v<T> && std::is_signed_v<T>, int> = 0>
+  FormatArg(T v) : kind_{kSigned}, size_{sizeof(T)}, i_{v} {}
+  template <typename T,
+            std::enable_if_t<std::is_integral_v<T> && std::is_unsigned_v<T>, int> = 0>
+  FormatArg(T v) : kind_{kUnsigned}, size_{sizeof(T)}, u_{v} {}
+  template <typename T, std::enable_if_t<std::is_enum_v<T>, int> = 0>
+  FormatArg(T v) : FormatArg(static_cast<std::underlying_type_t<T>>(v)) {}
+  template <typename T>
+  FormatArg(T* p) : kind_{kPointer}, size_{sizeof(p)}, u_{reinterpret_cast<uintptr_t>(p)} {}
+
+  Kind GetKind() const { return kind_; }
+  int64_t Signed() const { return i_; }
+  uint64_t Unsigned() const { return u_; }
+  /** @brief 元の型のバイト数で切り詰めた値．%x に負の int を渡すと 32 ビットで表示する． */
+  uint64_t Bits() const {
+    return size_ >= sizeof(u_) ? u_ : u_ & ((uint64_t{1} << (8 * size_)) - 1);
+  }
+  const char* String() const { return s_; }
+
+ private:
+  Kind kind_;
+  uint8_t size_;  // 元の型のバイト数
+  union {
+    int64_t i_;
+    uint64_t u_;
+    const char* s_;
+  };
+};
+
+/** @brief 書式文字列 format に従って args を sink に書き込む．
+ *
+ * 使える変換指定子は d, i, u, x, X, p, s, c, % で，フラグ 0 と -，幅を指定できる．
+ * 長さ修飾子（l, ll, h, z）は読み飛ばし，値の大きさと符号は引数の型から決める．
+ * 変換指定子は基数だけを決めるので，%x に符号付き整数を渡しても %d に
+ * ポインタを渡しても未定義動作にはならない．符号付き整数を %x や %u で書くときは
+ * printf と同じく元の型の幅の符号なし整数として扱い，%c に整数を渡せば文字として書く．
+ *
+ * @return 書き込んだバイト数．
+ */
+size_t FormatArgs(FormatSink& sink, const char* format,
+                  const FormatArg* args, size_t num_args);
+
+/** @brief 書式文字列 format に従って args を sink に書き込む．
+ *
+ * 引数の型はコンパイル時に FormatArg に写され，書式文字列は中間バッファを使わずに
+ * 1 回の走査で sink へ書き出される．
+ */
+template <typename... Args>
+size_t Format(FormatSink& sink, const char* format, Args... args) {
+  const FormatArg fargs[] = {FormatArg(args)..., FormatArg()};
+  return FormatArgs(sink, format, fargs, sizeof...(Args));
+}
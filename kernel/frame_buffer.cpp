@@ -0,0 +1,181 @@
+/**
+ * @file frame_buffer.cpp
+ *
+ * フレームバッファと裏画面のプログラムを集めたファイル．
+ */
+
+#include "frame_buffer.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "smp.hpp"
+
+namespace {
+  /** @brief 裏画面やレイヤの描画面をヒープから確保する．先頭をキャッシュラインに揃える． */
+  uint8_t* AllocSurfaceMemory(size_t bytes) {
+    void* p;
+    if (posix_memalign(&p, 64, bytes) != 0) {
+      return nullptr;
+    }
+    return static_cast<uint8_t*>(p);
+  }
+}
+
+Error FrameBuffer::Initialize(const FrameBufferConfig& config) {
+  config_ = config;
+  switch (config_.pixel_format) {
+    case kPixelRGBResv8BitPerColor:
+      writer_ = new(writer_buf_) RGBResv8BitPerColorPixelWriter{config_};
+      break;
+    case kPixelBGRResv8BitPerColor:
+      writer_ = new(writer_buf_) BGRResv8BitPerColorPixelWriter{config_};
+      break;
+    default:
+      return MAKE_ERROR(Error::kUnknownPixelFormat);
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error FrameBuffer::Initialize(int width, int height, PixelFormat format) {
+  auto buf = AllocSurfaceMemory(4 * static_cast<size_t>(width) * height);
+  if (buf == nullptr) {
+    return MAKE_ERROR(Error::kNoEnoughMemory);
+  }
+
+  FrameBufferConfig config{};
+  config.frame_buffer = buf;
+  config.pixels_per_scan_line = width;
+  config.horizontal_resolution = width;
+  config.vertical_resolution = height;
+  config.pixel_format = format;
+  return Initialize(config);
+}
+
+bool FrameBuffer::ClipCopy(Vector2D<int>& dst_pos, const FrameBuffer& src,
+                           Rectangle<int>& src_area) const {
+  auto clipped_src = src_area & src.Bounds();
+  dst_pos += clipped_src.pos - src_area.pos;
+
+  const auto dst_area = Rectangle<int>{dst_pos, clipped_src.size} & Bounds();
+  clipped_src.pos += dst_area.pos - dst_pos;
+  clipped_src.size = dst_area.size;
+
+  dst_pos = dst_area.pos;
+  src_area = clipped_src;
+  return !src_area.Empty();
+}
+
+void FrameBuffer::Copy(Vector2D<int> dst_pos, const FrameBuffer& src,
+                       const Rectangle<int>& src_area) {
+  auto area = src_area;
+  if (!ClipCopy(dst_pos, src, area)) {
+    return;
+  }
+
+  const size_t bytes_per_row = 4 * area.size.x;
+  for (int dy = 0; dy < area.size.y; ++dy) {
+    memcpy(RowAt(dst_pos.x, dst_pos.y + dy),
+           src.RowAt(area.pos.x, area.pos.y + dy),
+           bytes_per_row);
+  }
+}
+
+void FrameBuffer::CopyTransparent(Vector2D<int> dst_pos, const FrameBuffer& src,
+                                  const Rectangle<int>& src_area,
+                                  uint32_t transparent_pixel) {
+  auto area = src_area;
+  if (!ClipCopy(dst_pos, src, area)) {
+    return;
+  }
+
+  for (int dy = 0; dy < area.size.y; ++dy) {
+    auto dst = RowAt(dst_pos.x, dst_pos.y + dy);
+    auto s = src.RowAt(area.pos.x, area.pos.y + dy);
+    for (int dx = 0; dx < area.size.x; ++dx) {
+      if (s[dx] != transparent_pixel) {
+        dst[dx] = s[dx];
+      }
+    }
+  }
+}
+
+Error ShadowFrameBuffer::Initialize(const FrameBufferConfig& screen_config) {
+  if (auto err = screen_.Initialize(screen_config)) {
+    return err;
+  }
+
+  has_back_ = false;
+  if (auto err = back_.Initialize(screen_config.horizontal_resolution,
+                                  screen_config.vertical_resolution,
+                                  screen_config.pixel_format)) {
+    return err;
+  }
+
+  damage_.Clear();
+  back_.Writer().SetDamageList(&damage_);
+  has_back_ = true;
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+namespace {
+  /** @brief これ以上の画素を複写するときだけ 2 つ目の CPU に手伝わせる．SGI の往復より十分大きくする． */
+  const int kParallelPresentPixels = 64 * 1024;
+
+  /** @brief 2 つ目の CPU に渡す複写の仕事．各ダメージの下半分を受け持つ． */
+  struct PresentJob {
+    FrameBuffer* screen;
+    const FrameBuffer* back;
+    const DamageList* damage;
+    std::atomic<bool> done{false};
+  };
+
+  /** @brief area を上下に分けた上半分か下半分を返す． */
+  Rectangle<int> HalfOf(const Rectangle<int>& area, bool lower) {
+    const int upper_rows = area.size.y / 2;
+    if (lower) {
+      return {{area.pos.x, area.pos.y + upper_rows}, {area.size.x, area.size.y - upper_rows}};
+    }
+    return {area.pos, {area.size.x, upper_rows}};
+  }
+
+  void CopyHalves(FrameBuffer& screen, const FrameBuffer& back,
+                  const DamageList& damage, bool lower) {
+    for (const auto& area : damage) {
+      const auto half = HalfOf(area, lower);
+      screen.Copy(half.pos, back, half);
+    }
+  }
+
+  void PresentLowerHalves(void* arg) {
+    auto job = static_cast<PresentJob*>(arg);
+    CopyHalves(*job->screen, *job->back, *job->damage, true);
+    job->done.store(true, std::memory_order_release);
+  }
+}
+
+void ShadowFrameBuffer::Present() {
+  if (!has_back_) {
+    return;
+  }
+
+  int pixels = 0;
+  for (const auto& area : damage_) {
+    pixels += area.Area();
+  }
+
+  // 画面への書き込みはキャッシュされず帯域で律速するので，大きな更新は 2 つの CPU で分ける
+  PresentJob job{&screen_, &back_, &damage_};
+  if (pixels >= kParallelPresentPixels && NumCPUs() > 1 &&
+      !RunOnCPU(1, PresentLowerHalves, &job)) {
+    CopyHalves(screen_, back_, damage_, false);
+    while (!job.done.load(std::memory_order_acquire));
+  } else {
+    for (const auto& area : damage_) {
+      screen_.Copy(area.pos, back_, area);
+    }
+  }
+  damage_.Clear();
+}
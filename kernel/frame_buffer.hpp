@@ -0,0 +1,91 @@
+/**
+ * @file frame_buffer.hpp
+ *
+ * 描画先となるフレームバッファと，裏画面を用いた画面更新の機能．
+ */
+
+#pragma once
+
+#include "error.hpp"
+#include "frame_buffer_config.hpp"
+#include "graphics.hpp"
+
+/** @brief 画素領域とそれに描画するための PixelWriter の組． */
+class FrameBuffer {
+ public:
+  FrameBuffer() = default;
+  FrameBuffer(const FrameBuffer&) = delete;
+  FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+  /** @brief config が指す画素領域を描画先として初期化する． */
+  Error Initialize(const FrameBufferConfig& config);
+  /** @brief width x height 画素の領域を RAM 上に確保して描画先とする． */
+  Error Initialize(int width, int height, PixelFormat format);
+
+  PixelWriter& Writer() { return *writer_; }
+  const FrameBufferConfig& Config() const { return config_; }
+  Rectangle<int> Bounds() const {
+    return {{0, 0}, {static_cast<int>(config_.horizontal_resolution),
+                     static_cast<int>(config_.vertical_resolution)}};
+  }
+
+  /** @brief src の src_area に含まれる画素を this の dst_pos へ行単位で複写する．
+   *
+   * src と this の画素形式は同じでなければならない．
+   */
+  void Copy(Vector2D<int> dst_pos, const FrameBuffer& src,
+            const Rectangle<int>& src_area);
+  /** @brief Copy と同様だが，src の画素のうち transparent_pixel（Pack 済み）
+   * に等しいものは複写しない．
+   */
+  void CopyTransparent(Vector2D<int> dst_pos, const FrameBuffer& src,
+                       const Rectangle<int>& src_area,
+                       uint32_t transparent_pixel);
+
+  /** @brief (x, y) の画素を指すポインタを返す．範囲の検査はしない． */
+  uint32_t* RowAt(int x, int y) const {
+    return reinterpret_cast<uint32_t*>(
+        config_.frame_buffer + 4 * (config_.pixels_per_scan_line * y + x));
+  }
+
+ private:
+  /** @brief 複写元と複写先の領域を両方のフレームバッファ内に切り詰める． */
+  bool ClipCopy(Vector2D<int>& dst_pos, const FrameBuffer& src,
+                Rectangle<int>& src_area) const;
+
+  FrameBufferConfig config_{};
+  alignas(PixelWriter) char writer_buf_[sizeof(RGBResv8BitPerColorPixelWriter)];
+  PixelWriter* writer_{nullptr};
+};
+
+/** @brief キャッシュ可能な RAM 上の裏画面に描画し，変更箇所だけを画面へ反映する．
+ *
+ * GOP のフレームバッファはキャッシュされない（あるいはライトコンバイン）
+ * 領域であるため，読み出しや重ね描きが遅い．
+ * Writer() で得られる PixelWriter は裏画面に描画し，描画した領域を
+ * ダメージとして記録する．Present() はダメージのある行だけを画面へ複写する．
+ */
+class ShadowFrameBuffer {
+ public:
+  /** @brief screen_config が指す画面に対応する裏画面を準備する．
+   *
+   * 裏画面を確保できなければ画面へ直接描画する（Present() は何もしない）．
+   */
+  Error Initialize(const FrameBufferConfig& screen_config);
+
+  /** @brief 描画先のフレームバッファ（通常は裏画面）を返す． */
+  FrameBuffer& Target() { return has_back_ ? back_ : screen_; }
+  PixelWriter& Writer() { return Target().Writer(); }
+
+  /** @brief 記録されたダメージを画面へ反映し，ダメージを消去する．
+   *
+   * 大きな更新では CPU 1 に各矩形の下半分を RunOnCPU で頼み，終わるまで待つ．
+   * ブート CPU のタスクから呼び，割り込みハンドラからは呼ばない．
+   */
+  void Present();
+
+ private:
+  FrameBuffer screen_, back_;
+  DamageList damage_;
+  bool has_back_{false};
+};
@@ -6,37 +6,155 @@
 
 #include "graphics.hpp"
 
-void RGBResv8BitPerColorPixelWriter::Write(int x, int y, const PixelColor& c) {
-  auto p = PixelAt(x, y);
-  p[0] = c.r;
-  p[1] = c.g;
-  p[2] = c.b;
+#include <algorithm>
+#include <cstring>
+
+#include "profile.hpp"
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+  void FillPixels(uint32_t* dst, uint32_t pixel, int len) {
+#ifdef __ARM_NEON
+    const uint32x4_t v = vdupq_n_u32(pixel);
+    for (; len >= 4; len -= 4, dst += 4) {
+      vst1q_u32(dst, v);
+    }
+#endif
+    for (; len > 0; --len) {
+      *dst++ = pixel;
+    }
+  }
+}
+
+void DamageList::Add(const Rectangle<int>& rect) {
+  if (rect.Empty()) {
+    return;
+  }
+
+  auto merged = rect;
+  for (int i = 0; i < num_rects_; ++i) {
+    const auto u = Union(rects_[i], merged);
+    if (u.Area() <= rects_[i].Area() + merged.Area()) {
+      // 併合した矩形が別の矩形と重なり得るので，取り除いて最初から調べ直す
+      merged = u;
+      rects_[i] = rects_[--num_rects_];
+      i = -1;
+    }
+  }
+
+  if (num_rects_ < kMaxRects) {
+    rects_[num_rects_++] = merged;
+    return;
+  }
+
+  int best = 0;
+  int best_growth = -1;
+  for (int i = 0; i < num_rects_; ++i) {
+    const int growth = Union(rects_[i], merged).Area() - rects_[i].Area();
+    if (best_growth < 0 || growth < best_growth) {
+      best = i;
+      best_growth = growth;
+    }
+  }
+  rects_[best] = Union(rects_[best], merged);
+}
+
+bool PixelWriter::ClipSpan(int& x, int y, int& len, int& skip) const {
+  skip = 0;
+  if (y < 0 || Height() <= y) {
+    return false;
+  }
+  if (x < 0) {
+    skip = -x;
+    len += x;
+    x = 0;
+  }
+  if (x + len > Width()) {
+    len = Width() - x;
+  }
+  return len > 0;
+}
+
+void PixelWriter::FillSpan(int x, int y, int len, uint32_t pixel) {
+  int skip;
+  if (!ClipSpan(x, y, len, skip)) {
+    return;
+  }
+  FillPixels(RowAt(x, y), pixel, len);
+}
+
+void PixelWriter::WriteSpan(int x, int y, const uint32_t* pixels, int len) {
+  int skip;
+  if (!ClipSpan(x, y, len, skip)) {
+    return;
+  }
+  memcpy(RowAt(x, y), pixels + skip, 4 * len);
+}
+
+void PixelWriter::WriteSpanMasked(int x, int y, const uint32_t* pixels,
+                                  uint32_t mask, int len) {
+  int skip;
+  if (!ClipSpan(x, y, len, skip)) {
+    return;
+  }
+  auto dst = RowAt(x, y);
+  pixels += skip;
+  mask >>= skip;
+  for (int i = 0; i < len && mask; ++i, mask >>= 1) {
+    if (mask & 1u) {
+      dst[i] = pixels[i];
+    }
+  }
+}
+
+void PixelWriter::CopyRow(int dst_x, int dst_y, int src_x, int src_y, int len) {
+  int skip;
+  if (!ClipSpan(dst_x, dst_y, len, skip)) {
+    return;
+  }
+  src_x += skip;
+  if (!ClipSpan(src_x, src_y, len, skip)) {
+    return;
+  }
+  dst_x += skip;
+  memmove(RowAt(dst_x, dst_y), RowAt(src_x, src_y), 4 * len);
 }
 
-void BGRResv8BitPerColorPixelWriter::Write(int x, int y, const PixelColor& c) {
-  auto p = PixelAt(x, y);
-  p[0] = c.b;
-  p[1] = c.g;
-  p[2] = c.r;
+void PixelWriter::MoveRows(int dst_y, int src_y, int height) {
+  const int top = std::max(0, -std::min(dst_y, src_y));
+  const int bottom = std::min(height, Height() - std::max(dst_y, src_y));
+  if (top >= bottom) {
+    return;
+  }
+  dst_y += top;
+  src_y += top;
+  height = bottom - top;
+  memmove(RowAt(0, dst_y), RowAt(0, src_y),
+          4 * config_.pixels_per_scan_line * height);
+  MarkDirty({{0, dst_y}, {Width(), height}});
 }
 
 void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos,
                    const Vector2D<int>& size, const PixelColor& c) {
-  for (int dx = 0; dx < size.x; ++dx) {
-    writer.Write(pos.x + dx, pos.y, c);
-    writer.Write(pos.x + dx, pos.y + size.y - 1, c);
-  }
+  const uint32_t pixel = writer.Pack(c);
+  writer.FillSpan(pos.x, pos.y, size.x, pixel);
+  writer.FillSpan(pos.x, pos.y + size.y - 1, size.x, pixel);
   for (int dy = 1; dy < size.y - 1; ++dy) {
-    writer.Write(pos.x, pos.y + dy, c);
-    writer.Write(pos.x + size.x - 1, pos.y + dy, c);
+    writer.FillSpan(pos.x, pos.y + dy, 1, pixel);
+    writer.FillSpan(pos.x + size.x - 1, pos.y + dy, 1, pixel);
   }
+  writer.MarkDirty({pos, size});
 }
 
 void FillRectangle(PixelWriter& writer, const Vector2D<int>& pos,
                    const Vector2D<int>& size, const PixelColor& c) {
+  PMU_SCOPE("FillRectangle");
+  const uint32_t pixel = writer.Pack(c);
   for (int dy = 0; dy < size.y; ++dy) {
-    for (int dx = 0; dx < size.x; ++dx) {
-      writer.Write(pos.x + dx, pos.y + dy, c);
-    }
+    writer.FillSpan(pos.x, pos.y + dy, size.x, pixel);
   }
+  writer.MarkDirty({pos, size});
 }
@@ -1,11 +1,99 @@
 #pragma once
 
+#include <cstdint>
+
 #include "frame_buffer_config.hpp"
 
 struct PixelColor {
   uint8_t r, g, b;
 };
 
+// #@@range_begin(vector2d)
+template <typename T>
+struct Vector2D {
+  T x, y;
+
+  template <typename U>
+  Vector2D<T>& operator +=(const Vector2D<U>& rhs) {
+    x += rhs.x;
+    y += rhs.y;
+    return *this;
+  }
+};
+// #@@range_end(vector2d)
+
+template <typename T, typename U>
+auto operator +(const Vector2D<T>& lhs, const Vector2D<U>& rhs)
+    -> Vector2D<decltype(lhs.x + rhs.x)> {
+  return {lhs.x + rhs.x, lhs.y + rhs.y};
+}
+
+template <typename T, typename U>
+auto operator -(const Vector2D<T>& lhs, const Vector2D<U>& rhs)
+    -> Vector2D<decltype(lhs.x - rhs.x)> {
+  return {lhs.x - rhs.x, lhs.y - rhs.y};
+}
+
+template <typename T>
+struct Rectangle {
+  Vector2D<T> pos, size;
+
+  bool Empty() const { return size.x <= 0 || size.y <= 0; }
+  T Area() const { return Empty() ? 0 : size.x * size.y; }
+};
+
+/** @brief 2 つの矩形の共通部分を返す．共通部分が無ければ Empty() な矩形を返す． */
+template <typename T>
+Rectangle<T> operator &(const Rectangle<T>& lhs, const Rectangle<T>& rhs) {
+  const T left = lhs.pos.x > rhs.pos.x ? lhs.pos.x : rhs.pos.x;
+  const T top = lhs.pos.y > rhs.pos.y ? lhs.pos.y : rhs.pos.y;
+  const T l_right = lhs.pos.x + lhs.size.x, r_right = rhs.pos.x + rhs.size.x;
+  const T l_bottom = lhs.pos.y + lhs.size.y, r_bottom = rhs.pos.y + rhs.size.y;
+  const T right = l_right < r_right ? l_right : r_right;
+  const T bottom = l_bottom < r_bottom ? l_bottom : r_bottom;
+  return {{left, top}, {right - left, bottom - top}};
+}
+
+/** @brief 2 つの矩形を包含する最小の矩形を返す． */
+template <typename T>
+Rectangle<T> Union(const Rectangle<T>& lhs, const Rectangle<T>& rhs) {
+  if (lhs.Empty()) {
+    return rhs;
+  } else if (rhs.Empty()) {
+    return lhs;
+  }
+  const T left = lhs.pos.x < rhs.pos.x ? lhs.pos.x : rhs.pos.x;
+  const T top = lhs.pos.y < rhs.pos.y ? lhs.pos.y : rhs.pos.y;
+  const T l_right = lhs.pos.x + lhs.size.x, r_right = rhs.pos.x + rhs.size.x;
+  const T l_bottom = lhs.pos.y + lhs.size.y, r_bottom = rhs.pos.y + rhs.size.y;
+  const T right = l_right > r_right ? l_right : r_right;
+  const T bottom = l_bottom > r_bottom ? l_bottom : r_bottom;
+  return {{left, top}, {right - left, bottom - top}};
+}
+
+/** @brief 再描画が必要な領域（ダメージ）の一覧．
+ *
+ * 追加された矩形は，併合しても面積が増えない既存の矩形（重なる矩形や
+ * 同じ幅で上下に接する矩形）と併合して保持する．
+ * 保持できる矩形の数を超えた場合は，併合による面積の増加が最小となる
+ * 矩形と併合する．
+ */
+class DamageList {
+ public:
+  static const int kMaxRects = 16;
+
+  void Add(const Rectangle<int>& rect);
+  void Clear() { num_rects_ = 0; }
+  bool Empty() const { return num_rects_ == 0; }
+
+  const Rectangle<int>* begin() const { return rects_; }
+  const Rectangle<int>* end() const { return rects_ + num_rects_; }
+
+ private:
+  Rectangle<int> rects_[kMaxRects];
+  int num_rects_{0};
+};
+
 class PixelWriter {
  public:
   PixelWriter(const FrameBufferConfig& config) : config_{config} {
@@ -13,40 +101,114 @@ class PixelWriter {
   virtual ~PixelWriter() = default;
   virtual void Write(int x, int y, const PixelColor& c) = 0;
 
+  /** @brief 色 c をフレームバッファ上の 32 ビット画素値に変換する． */
+  virtual uint32_t Pack(const PixelColor& c) const = 0;
+
+  /** @brief (x, y) から右へ len 画素を色 c で塗りつぶす． */
+  void FillSpan(int x, int y, int len, const PixelColor& c) {
+    FillSpan(x, y, len, Pack(c));
+  }
+  /** @brief (x, y) から右へ len 画素を Pack 済みの画素値 pixel で塗りつぶす． */
+  void FillSpan(int x, int y, int len, uint32_t pixel);
+  /** @brief (x, y) から右へ Pack 済みの画素列 pixels を len 画素書き込む． */
+  void WriteSpan(int x, int y, const uint32_t* pixels, int len);
+  /** @brief (x, y) から右へ len 画素のうち mask のビット i が 1 の画素だけ
+   * pixels[i] を書き込む．len は 32 以下でなければならない．
+   */
+  void WriteSpanMasked(int x, int y, const uint32_t* pixels,
+                       uint32_t mask, int len);
+  /** @brief (src_x, src_y) から始まる len 画素を (dst_x, dst_y) へ複写する．
+   *
+   * 複写元と複写先は重なっていてもよい．
+   */
+  void CopyRow(int dst_x, int dst_y, int src_x, int src_y, int len);
+  /** @brief 行 src_y から height 行を行 dst_y へ画面の幅いっぱいに移す．
+   *
+   * 行は連続して並んでいるので 1 回の memmove で済む．
+   * 複写元と複写先は重なっていてもよい．移した先の領域をダメージとして記録する．
+   */
+  void MoveRows(int dst_y, int src_y, int height);
+
+  int Width() const { return config_.horizontal_resolution; }
+  int Height() const { return config_.vertical_resolution; }
+  PixelFormat Format() const { return config_.pixel_format; }
+
+  /** @brief 描画した領域を記録するダメージ一覧を設定する．nullptr なら記録しない． */
+  void SetDamageList(DamageList* damage) { damage_ = damage; }
+  /** @brief area を描き換えたことを記録する．
+   *
+   * 矩形単位の描画関数（FillRectangle, WriteAscii など）は自ら記録する．
+   * Write やスパン単位の関数を直接使う場合は呼び出し側で記録すること．
+   */
+  void MarkDirty(const Rectangle<int>& area) {
+    if (damage_) {
+      damage_->Add(area);
+    }
+  }
+
  protected:
   uint8_t* PixelAt(int x, int y) {
     return config_.frame_buffer + 4 * (config_.pixels_per_scan_line * y + x);
   }
 
+  uint32_t* RowAt(int x, int y) {
+    return reinterpret_cast<uint32_t*>(PixelAt(x, y));
+  }
+
  private:
+  /** @brief 行 y 上の [x, x + len) を画面内に切り詰める．
+   *
+   * 左端で切り捨てた画素数を skip に設定する．
+   * 描くべき画素が残らなければ false を返す．
+   */
+  bool ClipSpan(int& x, int y, int& len, int& skip) const;
+
   const FrameBufferConfig& config_;
+  DamageList* damage_{nullptr};
 };
 
-class RGBResv8BitPerColorPixelWriter : public PixelWriter {
- public:
-  using PixelWriter::PixelWriter;
-  virtual void Write(int x, int y, const PixelColor& c) override;
+/** @brief 画素形式ごとの画素値の作り方． */
+template <PixelFormat kFormat>
+struct PixelTraits;
+
+template <>
+struct PixelTraits<kPixelRGBResv8BitPerColor> {
+  static uint32_t Pack(const PixelColor& c) {
+    return c.r | (static_cast<uint32_t>(c.g) << 8)
+      | (static_cast<uint32_t>(c.b) << 16);
+  }
 };
 
-class BGRResv8BitPerColorPixelWriter : public PixelWriter {
- public:
-  using PixelWriter::PixelWriter;
-  virtual void Write(int x, int y, const PixelColor& c) override;
+template <>
+struct PixelTraits<kPixelBGRResv8BitPerColor> {
+  static uint32_t Pack(const PixelColor& c) {
+    return c.b | (static_cast<uint32_t>(c.g) << 8)
+      | (static_cast<uint32_t>(c.r) << 16);
+  }
 };
 
-// #@@range_begin(vector2d)
-template <typename T>
-struct Vector2D {
-  T x, y;
+/** @brief 画素形式 kFormat の PixelWriter．
+ *
+ * 画素形式の違いは画素値の作り方だけなので，描画関数は先頭で 1 度だけ
+ * 仮想関数 Pack を呼び，以降は Pack 済みの値をスパン単位の関数で書く．
+ * 画素ごとの Write は互換のために残している．
+ */
+template <PixelFormat kFormat>
+class BasicPixelWriter final : public PixelWriter {
+ public:
+  using Traits = PixelTraits<kFormat>;
+  using PixelWriter::PixelWriter;
 
-  template <typename U>
-  Vector2D<T>& operator +=(const Vector2D<U>& rhs) {
-    x += rhs.x;
-    y += rhs.y;
-    return *this;
+  void Write(int x, int y, const PixelColor& c) override {
+    *RowAt(x, y) = Traits::Pack(c);
+  }
+  uint32_t Pack(const PixelColor& c) const override {
+    return Traits::Pack(c);
   }
 };
-// #@@range_end(vector2d)
+
+using RGBResv8BitPerColorPixelWriter = BasicPixelWriter<kPixelRGBResv8BitPerColor>;
+using BGRResv8BitPerColorPixelWriter = BasicPixelWriter<kPixelBGRResv8BitPerColor>;
 
 void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos,
                    const Vector2D<int>& size, const PixelColor& c);
@@ -0,0 +1,482 @@
+/**
+ * @file heap.cpp
+ *
+ * malloc，posix_memalign，operator new の背後にあるカーネルヒープ．
+ */
+
+#include "heap.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include "halt.hpp"
+#include "logger.hpp"
+#include "memory_manager.hpp"
+
+namespace {
+  const uint32_t kBlockMagic = 0x6b686561;  // "khea"
+
+  enum class BlockKind : uint32_t {
+    kSmall,    // スラブのスロット
+    kLarge,    // フレームから直接切り出した領域
+    kAligned,  // 境界を揃えるために別の確保の内側にずらした位置
+    kFree,     // 解放済みのスラブのスロット
+  };
+
+  struct Slab;
+
+  /** @brief 返すポインタの直前に置くヘッダ．free はこれを見て戻し先を決める． */
+  struct alignas(16) BlockHeader {
+    uint32_t magic;
+    BlockKind kind;
+    union {
+      Slab* slab;         // kSmall, kFree
+      size_t num_frames;  // kLarge
+      size_t offset;      // kAligned: 元の確保の先頭からのずれ
+    };
+  };
+  static_assert(sizeof(BlockHeader) == 16);
+
+  const size_t kMinAlignment = alignof(BlockHeader);
+
+  struct SizeClass;
+
+  /** @brief 同じ大きさのスロットを並べた連続フレーム．先頭にこの管理情報を置く．
+   *
+   * 空きスロットを 1 つ以上持つスラブはサイズクラスの partial リストにつながる．
+   * 満杯のスラブはどのリストにもつながず，スロットのヘッダからたどる．
+   */
+  struct alignas(64) Slab {
+    SizeClass* size_class;
+    Slab* prev;
+    Slab* next;
+    void* free_list;  // 空きスロットのヘッダの直後に次の空きスロットへのポインタを置く
+    uint32_t num_used;
+    uint32_t capacity;
+  };
+
+  const size_t kSlabFrames = 4;
+  const size_t kSlabBytes = kSlabFrames * kBytesPerFrame;
+
+  struct SizeClass {
+    const size_t slot_size;  // ヘッダを含むスロットの大きさ
+    Slab* partial = nullptr;
+    Slab* cached = nullptr;  // 全部空いたスラブを 1 つだけ手元に残し，確保と解放の往復を避ける
+    size_t num_slabs = 0;
+    size_t num_used = 0;
+    uint64_t num_allocs = 0;
+
+    constexpr SizeClass(size_t slot) : slot_size{slot} {}
+  };
+
+  // 要求の大きさ + ヘッダ 16 バイトが収まる最小のクラスを使う
+  SizeClass size_classes[] = {
+    {32}, {64}, {128}, {256}, {512}, {1024}, {2048},
+  };
+  const size_t kMaxSmallSize = 2048 - sizeof(BlockHeader);
+
+  struct LargeStats {
+    size_t num_blocks = 0;
+    size_t num_frames = 0;
+    uint64_t num_allocs = 0;
+  } large_stats;
+
+  uint64_t num_failures = 0;
+  uint64_t num_invalid_frees = 0;
+
+  BlockHeader* HeaderOf(void* p) {
+    return reinterpret_cast<BlockHeader*>(p) - 1;
+  }
+
+  void* InitBlock(void* slot, BlockKind kind) {
+    auto header = reinterpret_cast<BlockHeader*>(slot);
+    header->magic = kBlockMagic;
+    header->kind = kind;
+    return header + 1;
+  }
+
+  void*& NextFree(void* slot) {
+    return *reinterpret_cast<void**>(reinterpret_cast<BlockHeader*>(slot) + 1);
+  }
+
+  void PushSlab(Slab*& list, Slab* slab) {
+    slab->prev = nullptr;
+    slab->next = list;
+    if (list) {
+      list->prev = slab;
+    }
+    list = slab;
+  }
+
+  void EraseSlab(Slab*& list, Slab* slab) {
+    if (slab->prev) {
+      slab->prev->next = slab->next;
+    } else {
+      list = slab->next;
+    }
+    if (slab->next) {
+      slab->next->prev = slab->prev;
+    }
+  }
+
+  Slab* NewSlab(SizeClass& size_class) {
+    auto [ frame, err ] = memory_manager->Allocate(kSlabFrames);
+    if (err) {
+      return nullptr;
+    }
+
+    auto slab = reinterpret_cast<Slab*>(frame.Frame());
+    auto base = reinterpret_cast<uint8_t*>(slab);
+    slab->size_class = &size_class;
+    slab->num_used = 0;
+    slab->capacity = (kSlabBytes - sizeof(Slab)) / size_class.slot_size;
+    slab->free_list = nullptr;
+    // 先頭のスロットから順に使われるよう，後ろから積む
+    for (size_t i = slab->capacity; i > 0; --i) {
+      void* slot = base + sizeof(Slab) + (i - 1) * size_class.slot_size;
+      NextFree(slot) = slab->free_list;
+      slab->free_list = slot;
+    }
+    ++size_class.num_slabs;
+    return slab;
+  }
+
+  void DeleteSlab(Slab* slab) {
+    --slab->size_class->num_slabs;
+    memory_manager->Free(FrameID{reinterpret_cast<uintptr_t>(slab) / kBytesPerFrame},
+                         kSlabFrames);
+  }
+
+  void* AllocSmall(SizeClass& size_class) {
+    Slab* slab = size_class.partial;
+    if (slab == nullptr) {
+      if (size_class.cached) {
+        slab = size_class.cached;
+        size_class.cached = nullptr;
+      } else if ((slab = NewSlab(size_class)) == nullptr) {
+        return nullptr;
+      }
+      PushSlab(size_class.partial, slab);
+    }
+
+    void* slot = slab->free_list;
+    slab->free_list = NextFree(slot);
+    if (++slab->num_used == slab->capacity) {
+      EraseSlab(size_class.partial, slab);
+    }
+    ++size_class.num_used;
+    ++size_class.num_allocs;
+
+    reinterpret_cast<BlockHeader*>(slot)->slab = slab;
+    return InitBlock(slot, BlockKind::kSmall);
+  }
+
+  void FreeSmall(BlockHeader* header) {
+    Slab* slab = header->slab;
+    SizeClass& size_class = *slab->size_class;
+    header->kind = BlockKind::kFree;
+
+    void* slot = header;
+    NextFree(slot) = slab->free_list;
+    slab->free_list = slot;
+    if (slab->num_used-- == slab->capacity) {
+      PushSlab(size_class.partial, slab);
+    }
+    --size_class.num_used;
+
+    if (slab->num_used == 0) {
+      EraseSlab(size_class.partial, slab);
+      if (size_class.cached == nullptr) {
+        size_class.cached = slab;
+      } else {
+        DeleteSlab(slab);
+      }
+    }
+  }
+
+  void* AllocLarge(size_t size) {
+    const size_t num_frames = (size + sizeof(BlockHeader) + kBytesPerFrame - 1) / kBytesPerFrame;
+    auto [ frame, err ] = memory_manager->Allocate(num_frames);
+    if (err) {
+      return nullptr;
+    }
+    large_stats.num_blocks += 1;
+    large_stats.num_frames += num_frames;
+    large_stats.num_allocs += 1;
+
+    auto header = reinterpret_cast<BlockHeader*>(frame.Frame());
+    header->num_frames = num_frames;
+    return InitBlock(header, BlockKind::kLarge);
+  }
+
+  void FreeLarge(BlockHeader* header) {
+    large_stats.num_blocks -= 1;
+    large_stats.num_frames -= header->num_frames;
+    header->magic = 0;
+    memory_manager->Free(FrameID{reinterpret_cast<uintptr_t>(header) / kBytesPerFrame},
+                         header->num_frames);
+  }
+
+  void* Allocate(size_t size) {
+    if (memory_manager == nullptr) {
+      return nullptr;
+    }
+
+    void* p = nullptr;
+    if (size <= kMaxSmallSize) {
+      for (auto& size_class : size_classes) {
+        if (size + sizeof(BlockHeader) <= size_class.slot_size) {
+          p = AllocSmall(size_class);
+          break;
+        }
+      }
+    } else if (size < BitmapMemoryManager::kMaxPhysicalMemoryBytes) {
+      p = AllocLarge(size);
+    }
+
+    if (p == nullptr) {
+      ++num_failures;
+    }
+    return p;
+  }
+
+  /** @brief alignment（2 のべき乗）の境界に揃えて確保する． */
+  void* AllocateAligned(size_t alignment, size_t size) {
+    if (alignment <= kMinAlignment) {
+      return Allocate(size);
+    }
+    if (size > SIZE_MAX - alignment) {
+      ++num_failures;
+      return nullptr;
+    }
+
+    // 元の確保の先頭は 16 バイト境界なので，揃えた位置の直前には必ずヘッダを置ける
+    auto raw = reinterpret_cast<uintptr_t>(Allocate(size + alignment));
+    if (raw == 0) {
+      return nullptr;
+    }
+    const uintptr_t aligned = (raw + sizeof(BlockHeader) + alignment - 1) & ~(alignment - 1);
+    auto header = reinterpret_cast<BlockHeader*>(aligned) - 1;
+    header->offset = aligned - raw;
+    return InitBlock(header, BlockKind::kAligned);
+  }
+
+  /** @brief p のヘッダが壊れていたり解放済みだったりすれば nullptr． */
+  BlockHeader* ValidHeader(void* p, const char* caller) {
+    auto header = HeaderOf(p);
+    if (header->magic != kBlockMagic || header->kind == BlockKind::kFree) {
+      ++num_invalid_frees;
+      Log(kError, "%s: invalid or already freed pointer %p\n", caller, p);
+      return nullptr;
+    }
+    return header;
+  }
+
+  void Free(void* p) {
+    if (p == nullptr) {
+      return;
+    }
+    auto header = ValidHeader(p, "free");
+    if (header == nullptr) {
+      return;
+    }
+
+    switch (header->kind) {
+    case BlockKind::kSmall:
+      FreeSmall(header);
+      break;
+    case BlockKind::kLarge:
+      FreeLarge(header);
+      break;
+    case BlockKind::kAligned:
+      header->magic = 0;
+      Free(reinterpret_cast<uint8_t*>(p) - header->offset);
+      break;
+    case BlockKind::kFree:
+      break;
+    }
+  }
+
+  /** @brief p から使ってよいバイト数． */
+  size_t UsableSize(void* p) {
+    auto header = HeaderOf(p);
+    switch (header->kind) {
+    case BlockKind::kSmall:
+      return header->slab->size_class->slot_size - sizeof(BlockHeader);
+    case BlockKind::kLarge:
+      return header->num_frames * kBytesPerFrame - sizeof(BlockHeader);
+    case BlockKind::kAligned:
+      return UsableSize(reinterpret_cast<uint8_t*>(p) - header->offset) - header->offset;
+    case BlockKind::kFree:
+      break;
+    }
+    return 0;
+  }
+
+  void* Reallocate(void* p, size_t size) {
+    if (p == nullptr) {
+      return Allocate(size);
+    }
+    if (ValidHeader(p, "realloc") == nullptr) {
+      return nullptr;
+    }
+
+    const size_t usable = UsableSize(p);
+    if (size <= usable) {
+      return p;
+    }
+    void* new_p = Allocate(size);
+    if (new_p) {
+      memcpy(new_p, p, usable);
+      Free(p);
+    }
+    return new_p;
+  }
+
+  void* AllocateOrHalt(size_t size, size_t alignment = kMinAlignment) {
+    if (void* p = AllocateAligned(alignment, size)) {
+      return p;
+    }
+    // 例外を使わないので std::bad_alloc を投げる代わりに止める
+    Log(kError, "operator new: failed to allocate %lu bytes\n", size);
+    while (1) halt();
+  }
+}
+
+void DumpHeapStats() {
+  printk("%-10s %8s %10s %10s %12s\n", "heap", "slabs", "in use", "capacity", "allocs");
+  for (const auto& size_class : size_classes) {
+    const size_t per_slab = (kSlabBytes - sizeof(Slab)) / size_class.slot_size;
+    printk("%-10lu %8lu %10lu %10lu %12lu\n",
+           size_class.slot_size - sizeof(BlockHeader),
+           size_class.num_slabs, size_class.num_used,
+           size_class.num_slabs * per_slab, size_class.num_allocs);
+  }
+  printk("large: %lu blocks, %lu KiB, %lu allocs\n",
+         large_stats.num_blocks, large_stats.num_frames * kBytesPerFrame / 1_KiB,
+         large_stats.num_allocs);
+  printk("failures %lu, invalid frees %lu, free frames %lu MiB\n",
+         num_failures, num_invalid_frees,
+         memory_manager ? memory_manager->CountFreeFrames() * kBytesPerFrame / 1_MiB : 0);
+}
+
+struct _reent;
+
+extern "C" void* malloc(size_t size) {
+  return Allocate(size);
+}
+
+extern "C" void free(void* p) {
+  Free(p);
+}
+
+extern "C" void* calloc(size_t num, size_t size) {
+  if (size != 0 && num > SIZE_MAX / size) {
+    ++num_failures;
+    return nullptr;
+  }
+  void* p = Allocate(num * size);
+  if (p) {
+    memset(p, 0, num * size);
+  }
+  return p;
+}
+
+extern "C" void* realloc(void* p, size_t size) {
+  return Reallocate(p, size);
+}
+
+extern "C" int posix_memalign(void** memptr, size_t alignment, size_t size) {
+  if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  void* p = AllocateAligned(alignment, size);
+  if (p == nullptr) {
+    return ENOMEM;
+  }
+  *memptr = p;
+  return 0;
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size) {
+  if ((alignment & (alignment - 1)) != 0) {
+    return nullptr;
+  }
+  return AllocateAligned(alignment, size);
+}
+
+// newlib の内部（printf の浮動小数点の変換など）は再入版を直接呼ぶので，
+// これらも用意して sbrk に頼る newlib の malloc がリンクされないようにする
+extern "C" void* _malloc_r(_reent*, size_t size) {
+  return Allocate(size);
+}
+
+extern "C" void _free_r(_reent*, void* p) {
+  Free(p);
+}
+
+extern "C" void* _calloc_r(_reent*, size_t num, size_t size) {
+  return calloc(num, size);
+}
+
+extern "C" void* _realloc_r(_reent*, void* p, size_t size) {
+  return Reallocate(p, size);
+}
+
+void* operator new(size_t size) {
+  return AllocateOrHalt(size);
+}
+
+void* operator new[](size_t size) {
+  return AllocateOrHalt(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  return AllocateOrHalt(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return AllocateOrHalt(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept {
+  Free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  Free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  Free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  Free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  Free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+  Free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  Free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  Free(p);
+}
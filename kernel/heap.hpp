@@ -0,0 +1,18 @@
+/**
+ * @file heap.hpp
+ *
+ * malloc，posix_memalign，operator new の背後にあるカーネルヒープ．
+ *
+ * 2032 バイトまでの要求は 2 のべき乗のサイズクラスごとのスラブから，
+ * それより大きい要求はメモリマネージャのフレームから直接切り出す．
+ * 返すポインタは 16 バイト境界に揃う．
+ * メモリマネージャと同じくロックを持たないので，ブート CPU のタスクからだけ使い，
+ * 割り込みハンドラからは呼ばないこと．
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/** @brief サイズクラスごとのスラブの使用状況と，大きな確保の状況を printk で表示する． */
+void DumpHeapStats();
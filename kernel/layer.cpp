@@ -0,0 +1,168 @@
+/**
+ * @file layer.cpp
+ *
+ * 重ね合わせ処理のプログラムを集めたファイル．
+ */
+
+#include "layer.hpp"
+
+#include "profile.hpp"
+
+void Layer::SetTransparentColor(const PixelColor& c) {
+  has_transparent_color_ = true;
+  transparent_pixel_ = surface_.Writer().Pack(c);
+}
+
+void Layer::DrawTo(FrameBuffer& dst, const Rectangle<int>& area) const {
+  const auto overlap = area & Area();
+  if (overlap.Empty()) {
+    return;
+  }
+
+  const Rectangle<int> src_area{overlap.pos - pos_, overlap.size};
+  if (has_transparent_color_) {
+    dst.CopyTransparent(overlap.pos, surface_, src_area, transparent_pixel_);
+  } else {
+    dst.Copy(overlap.pos, surface_, src_area);
+  }
+}
+
+void LayerManager::Initialize(ShadowFrameBuffer* screen) {
+  screen_ = screen;
+  num_stacked_ = 0;
+  damage_.Clear();
+}
+
+WithError<Layer*> LayerManager::NewLayer(int width, int height) {
+  for (auto& layer : layers_) {
+    if (layer.in_use_) {
+      continue;
+    }
+
+    const auto format = screen_->Target().Config().pixel_format;
+    if (auto err = layer.surface_.Initialize(width, height, format)) {
+      return {nullptr, err};
+    }
+    layer.damage_.Clear();
+    layer.surface_.Writer().SetDamageList(&layer.damage_);
+    layer.pos_ = {0, 0};
+    layer.visible_ = false;
+    layer.has_transparent_color_ = false;
+    layer.in_use_ = true;
+    return {&layer, MAKE_ERROR(Error::kSuccess)};
+  }
+  return {nullptr, MAKE_ERROR(Error::kFull)};
+}
+
+void LayerManager::Move(Layer* layer, Vector2D<int> pos) {
+  if (layer->visible_) {
+    damage_.Add(layer->Area());
+  }
+  layer->pos_ = pos;
+  if (layer->visible_) {
+    damage_.Add(layer->Area());
+  }
+}
+
+void LayerManager::MoveRelative(Layer* layer, Vector2D<int> diff) {
+  Move(layer, layer->pos_ + diff);
+}
+
+void LayerManager::UpDown(Layer* layer, int height) {
+  Hide(layer);
+  if (height < 0) {
+    return;
+  }
+  if (height > num_stacked_) {
+    height = num_stacked_;
+  }
+
+  for (int i = num_stacked_; i > height; --i) {
+    stack_[i] = stack_[i - 1];
+  }
+  stack_[height] = layer;
+  ++num_stacked_;
+  layer->visible_ = true;
+  damage_.Add(layer->Area());
+}
+
+void LayerManager::Hide(Layer* layer) {
+  if (!layer->visible_) {
+    return;
+  }
+
+  int i = 0;
+  while (stack_[i] != layer) {
+    ++i;
+  }
+  for (; i < num_stacked_ - 1; ++i) {
+    stack_[i] = stack_[i + 1];
+  }
+  --num_stacked_;
+  layer->visible_ = false;
+  damage_.Add(layer->Area());
+}
+
+void LayerManager::ShowSprite(Sprite* sprite, Vector2D<int> pos) {
+  auto& target = screen_->Target();
+  if (sprite_) {
+    sprite_->Hide(target);
+    target.Writer().MarkDirty(sprite_->Area() & target.Bounds());
+  }
+
+  sprite_ = sprite;
+  if (sprite_) {
+    sprite_->pos_ = pos;
+    sprite_->Show(target);
+    target.Writer().MarkDirty(sprite_->Area() & target.Bounds());
+  }
+}
+
+void LayerManager::MoveSpriteRelative(Vector2D<int> diff) {
+  if (sprite_ == nullptr) {
+    return;
+  }
+
+  auto& target = screen_->Target();
+  const auto old_area = sprite_->Area();
+  if (sprite_->MoveTo(target, old_area.pos + diff)) {
+    target.Writer().MarkDirty(old_area & target.Bounds());
+    target.Writer().MarkDirty(sprite_->Area() & target.Bounds());
+  }
+}
+
+void LayerManager::Compose() {
+  for (auto& layer : layers_) {
+    if (layer.visible_) {
+      for (const auto& area : layer.damage_) {
+        damage_.Add({area.pos + layer.pos_, area.size});
+      }
+    }
+    layer.damage_.Clear();
+  }
+
+  for (const auto& area : damage_) {
+    Recompose(area);
+  }
+  damage_.Clear();
+
+  screen_->Present();
+}
+
+void LayerManager::Recompose(const Rectangle<int>& area) {
+  PROFILE_SCOPE("LayerManager::Recompose");
+  PMU_SCOPE("LayerManager::Recompose");
+  auto& target = screen_->Target();
+  const auto clipped = area & target.Bounds();
+  if (clipped.Empty()) {
+    return;
+  }
+
+  for (int i = 0; i < num_stacked_; ++i) {
+    stack_[i]->DrawTo(target, clipped);
+  }
+  if (sprite_) {
+    sprite_->Refresh(target, clipped);
+  }
+  target.Writer().MarkDirty(clipped);
+}
@@ -0,0 +1,103 @@
+/**
+ * @file layer.hpp
+ *
+ * 重ね合わせ処理（レイヤ）を提供する．
+ */
+
+#pragma once
+
+#include <array>
+
+#include "error.hpp"
+#include "frame_buffer.hpp"
+#include "graphics.hpp"
+#include "sprite.hpp"
+
+/** @brief 画面に重ねて表示する 1 枚の描画面．
+ *
+ * Writer() で描画した領域はレイヤのダメージとして記録され，
+ * LayerManager::Compose() の際に画面へ反映される．
+ */
+class Layer {
+ public:
+  PixelWriter& Writer() { return surface_.Writer(); }
+  Vector2D<int> Position() const { return pos_; }
+  Vector2D<int> Size() const { return surface_.Bounds().size; }
+  /** @brief 画面座標で表したレイヤの領域 */
+  Rectangle<int> Area() const { return {pos_, Size()}; }
+  bool IsVisible() const { return visible_; }
+
+  /** @brief 色 c の画素を透過させる（下のレイヤが見える）ようにする． */
+  void SetTransparentColor(const PixelColor& c);
+
+ private:
+  friend class LayerManager;
+
+  /** @brief 画面座標の area のうち，このレイヤと重なる部分を dst へ描く． */
+  void DrawTo(FrameBuffer& dst, const Rectangle<int>& area) const;
+
+  FrameBuffer surface_;
+  DamageList damage_;
+  Vector2D<int> pos_{0, 0};
+  bool in_use_{false};
+  bool visible_{false};
+  bool has_transparent_color_{false};
+  uint32_t transparent_pixel_{0};
+};
+
+/** @brief レイヤの重なり順を管理し，変化した領域だけを画面へ合成する． */
+class LayerManager {
+ public:
+  static const int kMaxLayers = 8;
+
+  /** @brief 合成先の画面を設定する． */
+  void Initialize(ShadowFrameBuffer* screen);
+
+  /** @brief width x height 画素の描画面を持つ非表示のレイヤを作る． */
+  WithError<Layer*> NewLayer(int width, int height);
+
+  /** @brief レイヤを画面座標 pos へ移動する． */
+  void Move(Layer* layer, Vector2D<int> pos);
+  /** @brief レイヤを diff だけ移動する． */
+  void MoveRelative(Layer* layer, Vector2D<int> diff);
+  /** @brief レイヤを下から height 番目に表示する．
+   *
+   * height が負ならレイヤを非表示にする．
+   * height が表示中のレイヤ数以上なら最前面に表示する．
+   */
+  void UpDown(Layer* layer, int height);
+  /** @brief レイヤを非表示にする． */
+  void Hide(Layer* layer);
+
+  /** @brief 全レイヤのさらに上に sprite を pos の位置で表示する．
+   *
+   * 表示できるスプライトは 1 つだけで，nullptr を渡すと非表示にする．
+   */
+  void ShowSprite(Sprite* sprite, Vector2D<int> pos);
+  /** @brief 表示中のスプライトを diff だけ移動する．
+   *
+   * 下のレイヤは合成し直さず，スプライトが退避した画素を書き戻す．
+   */
+  void MoveSpriteRelative(Vector2D<int> diff);
+
+  /** @brief 画面と同じ形式の画素値に変換する． */
+  uint32_t Pack(const PixelColor& c) { return screen_->Writer().Pack(c); }
+
+  /** @brief 各レイヤのダメージと，移動や表示切替で露出した領域を
+   * 合成し直して画面へ反映する．
+   */
+  void Compose();
+
+ private:
+  /** @brief 画面座標の area を最背面のレイヤから順に描き直す． */
+  void Recompose(const Rectangle<int>& area);
+
+  ShadowFrameBuffer* screen_{nullptr};
+  std::array<Layer, kMaxLayers> layers_{};
+  /** @brief 表示中のレイヤ．先頭が最背面． */
+  std::array<Layer*, kMaxLayers> stack_{};
+  int num_stacked_{0};
+  Sprite* sprite_{nullptr};
+  /** @brief 合成し直す必要のある画面上の領域 */
+  DamageList damage_;
+};
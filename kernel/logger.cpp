@@ -1,34 +1,299 @@
 #include "logger.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
-#include <cstdio>
-#include <cstdarg>
+#include <cstdint>
+#include <cstring>
 
 #include "console.hpp"
+#include "layer.hpp"
+#include "profile.hpp"
+#include "uart.hpp"
+
+extern Console* console;
+extern LayerManager* layer_manager;
 
 namespace {
-  LogLevel log_level = kWarn;
-}
+  LogLevel log_levels[kNumLogSubsystems] = {
+    kWarn, kWarn, kWarn, kWarn, kWarn, kWarn,
+  };
+  static_assert(kNumLogSubsystems == 6, "initialize log_levels for every subsystem");
+  bool log_deferred = false;
+  unsigned int log_sinks = kLogSinkConsole | kLogSinkUART;
 
-extern Console* console;
+  /** @brief ログリングの 1 レコード．長いログは連続した複数のレコードに分けて格納する． */
+  struct LogRecord {
+    /** @brief Vyukov 方式のシーケンス番号からスロット番号を引いた値．
+     *
+     * グローバル変数のコンストラクタは呼ばれないため，
+     * ゼロ初期化された状態が「空き」を表すようにずらして持つ．
+     */
+    std::atomic<size_t> seq;
+    uint32_t len;
+    char text[244];
+  };
+
+  /** @brief 複数の書き込み側と 1 つの読み出し側を持つ固定長のロックフリーなリング．
+   *
+   * 書き込み側は割り込みハンドラでもよい．リングが一杯なら待たずにレコードを捨てる．
+   */
+  class LogRing {
+   public:
+    static const size_t kNumRecords = 128;  // 2 のべき乗
+
+    /** @brief 書き込み用に連続した num_records 個のレコードを確保し，先頭の位置を pos に設定する．
+     *
+     * 確保したレコードは Commit するまで読み出し側に見えない．
+     * 1 つのメッセージのレコードの間にほかの書き込み側のレコードが挟まらないよう，まとめて確保する．
+     * リングに空きが足りなければ捨てた件数を数えて false を返す．
+     */
+    bool Reserve(size_t& pos, size_t num_records) {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+      while (true) {
+        // 読み出し側は順に空けるので，最後のレコードが空いていればその前もすべて空いている
+        const size_t last = pos + num_records - 1;
+        LogRecord& rec = records_[last % kNumRecords];
+        const size_t seq = rec.seq.load(std::memory_order_acquire) + last % kNumRecords;
+        const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(last);
+        if (diff == 0) {
+          if (enqueue_pos_.compare_exchange_weak(pos, pos + num_records,
+                                                 std::memory_order_relaxed)) {
+            return true;
+          }
+        } else if (diff < 0) {
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        } else {
+          pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    LogRecord& RecordAt(size_t pos) {
+      return records_[pos % kNumRecords];
+    }
+
+    /** @brief Reserve したレコードを len バイトの長さで読み出し側に渡す． */
+    void Commit(size_t pos, size_t len) {
+      LogRecord& rec = records_[pos % kNumRecords];
+      rec.len = len;
+      rec.seq.store(pos + 1 - pos % kNumRecords, std::memory_order_release);
+    }
+
+    /** @brief 先頭のレコードを buf に NUL 終端して取り出す．空なら false． */
+    bool Pop(char (&buf)[sizeof(LogRecord::text) + 1]) {
+      const size_t pos = dequeue_pos_;
+      LogRecord& rec = records_[pos % kNumRecords];
+      if (rec.seq.load(std::memory_order_acquire) + pos % kNumRecords != pos + 1) {
+        return false;
+      }
+      memcpy(buf, rec.text, rec.len);
+      buf[rec.len] = '\0';
+      rec.seq.store(pos + kNumRecords - pos % kNumRecords, std::memory_order_release);
+      dequeue_pos_ = pos + 1;
+      return true;
+    }
+
+    /** @brief 読み出し側がまだ取り出していないレコードや捨てた件数があれば真． */
+    bool HasPending() const {
+      return enqueue_pos_.load(std::memory_order_relaxed) != dequeue_pos_ ||
+        dropped_.load(std::memory_order_relaxed) != 0;
+    }
+
+    size_t TakeDropped() {
+      return dropped_.exchange(0, std::memory_order_relaxed);
+    }
+
+   private:
+    LogRecord records_[kNumRecords];
+    std::atomic<size_t> enqueue_pos_;
+    size_t dequeue_pos_;
+    std::atomic<size_t> dropped_;
+  };
+
+  LogRing log_ring;
+  std::atomic_flag draining = ATOMIC_FLAG_INIT;
+
+  /** @brief 1 つのメッセージに使うレコードの上限．超えた分は捨てる． */
+  const size_t kMaxMessageRecords = 8;
+  static_assert(kMaxMessageRecords <= LogRing::kNumRecords, "a message must fit in the ring");
+
+  /** @brief 書式化した文字列を，まとめて確保した連続レコードへ直接書き込む．
+   *
+   * 確保したレコードは破棄するときにまとめて Commit する．
+   * 確保した分に入りきらなければ残りを捨て，Overflowed が真になる．
+   * リングが溢れて確保できなければ，メッセージ全体を捨てる．
+   */
+  class LogRingSink : public FormatSink {
+   public:
+    explicit LogRingSink(size_t num_records)
+        : num_records_{std::min(num_records, kMaxMessageRecords)} {
+      reserved_ = log_ring.Reserve(pos_, num_records_);
+    }
+
+    ~LogRingSink() {
+      if (!reserved_) {
+        return;
+      }
+      // 使わなかったレコードも長さ 0 で渡し，読み出し側が先へ進めるようにする
+      for (size_t i = 0; i < num_records_; ++i) {
+        const size_t begin = std::min(len_, i * kTextSize);
+        log_ring.Commit(pos_ + i, std::min(len_ - begin, kTextSize));
+      }
+    }
+
+    void Write(const char* s, size_t len) override {
+      while (len > 0 && reserved_) {
+        if (len_ == num_records_ * kTextSize) {
+          overflowed_ = true;
+          return;
+        }
+        auto& rec = log_ring.RecordAt(pos_ + len_ / kTextSize);
+        const size_t offset = len_ % kTextSize;
+        const size_t n = std::min(len, kTextSize - offset);
+        memcpy(&rec.text[offset], s, n);
+        len_ += n;
+        s += n;
+        len -= n;
+      }
+    }
+
+    /** @brief 確保したレコードに入りきらず，捨てた文字があれば真． */
+    bool Overflowed() const { return overflowed_; }
+
+    /** @brief 書いた内容を取り消す．確保したレコードは空のまま渡す． */
+    void Discard() { len_ = 0; }
+
+    /** @brief len バイトのメッセージを収めるのに要るレコードの数． */
+    static size_t NumRecordsFor(size_t len) {
+      return std::max<size_t>(1, (len + kTextSize - 1) / kTextSize);
+    }
+
+   private:
+    static constexpr size_t kTextSize = sizeof(LogRecord::text);
+
+    size_t num_records_, pos_ = 0, len_ = 0;
+    bool reserved_, overflowed_ = false;
+  };
+
+  /** @brief format(sink) が書き出すメッセージを，連続したレコードに収めてログリングへ追加する．
+   *
+   * たいていのメッセージは 1 レコードに収まるので，まず 1 レコードに書く．
+   * 収まらなければそのレコードを空にし，format が返した長さの分を確保して書き直す．
+   *
+   * @return format が返したメッセージの長さ．
+   */
+  template <class Formatter>
+  size_t PushLog(Formatter format) {
+    size_t len;
+    {
+      LogRingSink sink{1};
+      len = format(sink);
+      if (!sink.Overflowed()) {
+        return len;
+      }
+      sink.Discard();
+    }
+    LogRingSink sink{LogRingSink::NumRecordsFor(len)};
+    format(sink);
+    return len;
+  }
+
+  void PutLog(const char* s) {
+    // コンソールができる前に書き出されたログは UART にだけ出す
+    if ((log_sinks & kLogSinkConsole) && console) {
+      console->PutString(s);
+    }
+    if (log_sinks & kLogSinkUART) {
+      UARTWrite(s, strlen(s));
+    }
+  }
+}
 
 void SetLogLevel(LogLevel level) {
-  log_level = level;
+  for (auto& l : log_levels) {
+    l = level;
+  }
+}
+
+void SetLogLevel(LogSubsystem subsystem, LogLevel level) {
+  log_levels[subsystem] = level;
+}
+
+bool IsLogLevelEnabled(LogSubsystem subsystem, LogLevel level) {
+  return level <= log_levels[subsystem];
+}
+
+void SetLogSinks(unsigned int sinks) {
+  log_sinks = sinks;
+}
+
+void SetLogDeferred(bool deferred) {
+  log_deferred = deferred;
+}
+
+void WriteLog(const char* s, size_t len) {
+  PushLog([s, len](FormatSink& sink) {
+    sink.Write(s, len);
+    return len;
+  });
+
+  if (!log_deferred) {
+    DrainLog();
+  }
 }
 
-int Log(LogLevel level, const char* format, ...) {
-  if (level > log_level) {
+bool LogPending() {
+  return log_ring.HasPending();
+}
+
+size_t DrainLog(size_t max_records) {
+  // 描画中に割り込みなどから呼ばれても二重に描かない
+  if (draining.test_and_set(std::memory_order_acquire)) {
     return 0;
   }
+  PROFILE_SCOPE("DrainLog");
 
-  va_list ap;
-  int result;
-  char s[1024];
+  UARTPoll();
 
-  va_start(ap, format);
-  result = vsprintf(s, format, ap);
-  va_end(ap);
+  size_t num_records = 0;
+  char buf[sizeof(LogRecord::text) + 1];
+  while (num_records < max_records && log_ring.Pop(buf)) {
+    PutLog(buf);
+    ++num_records;
+  }
+  const size_t dropped = log_ring.TakeDropped();
+  if (dropped > 0) {
+    BufferSink sink{buf, sizeof(buf)};
+    Format(sink, "[log] %u messages dropped\n", dropped);
+    PutLog(buf);
+  }
+
+  if ((num_records > 0 || dropped > 0) && (log_sinks & kLogSinkConsole) &&
+      console && layer_manager) {
+    console->Flush();
+    layer_manager->Compose();
+  }
+  draining.clear(std::memory_order_release);
+  return num_records;
+}
 
-  console->PutString(s);
+int LogArgs(LogSubsystem subsystem, LogLevel level, const char* format,
+            const FormatArg* args, size_t num_args) {
+  if (!IsLogLevelEnabled(subsystem, level)) {
+    return 0;
+  }
+  return PrintArgs(format, args, num_args);
+}
+
+int PrintArgs(const char* format, const FormatArg* args, size_t num_args) {
+  const size_t result = PushLog([=](FormatSink& sink) {
+    return FormatArgs(sink, format, args, num_args);
+  });
+
+  if (!log_deferred) {
+    DrainLog();
+  }
   return result;
 }
@@ -6,6 +6,11 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
+#include "format.hpp"
+
 enum LogLevel {
   kError = 3,
   kWarn  = 4,
@@ -13,19 +18,133 @@ enum LogLevel {
   kDebug = 7,
 };
 
+/** @brief コンパイル時に残すログ優先度の下限．
+ *
+ * これより優先度の低い Log や LogFor の呼び出しは，引数の評価も含めてコンパイル時に消える．
+ * ビルド時に -DMIKANOS_MIN_LOG_LEVEL=kInfo などとして変更できる．
+ */
+#ifndef MIKANOS_MIN_LOG_LEVEL
+#define MIKANOS_MIN_LOG_LEVEL kDebug
+#endif
+constexpr LogLevel kMinLogLevel = MIKANOS_MIN_LOG_LEVEL;
+
+/** @brief ログ優先度のしきい値を個別に設定できるサブシステム． */
+enum LogSubsystem {
+  kLogGeneral,
+  kLogPCI,
+  kLogXHCI,
+  kLogUSB,
+  kLogHID,
+  kLogGraphics,
+  kNumLogSubsystems,
+};
+
+/** @brief ログの出力先．ビットごとの論理和で複数を指定できる． */
+enum LogSink {
+  kLogSinkConsole = 1u << 0,
+  kLogSinkUART    = 1u << 1,
+};
+
 /** @brief グローバルなログ優先度のしきい値を変更する．
  *
- * グローバルなログ優先度のしきい値を level に設定する．
+ * すべてのサブシステムのログ優先度のしきい値を level に設定する．
  * 以降の Log の呼び出しでは，ここで設定した優先度以上のログのみ記録される．
  */
 void SetLogLevel(LogLevel level);
 
+/** @brief サブシステム subsystem のログ優先度のしきい値を level に設定する． */
+void SetLogLevel(LogSubsystem subsystem, LogLevel level);
+
+/** @brief subsystem の実行時のしきい値が level 以上の優先度を記録するなら true． */
+bool IsLogLevelEnabled(LogSubsystem subsystem, LogLevel level);
+
+/** @brief subsystem の優先度 level のログが記録されるなら true．
+ *
+ * level が定数なら，コンパイル時の下限による判定は畳み込まれる．
+ */
+inline bool LogEnabled(LogSubsystem subsystem, LogLevel level) {
+  return level <= kMinLogLevel && IsLogLevelEnabled(subsystem, level);
+}
+
+/** @brief LogMessage の本体．引数は型の情報付きで受け取る． */
+int LogArgs(LogSubsystem subsystem, LogLevel level, const char* format,
+            const FormatArg* args, size_t num_args);
+
+/** @brief subsystem のしきい値以上の優先度ならログを記録する．通常は Log か LogFor を使う．
+ *
+ * Log と LogFor は同じ判定を引数の評価より前に行い，捨てるログの引数を評価しない．
+ * 書式化した文字列はログリングのレコードへ直接書き込まれ，
+ * DrainLog で出力先に書き出される．
+ *
+ * @param subsystem  ログを出したサブシステム．
+ * @param level  ログの優先度．
+ * @param format  書式文字列．Format と同じ変換指定が使える．
+ */
+template <typename... Args>
+int LogMessage(LogSubsystem subsystem, LogLevel level, const char* format,
+               Args... args) {
+  const FormatArg fargs[] = {FormatArg(args)..., FormatArg()};
+  return LogArgs(subsystem, level, format, fargs, sizeof...(Args));
+}
+
+/** @brief printk の本体．引数は型の情報付きで受け取る． */
+int PrintArgs(const char* format, const FormatArg* args, size_t num_args);
+
+/** @brief 優先度によらず書式化した文字列をログリングに記録する． */
+template <typename... Args>
+int printk(const char* format, Args... args) {
+  const FormatArg fargs[] = {FormatArg(args)..., FormatArg()};
+  return PrintArgs(format, fargs, sizeof...(Args));
+}
+
+/** @brief サブシステム subsystem のログを指定された優先度で記録する．
+ *
+ * 指定された優先度がコンパイル時の下限と subsystem のしきい値の両方以上ならば記録する．
+ * そうでなければ引数を評価せずにログを捨てる．
+ */
+#define LogFor(subsystem, level, ...) \
+  (LogEnabled((subsystem), (level)) ? \
+   LogMessage((subsystem), (level), __VA_ARGS__) : 0)
+
 /** @brief ログを指定された優先度で記録する．
  *
  * 指定された優先度がしきい値以上ならば記録する．
  * 優先度がしきい値未満ならログは捨てられる．
  *
  * @param level  ログの優先度．しきい値以上の優先度のログのみが記録される．
- * @param format  書式文字列．printk と互換．
+ * @param format  書式文字列．Format と同じ変換指定が使える．
+ */
+#define Log(level, ...) LogFor(kLogGeneral, (level), __VA_ARGS__)
+
+/** @brief 書式化済みの文字列 s の先頭 len バイトをログリングに追加する．
+ *
+ * 優先度によらず記録する．
+ */
+void WriteLog(const char* s, size_t len);
+
+/** @brief ログの出力先を sinks（LogSink の論理和）に設定する．
+ *
+ * 既定ではコンソールと UART の両方に出力する．
+ */
+void SetLogSinks(unsigned int sinks);
+
+/** @brief ログの描画を遅延させるかどうかを設定する．
+ *
+ * false（既定）なら Log や WriteLog の呼び出しのたびにログリングを描画する．
+ * true ならログリングへの追加だけを行い，描画は DrainLog の呼び出しまで遅らせる．
+ */
+void SetLogDeferred(bool deferred);
+
+/** @brief ログリングに描いていないログがあれば真．DrainLog を呼ぶ必要があるかの目安にする． */
+bool LogPending();
+
+/** @brief ログリングに溜まったログを高々 max_records 件，出力先に書き出す．
+ *
+ * コンソールへ描いた場合は画面にも反映する．
+ * 件数を絞ると，描画の合間にほかのタスクへ切り替えられる．
+ * リングが溢れて捨てたログがあれば，その件数も出力する．
+ * 送りきれずに UART の送信バッファに残っている分も，FIFO が受け付けるだけ送る．
+ *
+ * @return 描いたレコードの数．
  */
-int Log(LogLevel level, const char* format, ...);
+size_t DrainLog(size_t max_records = SIZE_MAX);
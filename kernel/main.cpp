@@ -4,24 +4,44 @@
  * カーネル本体のプログラムを書いたファイル．
  */
 
+#include <algorithm>
 #include <cstdint>
 #include <cstddef>
-#include <cstdio>
-#include <cstdarg>
+#include <cstring>
 
 #include <numeric>
 #include <vector>
 
 #include "frame_buffer_config.hpp"
+#include "memory_map.hpp"
+#include "frame_buffer.hpp"
 #include "graphics.hpp"
+#include "drawing_bench.hpp"
+#include "layer.hpp"
 #include "mouse.hpp"
 #include "font.hpp"
 #include "console.hpp"
 #include "pci.hpp"
 #include "logger.hpp"
+#include "uart.hpp"
+#include "clock.hpp"
+#include "profile.hpp"
+#include "timeline.hpp"
+#include "interrupt.hpp"
+#include "message.hpp"
+#include "timer.hpp"
+#include "timer_device.hpp"
+#include "task.hpp"
+#include "memory_manager.hpp"
+#include "heap.hpp"
+#include "paging.hpp"
+#include "acpi.hpp"
+#include "smp.hpp"
 #include "usb/memory.hpp"
+#include "usb/object_cache.hpp"
 #include "usb/device.hpp"
 #include "usb/classdriver/mouse.hpp"
+#include "usb/classdriver/keyboard.hpp"
 #include "usb/xhci/xhci.hpp"
 #include "usb/xhci/trb.hpp"
 
@@ -31,25 +51,15 @@
 const PixelColor kDesktopBGColor{45, 118, 237};
 const PixelColor kDesktopFGColor{255, 255, 255};
 
-char pixel_writer_buf[sizeof(RGBResv8BitPerColorPixelWriter)];
-PixelWriter* pixel_writer;
+alignas(ShadowFrameBuffer) char screen_buf[sizeof(ShadowFrameBuffer)];
+ShadowFrameBuffer* screen;
+
+alignas(LayerManager) char layer_manager_buf[sizeof(LayerManager)];
+LayerManager* layer_manager;
 
 char console_buf[sizeof(Console)];
 Console* console;
 
-int printk(const char* format, ...) {
-  va_list ap;
-  int result;
-  char s[1024];
-
-  va_start(ap, format);
-  result = vsprintf(s, format, ap);
-  va_end(ap);
-
-  console->PutString(s);
-  return result;
-}
-
 // #@@range_begin(mouse_observer)
 char mouse_cursor_buf[sizeof(MouseCursor)];
 MouseCursor* mouse_cursor;
@@ -59,6 +69,152 @@ void MouseObserver(int8_t displacement_x, int8_t displacement_y) {
 }
 // #@@range_end(mouse_observer)
 
+void KeyboardObserver(uint8_t keycode) {
+  const uint8_t kF12 = 0x45;  // HID の Usage ID
+  if (keycode == kF12) {
+    DumpProbes();
+    DumpPMUProbes();
+    DumpHeapStats();
+    usb::DumpMemStats();
+    usb::DumpObjectCaches();
+  }
+}
+
+/** @brief 割り込みハンドラからメインループへのメッセージ． */
+MessageQueue main_queue;
+
+/** @brief xHC のイベントリングに溜まったイベントを main_queue へ移す．
+ *
+ * 割り込みハンドラか，割り込みを禁止したメインループから呼ぶ．
+ * main_queue が満杯になったら残りはイベントリングに残しておく．
+ */
+void QueueXHCEvents(usb::xhci::Controller& xhc) {
+  auto er = xhc.PrimaryEventRing();
+  while (er->HasFront()) {
+    Message msg{Message::kXHCIEvent};
+    msg.arg.xhci_event = er->Front()->data;
+    if (!main_queue.Push(msg)) {
+      break;
+    }
+    er->Pop();
+  }
+}
+
+void XHCInterruptHandler(uint32_t intid, void* arg) {
+  auto xhc = static_cast<usb::xhci::Controller*>(arg);
+  xhc->AcknowledgeInterrupt();
+  QueueXHCEvents(*xhc);
+}
+
+/** @brief タイマの刻みをメインループへ知らせる．
+ *
+ * ProcessTimers はカウンタから現在の刻みを求めるので，キューが満杯で捨てても遅れるだけで済む．
+ */
+void TimerInterruptHandler(uint32_t intid, void* arg) {
+  AcknowledgeTimerDevice();
+  main_queue.Push(Message{Message::kTimerTick});
+}
+
+/** @brief xHC と時刻を割り込みで扱えているなら真．偽ならイベントリングをポーリングする． */
+bool interrupt_driven = false;
+
+/** @brief xHC のイベントとタイマを処理するタスク（KernelMain）．最高レベルで動く． */
+Task* input_task;
+/** @brief ログと画面の描画を担うタスク． */
+Task* display_task;
+
+/** @brief 描画タスクを起こす間隔（ミリ秒）．この間に来た入力やログの描画をまとめる． */
+const unsigned long kDisplayIntervalMs = 10;
+
+void WakeupDisplay(Timer& timer, void* arg) {
+  task_manager->Wakeup(display_task);
+}
+
+/** @brief 描画タスクを起こすタイマ．描くものがあるときだけ登録する． */
+Timer display_timer{WakeupDisplay, nullptr};
+
+/** @brief 描くものがあれば，次の描画の時機に描画タスクが起きるようにする．
+ *
+ * タイマ割り込みを使えなければその場で起こす．
+ */
+void RequestDisplay() {
+  if (TimerInterruptAvailable() && !display_timer.Pending()) {
+    SetTimer(display_timer, kDisplayIntervalMs);
+  }
+  if (!TimerInterruptAvailable()) {
+    task_manager->Wakeup(display_task);
+  }
+}
+
+/** @brief 入力タスクが処理すべきものがあれば真．ポーリング中は常に真． */
+bool InputPending() {
+  return !interrupt_driven || !main_queue.Empty();
+}
+
+/** @brief 割り込みハンドラがメッセージを積んでいれば入力タスクを起こし，ほかのタスクへ譲る．
+ *
+ * 割り込みハンドラはタスクを操作できないので，ほかのタスクが切り替えの前に代わりに起こす．
+ */
+void YieldToInput() {
+  if (InputPending()) {
+    task_manager->Wakeup(input_task);
+  }
+  task_manager->SwitchTask();
+}
+
+/** @brief 溜まったログを描き，画面を合成する．
+ *
+ * 長い描画の間も入力の処理を待たせないよう，少しずつ描いては入力タスクに譲る．
+ */
+void DisplayTask(uint64_t task_id, int64_t data) {
+  const size_t kLogBatch = 8;
+  while (1) {
+    while (DrainLog(kLogBatch) == kLogBatch) {
+      YieldToInput();
+    }
+    layer_manager->Compose();
+    task_manager->Sleep(display_task);
+  }
+}
+
+/** @brief ほかに実行できるタスクが無いときに動き，割り込みが来るまで CPU を止める． */
+void IdleTask(uint64_t task_id, int64_t data) {
+  while (1) {
+    // 確認から WFI までの間に来た割り込みを取りこぼさないよう IRQ を止めて調べる
+    DisableInterrupts();
+    if (!InputPending() && !HasPendingCPUCalls()) {
+      WaitForInterrupt();
+    }
+    EnableInterrupts();
+    RunPendingCPUCalls();
+    YieldToInput();
+  }
+}
+
+/** @brief 起動時に接続済みのポートを 1 つずつリセットし，デバイスの設定を始める． */
+void PortScanTask(uint64_t task_id, int64_t data) {
+  auto& xhc = *reinterpret_cast<usb::xhci::Controller*>(data);
+  for (int i = 1; i <= xhc.MaxPorts(); ++i) {
+    auto port = xhc.PortAt(i);
+    Log(kDebug, "Port %d: IsConnected=%d\n", i, port.IsConnected());
+
+    if (port.IsConnected()) {
+      if (auto err = ConfigurePort(xhc, port)) {
+        Log(kError, "failed to configure port: %s at %s:%d\n",
+            err.Name(), err.File(), err.Line());
+      }
+    }
+    YieldToInput();
+  }
+  MarkBootPhase("kernel: port scan");
+
+#ifdef MIKANOS_DUMP_PROBES
+  // ポートの走査を終えた時点までの計測を表示する
+  DumpProbes();
+  DumpPMUProbes();
+#endif
+}
+
 // #@@range_begin(switch_echi2xhci)
 void SwitchEhci2Xhci(const pci::Device& xhc_dev) {
   bool intel_ehc_exist = false;
@@ -77,65 +233,129 @@ void SwitchEhci2Xhci(const pci::Device& xhc_dev) {
   pci::WriteConfReg(xhc_dev, 0xd8, superspeed_ports); // USB3_PSSEN
   uint32_t ehci2xhci_ports = pci::ReadConfReg(xhc_dev, 0xd4); // XUSB2PRM
   pci::WriteConfReg(xhc_dev, 0xd0, ehci2xhci_ports); // XUSB2PR
-  Log(kDebug, "SwitchEhci2Xhci: SS = %02, xHCI = %02x\n",
-      superspeed_ports, ehci2xhci_ports);
+  LogFor(kLogPCI, kDebug, "SwitchEhci2Xhci: SS = %02x, xHCI = %02x\n",
+         superspeed_ports, ehci2xhci_ports);
 }
 // #@@range_end(switch_echi2xhci)
 
-extern "C" void KernelMain(const FrameBufferConfig& frame_buffer_config) {
-  switch (frame_buffer_config.pixel_format) {
-    case kPixelRGBResv8BitPerColor:
-      pixel_writer = new(pixel_writer_buf)
-        RGBResv8BitPerColorPixelWriter{frame_buffer_config};
-      break;
-    case kPixelBGRResv8BitPerColor:
-      pixel_writer = new(pixel_writer_buf)
-        BGRResv8BitPerColorPixelWriter{frame_buffer_config};
-      break;
+alignas(16) uint8_t kernel_main_stack[1024 * 1024];
+
+/** @brief メモリマップの記述子の写し．元のバッファはブートサービスの領域にあり，回収される． */
+alignas(16) char memory_map_buf[4096 * 4];
+
+/** @brief KernelMain（arch の asm）がカーネルのスタックへ切り替えてから呼ぶ．
+ *
+ * 引数はローダのスタックにあり，メモリマネージャに回収されるので最初に写しておく．
+ */
+extern "C" void KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
+                                   const BootTimeline* boot_timeline,
+                                   const MemoryMap& memory_map_ref,
+                                   const acpi::RSDP* acpi_table) {
+  FrameBufferConfig frame_buffer_config{frame_buffer_config_ref};
+  MemoryMap memory_map{memory_map_ref};
+  memory_map.map_size = std::min<unsigned long long>(memory_map.map_size, sizeof(memory_map_buf));
+  memcpy(memory_map_buf, memory_map.buffer, memory_map.map_size);
+  memory_map.buffer = memory_map_buf;
+  memory_map.buffer_size = sizeof(memory_map_buf);
+  InitializeBootTimeline(boot_timeline);
+  MarkBootPhase("kernel: entry");
+
+  // コンソールができるまでのログはリングに溜めておき，コンソールを作ってから書き出す．
+  // UART のレジスタはカーネルのページテーブルで写すので，UART はページングより後に初期化する
+  SetLogDeferred(true);
+  InitializeMemoryManager(memory_map);
+  if (auto err = InitializePaging(memory_map, frame_buffer_config)) {
+    Log(kError, "InitializePaging: %s\n", err.Name());
   }
+  if (auto err = InitializeUART()) {
+    Log(kError, "InitializeUART: %s\n", err.Name());
+  }
+  if (auto err = acpi::Initialize(acpi_table)) {
+    Log(kWarn, "acpi::Initialize: %s\n", err.Name());
+  }
+  InitializeClock();
+  InitializeTimer();
+  InitializeTask();
+  InitializeSMP();
+  InitializePMU();
+
+  screen = new(screen_buf) ShadowFrameBuffer;
+  auto screen_err = screen->Initialize(frame_buffer_config);
+
+  layer_manager = new(layer_manager_buf) LayerManager;
+  layer_manager->Initialize(screen);
 
   const int kFrameWidth = frame_buffer_config.horizontal_resolution;
   const int kFrameHeight = frame_buffer_config.vertical_resolution;
 
-  FillRectangle(*pixel_writer,
+  auto [ bglayer, bglayer_err ] = layer_manager->NewLayer(kFrameWidth, kFrameHeight);
+  // コンソールはタスクバーを除く画面全体を文字単位で覆う
+  auto [ console_layer, console_layer_err ] = layer_manager->NewLayer(
+      kFrameWidth / 8 * 8, (kFrameHeight - 50) / 16 * 16);
+  if (bglayer_err || console_layer_err) {
+    while (1) halt();
+  }
+
+  auto& bg_writer = bglayer->Writer();
+  FillRectangle(bg_writer,
                 {0, 0},
                 {kFrameWidth, kFrameHeight - 50},
                 kDesktopBGColor);
-  FillRectangle(*pixel_writer,
+  FillRectangle(bg_writer,
                 {0, kFrameHeight - 50},
                 {kFrameWidth, 50},
                 {1, 8, 17});
-  FillRectangle(*pixel_writer,
+  FillRectangle(bg_writer,
                 {0, kFrameHeight - 50},
                 {kFrameWidth / 5, 50},
                 {80, 80, 80});
-  DrawRectangle(*pixel_writer,
+  DrawRectangle(bg_writer,
                 {10, kFrameHeight - 40},
                 {30, 30},
                 {160, 160, 160});
 
+  auto& console_writer = console_layer->Writer();
+  FillRectangle(console_writer, {0, 0},
+                {console_writer.Width(), console_writer.Height()}, kDesktopBGColor);
   console = new(console_buf) Console{
-    *pixel_writer, kDesktopFGColor, kDesktopBGColor
+    console_writer, kDesktopFGColor, kDesktopBGColor
   };
+
+  layer_manager->UpDown(bglayer, 0);
+  layer_manager->UpDown(console_layer, 1);
+  SetLogDeferred(false);
+  DrainLog();
+
+  MarkBootPhase("kernel: console ready");
   printk("Welcome to MikanOS-AARCH64!\n");
   SetLogLevel(kDebug);
+  if (screen_err) {
+    LogFor(kLogGraphics, kWarn, "shadow frame buffer is disabled: %s\n", screen_err.Name());
+  }
 
   // #@@range_begin(new_mouse_cursor)
   mouse_cursor = new(mouse_cursor_buf) MouseCursor{
-    pixel_writer, kDesktopBGColor, {300, 200}
+    layer_manager, {300, 200}
   };
+  layer_manager->Compose();
   // #@@range_end(new_mouse_cursor)
 
-  auto err = pci::ScanAllBus();
-  Log(kDebug, "ScanAllBus: %s\n", err.Name());
+  Error err = MAKE_ERROR(Error::kSuccess);
+  {
+    PROFILE_SCOPE("pci::ScanAllBus");
+    err = pci::ScanAllBus();
+  }
+  MarkBootPhase("kernel: pci scan");
+  LogFor(kLogPCI, kDebug, "ScanAllBus: %s\n", err.Name());
 
   for (int i = 0; i < pci::num_device; ++i) {
     const auto& dev = pci::devices[i];
     auto vendor_id = pci::ReadVendorId(dev);
     auto class_code = pci::ReadClassCode(dev.bus, dev.device, dev.function);
-    Log(kDebug, "%d.%d.%d: vend %04x, class %08x, head %02x\n",
-        dev.bus, dev.device, dev.function,
-        vendor_id, class_code, dev.header_type);
+    LogFor(kLogPCI, kDebug, "%d.%d.%d: vend %04x, class %02x%02x%02x, head %02x\n",
+           dev.bus, dev.device, dev.function, vendor_id,
+           class_code.base, class_code.sub, class_code.interface,
+           dev.header_type);
   }
 
   // #@@range_begin(find_xhc)
@@ -152,24 +372,28 @@ extern "C" void KernelMain(const FrameBufferConfig& frame_buffer_config) {
   }
 
   if (xhc_dev) {
-    Log(kInfo, "xHC has been found: %d.%d.%d\n",
-        xhc_dev->bus, xhc_dev->device, xhc_dev->function);
+    LogFor(kLogPCI, kInfo, "xHC has been found: %d.%d.%d\n",
+           xhc_dev->bus, xhc_dev->device, xhc_dev->function);
   }
   // #@@range_end(find_xhc)
 
   // #@@range_begin(read_bar)
   const WithError<uint64_t> xhc_bar = pci::ReadBar(*xhc_dev, 0);
-  Log(kDebug, "ReadBar: %s\n", xhc_bar.error.Name());
+  LogFor(kLogPCI, kDebug, "ReadBar: %s\n", xhc_bar.error.Name());
   uint64_t xhc_mmio_base = xhc_bar.value & ~static_cast<uint64_t>(0xf);
-  Log(kDebug, "xHC mmio_base = %08lx\n", xhc_mmio_base);
-  Log(kInfo, "vid:%x\n", pci::ReadVendorId(*xhc_dev));
+  LogFor(kLogPCI, kDebug, "xHC mmio_base = %08lx\n", xhc_mmio_base);
+  // xHCI のレジスタ（ケーパビリティ，オペレーショナル，ランタイム，ドアベル）は BAR 0 の先頭 64 KiB に収まる
+  if (auto err = MapMMIO(xhc_mmio_base, 64 * 1024)) {
+    Log(kError, "MapMMIO(xHC): %s\n", err.Name());
+  }
+  LogFor(kLogPCI, kInfo, "vid:%x\n", pci::ReadVendorId(*xhc_dev));
   // #@@range_end(read_bar)
 
   uint32_t command_reg = pci::ReadConfReg(*xhc_dev, 4);
-  Log(kInfo, "command (read):%x\n", command_reg);
-  pci::WriteConfReg(*xhc_dev, 4, command_reg | PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+  LogFor(kLogPCI, kInfo, "command (read):%x\n", command_reg);
+  pci::WriteConfReg(*xhc_dev, 4, (command_reg | PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER) & ~PCI_COMMAND_INTX_DISABLE);
   command_reg = pci::ReadConfReg(*xhc_dev, 4);
-  Log(kInfo, "command (write):%x\n", command_reg);
+  LogFor(kLogPCI, kInfo, "command (write):%x\n", command_reg);
 
   Log(kInfo, "create xhc\n");
   // #@@range_begin(init_xhc)
@@ -184,33 +408,108 @@ extern "C" void KernelMain(const FrameBufferConfig& frame_buffer_config) {
     auto err = xhc.Initialize();
     Log(kDebug, "xhc.Initialize: %s\n", err.Name());
   }
+  MarkBootPhase("kernel: xhc reset");
+
+  // 割り込みが使えなければイベントリングをポーリングする
+  if (auto err = InitializeInterrupt()) {
+    Log(kWarn, "InitializeInterrupt: %s, polling xHC\n", err.Name());
+  } else {
+    if (auto err = SetInterruptHandler(kTimerDeviceInterruptId, TimerInterruptHandler,
+                                       nullptr, false)) {
+      Log(kWarn, "SetInterruptHandler(timer): %s\n", err.Name());
+    } else if (auto err = EnableTimerInterrupt()) {
+      Log(kWarn, "EnableTimerInterrupt: %s\n", err.Name());
+    }
+
+    const auto xhc_intid = pci::GetInterruptId(*xhc_dev);
+    if (xhc_intid.error) {
+      Log(kWarn, "GetInterruptId: %s, polling xHC\n", xhc_intid.error.Name());
+    } else if (auto err = SetInterruptHandler(xhc_intid.value, XHCInterruptHandler,
+                                              &xhc, false)) {
+      Log(kWarn, "SetInterruptHandler: %s, polling xHC\n", err.Name());
+    } else {
+      LogFor(kLogXHCI, kInfo, "xHC interrupt: INTID %u\n", xhc_intid.value);
+      interrupt_driven = true;
+    }
+
+    Log(kInfo, "%d CPUs online\n", StartSecondaryCPUs());
+  }
 
   Log(kInfo, "xHC starting\n");
-  xhc.Run();
+  if (auto err = xhc.Run()) {
+    Log(kError, "xhc.Run: %s at %s:%d\n", err.Name(), err.File(), err.Line());
+  }
   // #@@range_end(init_xhc)
 
   // #@@range_begin(configure_port)
   usb::HIDMouseDriver::default_observer = MouseObserver;
+  usb::HIDKeyboardDriver::default_observer = KeyboardObserver;
+
+#ifdef MIKANOS_BENCH_DRAWING
+  BenchmarkDrawing(frame_buffer_config.pixel_format);
+#endif
+
+  // コンソールができてから即時に描いていたログを，ここから再びリングに溜め，描画タスクが描く
+  SetLogDeferred(true);
+
+  input_task = &task_manager->CurrentTask();
+  display_task = task_manager->NewTask();
+  display_task->InitContext(DisplayTask, 0);
+  task_manager->Wakeup(display_task, 1);
+  task_manager->Wakeup(&task_manager->NewTask()->InitContext(IdleTask, 0), 0);
+  task_manager->Wakeup(&task_manager->NewTask()->InitContext(
+      PortScanTask, reinterpret_cast<int64_t>(&xhc)), 2);
+  // #@@range_end(configure_port)
 
-  for (int i = 1; i <= xhc.MaxPorts(); ++i) {
-    auto port = xhc.PortAt(i);
-    Log(kDebug, "Port %d: IsConnected=%d\n", i, port.IsConnected());
+  // #@@range_begin(receive_event)
+  while (1) {
+    bool redraw = false;
+    if (interrupt_driven) {
+      // main_queue が溢れてイベントリングに残ったイベントを移す
+      DisableInterrupts();
+      QueueXHCEvents(xhc);
+      EnableInterrupts();
+    } else {
+      while (xhc.PrimaryEventRing()->HasFront()) {
+        redraw = true;
+        if (auto err = ProcessEvent(xhc)) {
+          Log(kError, "Error while ProcessEvent: %s at %s:%d\n",
+              err.Name(), err.File(), err.Line());
+        }
+      }
+    }
 
-    if (port.IsConnected()) {
-      if (auto err = ConfigurePort(xhc, port)) {
-        Log(kError, "failed to configure port: %s at %s:%d\n",
-            err.Name(), err.File(), err.Line());
-        continue;
+    Message msg;
+    while (main_queue.Pop(msg)) {
+      switch (msg.type) {
+      case Message::kXHCIEvent: {
+        redraw = true;
+        usb::xhci::TRB trb;
+        trb.data = msg.arg.xhci_event;
+        if (auto err = ProcessEvent(xhc, trb)) {
+          Log(kError, "Error while ProcessEvent: %s at %s:%d\n",
+              err.Name(), err.File(), err.Line());
+        }
+        break;
+      }
+      case Message::kTimerTick:
+        break;  // 期限の来たタイマは下の ProcessTimers で処理する
       }
     }
-  }
-  // #@@range_end(configure_port)
+    ProcessTimers();
+    // 入力でマウスカーソルなどが動いたか，ほかのタスクがログを書いていれば描く
+    if (redraw || LogPending()) {
+      RequestDisplay();
+    }
 
-  // #@@range_begin(receive_event)
-  while (1) {
-    if (auto err = ProcessEvent(xhc)) {
-      Log(kError, "Error while ProcessEvent: %s at %s:%d\n",
-          err.Name(), err.File(), err.Line());
+    // 処理の途中で届いたメッセージが無ければ寝る．寝た後に届いたものは
+    // ほかのタスクが YieldToInput で起こしてくれる
+    DisableInterrupts();
+    const bool drained = main_queue.Empty() &&
+      !(interrupt_driven && xhc.PrimaryEventRing()->HasFront());
+    EnableInterrupts();
+    if (drained) {
+      task_manager->Sleep(input_task);
     }
   }
   // #@@range_end(receive_event)
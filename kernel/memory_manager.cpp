@@ -0,0 +1,208 @@
+/**
+ * @file memory_manager.cpp
+ *
+ * 物理メモリをページフレーム単位で管理する．
+ */
+
+#include "memory_manager.hpp"
+
+#include <algorithm>
+#include <new>
+
+#include "logger.hpp"
+#include "paging.hpp"
+
+BitmapMemoryManager::BitmapMemoryManager()
+  : alloc_map_{}, range_begin_{FrameID{0}}, range_end_{FrameID{kFrameCount}} {
+}
+
+WithError<FrameID> BitmapMemoryManager::Allocate(size_t num_frames, size_t align_frames) {
+  auto align_up = [align_frames](size_t id) {
+    return (id + align_frames - 1) / align_frames * align_frames;
+  };
+
+  size_t start_frame_id = align_up(range_begin_.ID());
+  while (true) {
+    // 全部使用中の行は 1 フレームずつ調べずに読み飛ばす
+    if (start_frame_id % kBitsPerMapLine == 0 &&
+        start_frame_id + kBitsPerMapLine <= range_end_.ID() &&
+        alloc_map_[start_frame_id / kBitsPerMapLine] == ~MapLineType{0}) {
+      start_frame_id = align_up(start_frame_id + kBitsPerMapLine);
+      continue;
+    }
+
+    size_t i = 0;
+    for (; i < num_frames; ++i) {
+      if (start_frame_id + i >= range_end_.ID()) {
+        return {kNullFrame, MAKE_ERROR(Error::kNoEnoughMemory)};
+      }
+      if (GetBit(FrameID{start_frame_id + i})) {
+        // "start_frame_id + i" にあるフレームは割り当て済み
+        break;
+      }
+    }
+    if (i == num_frames) {
+      // num_frames 分の空きが見つかった
+      MarkAllocated(FrameID{start_frame_id}, num_frames);
+      return {
+        FrameID{start_frame_id},
+        MAKE_ERROR(Error::kSuccess),
+      };
+    }
+    // 次のフレームから再検索
+    start_frame_id = align_up(start_frame_id + i + 1);
+  }
+}
+
+Error BitmapMemoryManager::Free(FrameID start_frame, size_t num_frames) {
+  for (size_t i = 0; i < num_frames; ++i) {
+    SetBit(FrameID{start_frame.ID() + i}, false);
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+void BitmapMemoryManager::MarkAllocated(FrameID start_frame, size_t num_frames) {
+  // 扱える範囲より上にあるフレームはそもそも割り当てないので印を付けなくてよい
+  if (start_frame.ID() >= kFrameCount) {
+    return;
+  }
+  num_frames = std::min<size_t>(num_frames, kFrameCount - start_frame.ID());
+  for (size_t i = 0; i < num_frames; ++i) {
+    SetBit(FrameID{start_frame.ID() + i}, true);
+  }
+}
+
+void BitmapMemoryManager::SetMemoryRange(FrameID range_begin, FrameID range_end) {
+  range_begin_ = range_begin;
+  range_end_ = range_end;
+}
+
+size_t BitmapMemoryManager::CountFreeFrames() const {
+  size_t num_free = 0;
+  for (size_t id = range_begin_.ID(); id < range_end_.ID(); ++id) {
+    if (id % kBitsPerMapLine == 0 && id + kBitsPerMapLine <= range_end_.ID()) {
+      num_free += kBitsPerMapLine - __builtin_popcountl(alloc_map_[id / kBitsPerMapLine]);
+      id += kBitsPerMapLine - 1;
+    } else if (!GetBit(FrameID{id})) {
+      ++num_free;
+    }
+  }
+  return num_free;
+}
+
+bool BitmapMemoryManager::GetBit(FrameID frame) const {
+  auto line_index = frame.ID() / kBitsPerMapLine;
+  auto bit_index = frame.ID() % kBitsPerMapLine;
+
+  return (alloc_map_[line_index] & (static_cast<MapLineType>(1) << bit_index)) != 0;
+}
+
+void BitmapMemoryManager::SetBit(FrameID frame, bool allocated) {
+  auto line_index = frame.ID() / kBitsPerMapLine;
+  auto bit_index = frame.ID() % kBitsPerMapLine;
+
+  if (allocated) {
+    alloc_map_[line_index] |= (static_cast<MapLineType>(1) << bit_index);
+  } else {
+    alloc_map_[line_index] &= ~(static_cast<MapLineType>(1) << bit_index);
+  }
+}
+
+namespace {
+  alignas(BitmapMemoryManager) char memory_manager_buf[sizeof(BitmapMemoryManager)];
+
+  template <class F>
+  void ForEachDescriptor(const MemoryMap& memory_map, F f) {
+    const auto base = reinterpret_cast<uintptr_t>(memory_map.buffer);
+    for (uintptr_t iter = base;
+         iter < base + memory_map.map_size;
+         iter += memory_map.descriptor_size) {
+      f(*reinterpret_cast<const MemoryDescriptor*>(iter));
+    }
+  }
+}
+
+BitmapMemoryManager* memory_manager;
+
+namespace {
+  struct FrameRange {
+    size_t begin, end;
+  };
+
+  /** @brief ReserveFirmwareCode で使用中にした範囲．ReleaseFirmwareCode で空きに戻す． */
+  std::array<FrameRange, 16> firmware_code;
+  size_t num_firmware_code = 0;
+}
+
+void ReserveFirmwareCode(BitmapMemoryManager& memory_manager,
+                         const MemoryMap& memory_map, uint64_t addr) {
+  FrameRange range{addr / kBytesPerFrame, addr / kBytesPerFrame + 1};
+  ForEachDescriptor(memory_map, [&](const MemoryDescriptor& desc) {
+    const uint64_t end = desc.physical_start + desc.number_of_pages * kUEFIPageSize;
+    if (desc.type == MemoryType::kEfiBootServicesCode &&
+        desc.physical_start <= addr && addr < end) {
+      range = {desc.physical_start / kBytesPerFrame, end / kBytesPerFrame};
+    }
+  });
+  range.end = std::min<size_t>(range.end, BitmapMemoryManager::kFrameCount);
+
+  for (size_t i = 0; i < num_firmware_code; ++i) {
+    if (firmware_code[i].begin <= range.begin && range.end <= firmware_code[i].end) {
+      return;
+    }
+  }
+  if (num_firmware_code == firmware_code.size()) {
+    // 記録できなければ空きに戻せないが，使用中にはしておく
+    Log(kWarn, "too many firmware code ranges, %lx is reserved permanently\n", addr);
+  } else {
+    firmware_code[num_firmware_code++] = range;
+  }
+  memory_manager.MarkAllocated(FrameID{range.begin}, range.end - range.begin);
+}
+
+void ReleaseFirmwareCode() {
+  for (size_t i = 0; i < num_firmware_code; ++i) {
+    const auto& range = firmware_code[i];
+    if (range.begin < range.end) {
+      memory_manager->Free(FrameID{range.begin}, range.end - range.begin);
+    }
+  }
+  num_firmware_code = 0;
+}
+
+void InitializeMemoryManager(const MemoryMap& memory_map) {
+  memory_manager = new(memory_manager_buf) BitmapMemoryManager;
+
+  // UEFI はメモリマップの並び順を保証しないので，いったん全体を使用中にしてから空きを戻す
+  const size_t max_frame = BitmapMemoryManager::kFrameCount;
+  size_t available_end = 0;
+  ForEachDescriptor(memory_map, [&](const MemoryDescriptor& desc) {
+    if (IsAvailable(static_cast<MemoryType>(desc.type))) {
+      const auto end = (desc.physical_start + desc.number_of_pages * kUEFIPageSize) / kBytesPerFrame;
+      available_end = std::max<size_t>(available_end, std::min<size_t>(end, max_frame));
+    }
+  });
+  memory_manager->MarkAllocated(FrameID{0}, available_end);
+
+  ForEachDescriptor(memory_map, [&](const MemoryDescriptor& desc) {
+    if (!IsAvailable(static_cast<MemoryType>(desc.type))) {
+      return;
+    }
+    const size_t begin = desc.physical_start / kBytesPerFrame;
+    const size_t end = std::min<size_t>(
+        (desc.physical_start + desc.number_of_pages * kUEFIPageSize) / kBytesPerFrame,
+        available_end);
+    if (begin < end) {
+      memory_manager->Free(FrameID{begin}, end - begin);
+    }
+  });
+
+  // フレーム 0 はヌルポインタと区別がつかないので使わない
+  memory_manager->MarkAllocated(FrameID{0}, 1);
+  memory_manager->SetMemoryRange(FrameID{1}, FrameID{available_end});
+
+  ReserveFirmwareMemory(*memory_manager, memory_map);
+
+  Log(kInfo, "physical memory: %lu MiB free\n",
+      memory_manager->CountFreeFrames() * kBytesPerFrame / 1_MiB);
+}
@@ -0,0 +1,121 @@
+/**
+ * @file memory_manager.hpp
+ *
+ * 物理メモリをページフレーム単位で管理する．
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <limits>
+
+#include "error.hpp"
+#include "memory_map.hpp"
+
+namespace {
+  constexpr unsigned long long operator""_KiB(unsigned long long kib) {
+    return kib * 1024;
+  }
+
+  constexpr unsigned long long operator""_MiB(unsigned long long mib) {
+    return mib * 1024_KiB;
+  }
+
+  constexpr unsigned long long operator""_GiB(unsigned long long gib) {
+    return gib * 1024_MiB;
+  }
+}
+
+/** @brief 物理メモリフレーム 1 つの大きさ（バイト） */
+static const auto kBytesPerFrame{4_KiB};
+
+/** @brief 物理アドレスを kBytesPerFrame で割った番号でフレームを表す． */
+class FrameID {
+ public:
+  explicit FrameID(size_t id) : id_{id} {}
+  size_t ID() const { return id_; }
+  /** @brief フレームの先頭アドレス．カーネルは物理アドレスをそのまま使う． */
+  void* Frame() const { return reinterpret_cast<void*>(id_ * kBytesPerFrame); }
+
+ private:
+  size_t id_;
+};
+
+static const FrameID kNullFrame{std::numeric_limits<size_t>::max()};
+
+/** @brief ビットマップで空きフレームを管理するメモリマネージャ．
+ *
+ * 1 ビットが 1 フレームに対応し，1 なら使用中を表す．
+ * 空きを先頭から探す単純な first fit だが，全部使用中の行は 1 語ずつ読み飛ばす．
+ * ロックを持たないので，ブート CPU からだけ呼ぶこと．
+ */
+class BitmapMemoryManager {
+ public:
+  /** @brief このメモリマネージャで扱える最大の物理メモリ量（バイト） */
+  static const auto kMaxPhysicalMemoryBytes{128_GiB};
+  /** @brief kMaxPhysicalMemoryBytes までの物理メモリを扱うために必要なフレーム数 */
+  static const auto kFrameCount{kMaxPhysicalMemoryBytes / kBytesPerFrame};
+
+  /** @brief ビットマップ配列の要素型 */
+  using MapLineType = unsigned long;
+  /** @brief ビットマップ配列の 1 つの要素のビット数 == フレーム数 */
+  static const size_t kBitsPerMapLine{8 * sizeof(MapLineType)};
+
+  BitmapMemoryManager();
+
+  /** @brief 連続した num_frames 個のフレームを確保し，先頭のフレームを返す．
+   *
+   * 先頭のフレーム番号は align_frames の倍数になる．
+   */
+  WithError<FrameID> Allocate(size_t num_frames, size_t align_frames = 1);
+  Error Free(FrameID start_frame, size_t num_frames);
+  void MarkAllocated(FrameID start_frame, size_t num_frames);
+
+  /** @brief このメモリマネージャで扱うメモリ範囲を設定する．
+   * この呼び出し以降，Allocate によるメモリ割り当ては設定された範囲内でのみ行われる．
+   *
+   * @param range_begin_ メモリ範囲の始点
+   * @param range_end_   メモリ範囲の終点．最終フレームの次のフレーム．
+   */
+  void SetMemoryRange(FrameID range_begin, FrameID range_end);
+
+  /** @brief 管理範囲内の空きフレームの数を数える． */
+  size_t CountFreeFrames() const;
+
+ private:
+  std::array<MapLineType, kFrameCount / kBitsPerMapLine> alloc_map_;
+  /** @brief このメモリマネージャで扱うメモリ範囲の始点． */
+  FrameID range_begin_;
+  /** @brief このメモリマネージャで扱うメモリ範囲の終点．最終フレームの次のフレーム． */
+  FrameID range_end_;
+
+  bool GetBit(FrameID frame) const;
+  void SetBit(FrameID frame, bool allocated);
+};
+
+extern BitmapMemoryManager* memory_manager;
+
+/** @brief ローダから受け取ったメモリマップから空きフレームを登録する．
+ *
+ * EfiConventionalMemory に加えてブートサービスの領域も回収する．
+ * ファームウェアが作ったページテーブルなど，ブートサービスの領域にあって
+ * まだ使っているものは ReserveFirmwareMemory で使用中にする．
+ * ローダが渡すメモリマップのバッファもブートサービスの領域にあるので，
+ * 呼び出し後も読むならカーネルの領域へ写しておくこと．
+ */
+void InitializeMemoryManager(const MemoryMap& memory_map);
+
+/** @brief addr を含むブートサービスのコードの記述子を，ReleaseFirmwareCode まで使用中にする．
+ *
+ * 例外ベクタがまだ UEFI のハンドラを指しているあいだ，そのコードを回収しないために使う．
+ * addr を含む記述子がなければ addr のあるフレームだけを使用中にする．
+ */
+void ReserveFirmwareCode(BitmapMemoryManager& memory_manager,
+                         const MemoryMap& memory_map, uint64_t addr);
+
+/** @brief ReserveFirmwareCode で使用中にした範囲を空きに戻す．
+ *
+ * カーネルが自前の例外ベクタを設定したあとに，ブート CPU から呼ぶ．
+ */
+void ReleaseFirmwareCode();
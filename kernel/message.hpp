@@ -0,0 +1,29 @@
+/**
+ * @file message.hpp
+ *
+ * 割り込みハンドラからメインループへ送るメッセージ．
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "queue.hpp"
+
+struct Message {
+  enum Type {
+    kXHCIEvent,  // xHC のイベントリングから取り出したイベント TRB
+    kTimerTick,  // タイマ割り込み．メインループを起こしてタイマを処理させる
+  } type;
+
+  union {
+    std::array<uint32_t, 4> xhci_event;
+  } arg;
+};
+
+/** @brief 割り込みハンドラ（生産者）からメインループ（消費者）へのキュー．
+ *
+ * 割り込みハンドラは入れ子にならないので，複数のハンドラが Push しても生産者は 1 つとみなせる．
+ */
+using MessageQueue = SPSCQueue<Message, 256>;
@@ -32,42 +32,41 @@ namespace {
     "         @@@   ",
   };
 
-  void DrawMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position) {
+  /** @brief カーソルの形状からスプライトの画素とマスクを作る． */
+  void SetMouseCursorShape(Sprite& sprite, uint32_t black, uint32_t white) {
+    sprite.Initialize(kMouseCursorWidth, kMouseCursorHeight);
+    uint32_t row[kMouseCursorWidth];
     for (int dy = 0; dy < kMouseCursorHeight; ++dy) {
+      uint32_t mask = 0;
       for (int dx = 0; dx < kMouseCursorWidth; ++dx) {
+        row[dx] = 0;
         if (mouse_cursor_shape[dy][dx] == '@') {
-          pixel_writer->Write(position.x + dx, position.y + dy, {0, 0, 0});
+          row[dx] = black;
+          mask |= 1u << dx;
         } else if (mouse_cursor_shape[dy][dx] == '.') {
-          pixel_writer->Write(position.x + dx, position.y + dy, {255, 255, 255});
-        }
-      }
-    }
-  }
-
-  void EraseMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position,
-                        PixelColor erase_color) {
-    for (int dy = 0; dy < kMouseCursorHeight; ++dy) {
-      for (int dx = 0; dx < kMouseCursorWidth; ++dx) {
-        if (mouse_cursor_shape[dy][dx] != ' ') {
-          pixel_writer->Write(position.x + dx, position.y + dy, erase_color);
+          row[dx] = white;
+          mask |= 1u << dx;
         }
       }
+      sprite.SetRow(dy, row, mask);
     }
   }
 }
 
 // #@@range_begin(mouse_class)
-MouseCursor::MouseCursor(PixelWriter* writer, PixelColor erase_color,
+MouseCursor::MouseCursor(LayerManager* layer_manager,
                          Vector2D<int> initial_position)
-    : pixel_writer_{writer},
-      erase_color_{erase_color},
-      position_{initial_position} {
-  DrawMouseCursor(pixel_writer_, position_);
+    : layer_manager_{layer_manager} {
+  SetMouseCursorShape(sprite_,
+                      layer_manager_->Pack({0, 0, 0}),
+                      layer_manager_->Pack({255, 255, 255}));
+  layer_manager_->ShowSprite(&sprite_, initial_position);
 }
 
 void MouseCursor::MoveRelative(Vector2D<int> displacement) {
-  EraseMouseCursor(pixel_writer_, position_, erase_color_);
-  position_ += displacement;
-  DrawMouseCursor(pixel_writer_, position_);
+  if (displacement.x == 0 && displacement.y == 0) {
+    return;
+  }
+  layer_manager_->MoveSpriteRelative(displacement);
 }
 // #@@range_end(mouse_class)
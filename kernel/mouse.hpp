@@ -8,16 +8,17 @@
 
 // #@@range_begin(mouse_class)
 #include "graphics.hpp"
+#include "layer.hpp"
+#include "sprite.hpp"
 
+/** @brief マウスカーソル．全レイヤの上に重ねるスプライトとして表示する． */
 class MouseCursor {
  public:
-  MouseCursor(PixelWriter* writer, PixelColor erase_color,
-              Vector2D<int> initial_position);
+  MouseCursor(LayerManager* layer_manager, Vector2D<int> initial_position);
   void MoveRelative(Vector2D<int> displacement);
 
  private:
-  PixelWriter* pixel_writer_ = nullptr;
-  PixelColor erase_color_;
-  Vector2D<int> position_;
+  LayerManager* layer_manager_ = nullptr;
+  Sprite sprite_;
 };
 // #@@range_end(mouse_class)
@@ -0,0 +1,105 @@
+/**
+ * @file profile.cpp
+ *
+ * 名前付きの区間の実行時間を集計するプローブ．
+ */
+
+#include "profile.hpp"
+
+#include "logger.hpp"
+
+namespace {
+  Probe* probe_list = nullptr;
+  PMUProbe* pmu_probe_list = nullptr;
+}
+
+void Probe::Record(uint64_t ticks) {
+  if (!registered_) {
+    next_ = probe_list;
+    probe_list = this;
+    registered_ = true;
+  }
+  ++count_;
+  sum_ += ticks;
+  if (ticks < min_) {
+    min_ = ticks;
+  }
+  if (ticks > max_) {
+    max_ = ticks;
+  }
+}
+
+void DumpProbes() {
+  printk("%-28s %8s %10s %10s %10s %12s\n",
+         "probe", "count", "min(us)", "avg(us)", "max(us)", "total(us)");
+  for (auto p = probe_list; p; p = p->next_) {
+    if (p->count_ == 0) {
+      continue;
+    }
+    printk("%-28s %8u %10u %10u %10u %12u\n",
+           p->name_, p->count_,
+           TicksToMicroseconds(p->min_),
+           TicksToMicroseconds(p->sum_ / p->count_),
+           TicksToMicroseconds(p->max_),
+           TicksToMicroseconds(p->sum_));
+  }
+}
+
+void ResetProbes() {
+  for (auto p = probe_list; p; p = p->next_) {
+    p->count_ = 0;
+    p->min_ = UINT64_MAX;
+    p->max_ = 0;
+    p->sum_ = 0;
+  }
+  for (auto p = pmu_probe_list; p; p = p->next_) {
+    p->count_ = 0;
+    p->cycles_ = 0;
+    for (auto& e : p->events_) {
+      e = 0;
+    }
+  }
+}
+
+void PMUProbe::Record(const PMUSample& start, const PMUSample& end) {
+  if (!registered_) {
+    next_ = pmu_probe_list;
+    pmu_probe_list = this;
+    registered_ = true;
+  }
+  ++count_;
+  cycles_ += end.cycles - start.cycles;
+  for (int i = 0; i < kPMUMaxEvents; ++i) {
+    // イベントカウンタは 32 ビットで一周するので差も 32 ビットで求める
+    events_[i] += static_cast<uint32_t>(end.events[i] - start.events[i]);
+  }
+}
+
+void DumpPMUProbes() {
+  if (!PMUAvailable()) {
+    printk("PMU is not available\n");
+    return;
+  }
+
+  printk("%-28s %8s %10s", "pmu probe (avg per call)", "count", "CYCLES");
+  for (int i = 0; i < PMUNumEvents(); ++i) {
+    const char* name = PMUEventName(i);
+    printk(" %10s", name ? name : "-");
+  }
+  printk("\n");
+
+  for (auto p = pmu_probe_list; p; p = p->next_) {
+    if (p->count_ == 0) {
+      continue;
+    }
+    printk("%-28s %8u %10u", p->name_, p->count_, p->cycles_ / p->count_);
+    for (int i = 0; i < PMUNumEvents(); ++i) {
+      if (PMUEventName(i)) {
+        printk(" %10u", p->events_[i] / p->count_);
+      } else {
+        printk(" %10s", "-");
+      }
+    }
+    printk("\n");
+  }
+}
@@ -0,0 +1,123 @@
+/**
+ * @file profile.hpp
+ *
+ * 名前付きの区間の実行時間を集計するプローブ．
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "clock.hpp"
+#include "pmu.hpp"
+
+/** @brief 1 つの区間の実行時間の回数，最小，最大，合計を保持する．
+ *
+ * コンストラクタは constexpr なので，関数内の static 変数にしても
+ * 初期化のためのガードは生成されない．初めて記録したときに一覧へ登録する．
+ */
+class Probe {
+ public:
+  constexpr Probe(const char* name) : name_{name} {}
+
+  /** @brief 1 回分の実行時間 ticks を記録する． */
+  void Record(uint64_t ticks);
+
+  const char* Name() const { return name_; }
+  uint64_t Count() const { return count_; }
+  uint64_t Min() const { return min_; }
+  uint64_t Max() const { return max_; }
+  uint64_t Sum() const { return sum_; }
+
+ private:
+  friend void DumpProbes();
+  friend void ResetProbes();
+
+  const char* name_;
+  uint64_t count_ = 0, min_ = UINT64_MAX, max_ = 0, sum_ = 0;
+  Probe* next_ = nullptr;
+  bool registered_ = false;
+};
+
+/** @brief 生存期間を計測して Probe に記録する． */
+class ScopedProbe {
+ public:
+  explicit ScopedProbe(Probe& probe) : probe_{probe}, start_{ClockTicks()} {}
+  ~ScopedProbe() { probe_.Record(ClockTicks() - start_); }
+  ScopedProbe(const ScopedProbe&) = delete;
+  ScopedProbe& operator=(const ScopedProbe&) = delete;
+
+ private:
+  Probe& probe_;
+  const uint64_t start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+/** @brief この行から所属するスコープの終わりまでを name という名前で計測する． */
+#define PROFILE_SCOPE(name) \
+  static Probe PROFILE_CONCAT(profile_probe_, __LINE__){name}; \
+  ScopedProbe PROFILE_CONCAT(profile_scope_, __LINE__){ \
+    PROFILE_CONCAT(profile_probe_, __LINE__)}
+
+/** @brief 記録のあるすべてのプローブの集計を printk で表示する． */
+void DumpProbes();
+
+/** @brief すべてのプローブ（PMUProbe を含む）の集計を消す． */
+void ResetProbes();
+
+/** @brief 1 つの区間で数えた PMU のカウンタの合計を保持する．
+ *
+ * Probe と同じく constexpr で構築でき，初めて記録したときに一覧へ登録する．
+ */
+class PMUProbe {
+ public:
+  constexpr PMUProbe(const char* name) : name_{name} {}
+
+  /** @brief 区間の始まり start と終わり end のカウンタの差を記録する． */
+  void Record(const PMUSample& start, const PMUSample& end);
+
+ private:
+  friend void DumpPMUProbes();
+  friend void ResetProbes();
+
+  const char* name_;
+  uint64_t count_ = 0, cycles_ = 0;
+  uint64_t events_[kPMUMaxEvents] = {};
+  PMUProbe* next_ = nullptr;
+  bool registered_ = false;
+};
+
+/** @brief 生存期間の PMU のカウンタの差を PMUProbe に記録する． */
+class ScopedPMUProbe {
+ public:
+  explicit ScopedPMUProbe(PMUProbe& probe) : probe_{probe} { PMURead(start_); }
+  ~ScopedPMUProbe() {
+    PMUSample end;
+    PMURead(end);
+    probe_.Record(start_, end);
+  }
+  ScopedPMUProbe(const ScopedPMUProbe&) = delete;
+  ScopedPMUProbe& operator=(const ScopedPMUProbe&) = delete;
+
+ private:
+  PMUProbe& probe_;
+  PMUSample start_;
+};
+
+/** @brief この行から所属するスコープの終わりまでの PMU のカウンタを name で集計する．
+ *
+ * MIKANOS_NO_PMU_PROBES を定義してビルドすると何もしない．
+ */
+#ifdef MIKANOS_NO_PMU_PROBES
+#define PMU_SCOPE(name)
+#else
+#define PMU_SCOPE(name) \
+  static PMUProbe PROFILE_CONCAT(pmu_probe_, __LINE__){name}; \
+  ScopedPMUProbe PROFILE_CONCAT(pmu_scope_, __LINE__){ \
+    PROFILE_CONCAT(pmu_probe_, __LINE__)}
+#endif
+
+/** @brief 記録のあるすべての PMUProbe について 1 回あたりのカウンタの平均を表示する． */
+void DumpPMUProbes();
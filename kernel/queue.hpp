@@ -0,0 +1,66 @@
+/**
+ * @file queue.hpp
+ *
+ * 割り込みハンドラからメインループへデータを渡すためのキュー．
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/** @brief 固定長の単一生産者・単一消費者キュー．
+ *
+ * Push を呼ぶ文脈（割り込みハンドラなど）と Pop を呼ぶ文脈がそれぞれ 1 つずつなら，
+ * ロックも割り込み禁止も無しに使える．生産者は要素を書いてから tail_ を
+ * release で進め，消費者は tail_ を acquire で読んでから要素を読む．head_ も同様．
+ * 添字はラップさせずに増やし続け，N - 1 とのビット積で要素の位置を求める．
+ *
+ * メンバの初期値は 0 なので，静的領域に置けばコンストラクタを呼ばなくても使える．
+ */
+template <typename T, size_t N>
+class SPSCQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+ public:
+  /** @brief 末尾に value を追加する．満杯なら何もせず false を返す．生産者専用． */
+  bool Push(const T& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+    buf_[tail & (N - 1)] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** @brief 先頭の要素を value に取り出す．空なら false を返す．消費者専用． */
+  bool Pop(T& value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = buf_[head & (N - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** @brief どちらの文脈から呼んでもよいが，結果は呼んだ時点の近似値． */
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  size_t Count() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t Capacity() { return N; }
+
+ private:
+  // 生産者と消費者が同じキャッシュラインを奪い合わないように離して置く
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+  alignas(64) T buf_[N];
+};
@@ -0,0 +1,98 @@
+/**
+ * @file sprite.cpp
+ *
+ * スプライトのプログラムを集めたファイル．
+ */
+
+#include "sprite.hpp"
+
+#include <cstring>
+
+void Sprite::Initialize(int width, int height) {
+  width_ = width < kMaxWidth ? width : kMaxWidth;
+  height_ = height < kMaxHeight ? height : kMaxHeight;
+  memset(masks_, 0, sizeof(masks_));
+}
+
+void Sprite::SetRow(int y, const uint32_t* pixels, uint32_t mask) {
+  if (y < 0 || height_ <= y) {
+    return;
+  }
+  memcpy(pixels_[y], pixels, 4 * width_);
+  masks_[y] = width_ < 32 ? mask & ((1u << width_) - 1) : mask;
+}
+
+bool Sprite::MoveTo(FrameBuffer& fb, Vector2D<int> pos) {
+  if (pos.x == pos_.x && pos.y == pos_.y) {
+    return false;
+  }
+  if (!visible_) {
+    pos_ = pos;
+    return false;
+  }
+
+  Hide(fb);
+  pos_ = pos;
+  Show(fb);
+  return true;
+}
+
+void Sprite::Show(FrameBuffer& fb) {
+  const auto area = Area() & fb.Bounds();
+  Save(fb, area);
+  Draw(fb, area);
+  visible_ = true;
+}
+
+void Sprite::Hide(FrameBuffer& fb) {
+  if (visible_) {
+    Restore(fb, Area() & fb.Bounds());
+    visible_ = false;
+  }
+}
+
+void Sprite::Refresh(FrameBuffer& fb, const Rectangle<int>& area) {
+  if (!visible_) {
+    return;
+  }
+  const auto overlap = area & Area() & fb.Bounds();
+  Save(fb, overlap);
+  Draw(fb, overlap);
+}
+
+void Sprite::Save(FrameBuffer& fb, const Rectangle<int>& area) {
+  if (area.Empty()) {
+    return;
+  }
+  const int x = area.pos.x - pos_.x;
+  for (int y = area.pos.y; y < area.pos.y + area.size.y; ++y) {
+    memcpy(&saved_[y - pos_.y][x], fb.RowAt(area.pos.x, y), 4 * area.size.x);
+  }
+}
+
+void Sprite::Restore(FrameBuffer& fb, const Rectangle<int>& area) {
+  if (area.Empty()) {
+    return;
+  }
+  const int x = area.pos.x - pos_.x;
+  for (int y = area.pos.y; y < area.pos.y + area.size.y; ++y) {
+    memcpy(fb.RowAt(area.pos.x, y), &saved_[y - pos_.y][x], 4 * area.size.x);
+  }
+}
+
+void Sprite::Draw(FrameBuffer& fb, const Rectangle<int>& area) {
+  if (area.Empty()) {
+    return;
+  }
+  const int x = area.pos.x - pos_.x;
+  for (int y = area.pos.y; y < area.pos.y + area.size.y; ++y) {
+    const auto src = &pixels_[y - pos_.y][x];
+    auto dst = fb.RowAt(area.pos.x, y);
+    auto mask = masks_[y - pos_.y] >> x;
+    for (int i = 0; i < area.size.x && mask; ++i, mask >>= 1) {
+      if (mask & 1u) {
+        dst[i] = src[i];
+      }
+    }
+  }
+}
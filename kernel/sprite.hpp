@@ -0,0 +1,58 @@
+/**
+ * @file sprite.hpp
+ *
+ * 画面の最前面に重ねる小さな画像（スプライト）．
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "frame_buffer.hpp"
+#include "graphics.hpp"
+
+/** @brief 合成済みの画面に直接描く小さな画像．
+ *
+ * マスクと Pack 済みの画素をあらかじめ用意しておき，描く前に下にある画素を
+ * 退避する．移動時は退避した画素を書き戻してから新しい位置に描くので，
+ * 下のレイヤを合成し直す必要がなく，移動の手間は画像の大きさだけで決まる．
+ * 描画や退避は LayerManager が行う．
+ */
+class Sprite {
+ public:
+  static const int kMaxWidth = 32, kMaxHeight = 32;
+
+  /** @brief width x height 画素の透明な画像として初期化する． */
+  void Initialize(int width, int height);
+  /** @brief y 行目の画像を設定する．mask のビット i が 1 の画素だけ pixels[i] を描く． */
+  void SetRow(int y, const uint32_t* pixels, uint32_t mask);
+
+  Vector2D<int> Position() const { return pos_; }
+  Rectangle<int> Area() const { return {pos_, {width_, height_}}; }
+
+ private:
+  friend class LayerManager;
+
+  /** @brief pos に移動する．位置が変わらなければ何もしない．
+   *
+   * @return 画面を描き換えたら true
+   */
+  bool MoveTo(FrameBuffer& fb, Vector2D<int> pos);
+  /** @brief 現在位置の下の画素を退避してから画像を描く． */
+  void Show(FrameBuffer& fb);
+  /** @brief 退避した画素を書き戻す． */
+  void Hide(FrameBuffer& fb);
+  /** @brief 画面座標の area が合成し直された後に呼び，その部分の退避と描画をやり直す． */
+  void Refresh(FrameBuffer& fb, const Rectangle<int>& area);
+
+  void Save(FrameBuffer& fb, const Rectangle<int>& area);
+  void Restore(FrameBuffer& fb, const Rectangle<int>& area);
+  void Draw(FrameBuffer& fb, const Rectangle<int>& area);
+
+  int width_{0}, height_{0};
+  Vector2D<int> pos_{0, 0};
+  bool visible_{false};
+  uint32_t masks_[kMaxHeight];
+  uint32_t pixels_[kMaxHeight][kMaxWidth];
+  uint32_t saved_[kMaxHeight][kMaxWidth];
+};
@@ -0,0 +1,170 @@
+/**
+ * @file task.cpp
+ *
+ * 協調的なタスク切り替え．
+ */
+
+#include "task.hpp"
+
+#include <new>
+
+#include "halt.hpp"
+
+Task& Task::InitContext(TaskFunc* f, int64_t data) {
+  func_ = f;
+  data_ = data;
+  InitTaskContext(context_, reinterpret_cast<uint64_t>(stack_ + sizeof(stack_)),
+                  TaskEntry);
+  return *this;
+}
+
+/** @brief 新しいタスクが最初に切り替えられたときに実行を始める場所． */
+extern "C" void TaskEntry() {
+  Task& task = task_manager->CurrentTask();
+  task.func_(task.id_, task.data_);
+  task_manager->Finish();
+}
+
+void TaskManager::TaskQueue::Erase(Task* task) {
+  for (size_t i = 0; i < count_; ++i) {
+    if (tasks_[i] == task) {
+      for (; i + 1 < count_; ++i) {
+        tasks_[i] = tasks_[i + 1];
+      }
+      --count_;
+      return;
+    }
+  }
+}
+
+TaskManager::TaskManager() {
+  for (auto& task : tasks_) {
+    task.in_use_ = false;
+    task.running_ = false;
+  }
+  Task& main_task = *NewTask();
+  main_task.level_ = kMaxLevel;
+  main_task.running_ = true;
+  running_[kMaxLevel].PushBack(&main_task);
+}
+
+Task* TaskManager::NewTask() {
+  for (auto& task : tasks_) {
+    if (!task.in_use_) {
+      task.id_ = ++latest_id_;
+      task.func_ = nullptr;
+      task.data_ = 0;
+      task.level_ = Task::kDefaultLevel;
+      task.running_ = false;
+      task.in_use_ = true;
+      return &task;
+    }
+  }
+  return nullptr;
+}
+
+void TaskManager::SwitchTask(bool current_sleep) {
+  auto& level_queue = running_[current_level_];
+  Task* current_task = level_queue.Front();
+  level_queue.PopFront();
+  if (!current_sleep) {
+    level_queue.PushBack(current_task);
+  }
+
+  for (int level = kMaxLevel; level >= 0; --level) {
+    if (!running_[level].Empty()) {
+      current_level_ = level;
+      break;
+    }
+  }
+
+  Task* next_task = running_[current_level_].Front();
+  if (next_task != current_task) {
+    SwitchContext(&next_task->Context(), &current_task->Context());
+  }
+}
+
+void TaskManager::Sleep(Task* task) {
+  if (!task->running_) {
+    return;
+  }
+  task->running_ = false;
+
+  if (task == &CurrentTask()) {
+    SwitchTask(true);
+    return;
+  }
+  running_[task->level_].Erase(task);
+}
+
+Error TaskManager::Sleep(uint64_t id) {
+  Task* task = FindTask(id);
+  if (task == nullptr) {
+    return MAKE_ERROR(Error::kNoSuchTask);
+  }
+  Sleep(task);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+void TaskManager::Wakeup(Task* task, int level) {
+  if (level > kMaxLevel) {
+    level = kMaxLevel;
+  }
+
+  if (task->running_) {
+    // 実行中のタスクは待ち行列の先頭にいるので，レベルを変えない
+    if (level < 0 || level == task->level_ || task == &CurrentTask()) {
+      return;
+    }
+    running_[task->level_].Erase(task);
+    task->level_ = level;
+    running_[level].PushBack(task);
+    return;
+  }
+
+  if (level >= 0) {
+    task->level_ = level;
+  }
+  task->running_ = true;
+  running_[task->level_].PushBack(task);
+}
+
+Error TaskManager::Wakeup(uint64_t id, int level) {
+  Task* task = FindTask(id);
+  if (task == nullptr) {
+    return MAKE_ERROR(Error::kNoSuchTask);
+  }
+  Wakeup(task, level);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+void TaskManager::Finish() {
+  Task& task = CurrentTask();
+  task.running_ = false;
+  task.in_use_ = false;  // 切り替えた後はこのスタックに戻らないので再利用してよい
+  SwitchTask(true);
+  while (1) halt();
+}
+
+Task& TaskManager::CurrentTask() {
+  return *running_[current_level_].Front();
+}
+
+Task* TaskManager::FindTask(uint64_t id) {
+  for (auto& task : tasks_) {
+    if (task.in_use_ && task.id_ == id) {
+      return &task;
+    }
+  }
+  return nullptr;
+}
+
+namespace {
+  alignas(TaskManager) char task_manager_buf[sizeof(TaskManager)];
+}
+
+TaskManager* task_manager;
+
+void InitializeTask() {
+  task_manager = new(task_manager_buf) TaskManager;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file task.hpp
+ *
+ * 協調的なタスク切り替え．
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "context.hpp"
+#include "error.hpp"
+
+/** @brief タスクの本体．data は InitContext に渡した値． */
+using TaskFunc = void (uint64_t task_id, int64_t data);
+
+extern "C" void TaskEntry();
+
+class Task {
+ public:
+  static const int kDefaultLevel = 1;
+  static const size_t kDefaultStackBytes = 64 * 1024;
+
+  /** @brief 次に切り替えられたとき f(ID(), data) から実行を始めるよう準備する． */
+  Task& InitContext(TaskFunc* f, int64_t data);
+  TaskContext& Context() { return context_; }
+  uint64_t ID() const { return id_; }
+  int Level() const { return level_; }
+  bool Running() const { return running_; }
+
+ private:
+  friend class TaskManager;
+  friend void TaskEntry();
+
+  uint64_t id_;
+  TaskFunc* func_;
+  int64_t data_;
+  int level_;
+  bool running_;
+  bool in_use_;
+  TaskContext context_;
+  alignas(16) uint8_t stack_[kDefaultStackBytes];
+};
+
+/** @brief 実行可能なタスクを優先度（レベル）ごとの待ち行列で管理する．
+ *
+ * 切り替えは SwitchTask，Sleep，Finish を呼んだときにだけ起きる（協調的）．
+ * 実行可能なタスクのうち最もレベルの高いものが選ばれ，同じレベルの中では順番に回る．
+ * タスクの操作はタスクの文脈からだけ行い，割り込みハンドラからは呼ばない．
+ * 寝ないタスク（アイドルタスク）を最低レベルに 1 つ置き，実行可能なタスクが尽きないようにすること．
+ */
+class TaskManager {
+ public:
+  static const int kMaxLevel = 3;
+  static const size_t kMaxTasks = 8;
+
+  /** @brief 呼び出した文脈（KernelMain）を最初のタスクとして登録する． */
+  TaskManager();
+
+  /** @brief 空いているタスクを確保する．空きが無ければ nullptr． */
+  Task* NewTask();
+
+  /** @brief 次のタスクへ切り替える．current_sleep が真なら現在のタスクは寝かせる． */
+  void SwitchTask(bool current_sleep = false);
+
+  void Sleep(Task* task);
+  Error Sleep(uint64_t id);
+
+  /** @brief task を実行可能にする．level が 0 以上ならそのレベルに移す． */
+  void Wakeup(Task* task, int level = -1);
+  Error Wakeup(uint64_t id, int level = -1);
+
+  /** @brief 現在のタスクを終了し，二度と戻らない． */
+  [[noreturn]] void Finish();
+
+  Task& CurrentTask();
+
+ private:
+  /** @brief 1 つのレベルの実行待ち行列．先頭が実行中または次に実行するタスク． */
+  class TaskQueue {
+   public:
+    bool Empty() const { return count_ == 0; }
+    Task* Front() const { return tasks_[0]; }
+    void PushBack(Task* task) { tasks_[count_++] = task; }
+    void PopFront() { Erase(tasks_[0]); }
+    void Erase(Task* task);
+
+   private:
+    std::array<Task*, kMaxTasks> tasks_;
+    size_t count_ = 0;
+  };
+
+  std::array<Task, kMaxTasks> tasks_;
+  uint64_t latest_id_ = 0;
+  std::array<TaskQueue, kMaxLevel + 1> running_;
+  int current_level_ = kMaxLevel;
+
+  Task* FindTask(uint64_t id);
+};
+
+extern TaskManager* task_manager;
+
+/** @brief タスク管理を初期化する．KernelMain のタスクは最高レベルで動く． */
+void InitializeTask();
@@ -0,0 +1,110 @@
+/**
+ * @file test/queue_test.cpp
+ *
+ * SPSCQueue のホスト上のストレステストとスループットの計測．
+ * 生産者と消費者を別々のスレッドで動かし，順序が保たれ要素が失われないことを確かめる．
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "queue.hpp"
+
+namespace {
+  // 満杯や空で待つ間は CPU を譲る．CPU が 1 つしか無いホストでも相手のスレッドが進めるようにする．
+
+  /** @brief 0 から num_items - 1 までを順に送り，受け取った順序と合計を確かめる． */
+  template <size_t N>
+  bool StressTest(uint64_t num_items) {
+    static SPSCQueue<uint64_t, N> queue;
+
+    std::thread producer{[&] {
+      for (uint64_t i = 0; i < num_items;) {
+        if (queue.Push(i)) {
+          ++i;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }};
+
+    bool ok = true;
+    uint64_t expected = 0;
+    while (expected < num_items) {
+      uint64_t value;
+      if (!queue.Pop(value)) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (value != expected) {
+        printf("FAIL: capacity %zu: got %lu, expected %lu\n",
+               N, static_cast<unsigned long>(value), static_cast<unsigned long>(expected));
+        ok = false;
+        break;
+      }
+      ++expected;
+    }
+    producer.join();
+
+    if (ok && !queue.Empty()) {
+      printf("FAIL: capacity %zu: %zu items left after the last one\n", N, queue.Count());
+      ok = false;
+    }
+    if (ok) {
+      printf("ok: capacity %zu: %lu items in order\n", N, static_cast<unsigned long>(num_items));
+    }
+    return ok;
+  }
+
+  /** @brief 1 要素あたりの受け渡しにかかる時間と毎秒の要素数を表示する． */
+  template <size_t N>
+  void Benchmark(uint64_t num_items) {
+    static SPSCQueue<uint64_t, N> queue;
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread producer{[&] {
+      for (uint64_t i = 0; i < num_items;) {
+        if (queue.Push(i)) {
+          ++i;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }};
+    uint64_t sum = 0;
+    for (uint64_t n = 0; n < num_items;) {
+      uint64_t value;
+      if (queue.Pop(value)) {
+        sum += value;
+        ++n;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    producer.join();
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    printf("bench: capacity %5zu: %6.2f ns/item, %7.2f Mitems/s (sum %lu)\n",
+           N, static_cast<double>(ns) / num_items,
+           num_items * 1e3 / static_cast<double>(ns), static_cast<unsigned long>(sum));
+  }
+}
+
+int main(int argc, char** argv) {
+  const uint64_t num_items = argc > 1 ? strtoull(argv[1], nullptr, 0) : 10'000'000;
+
+  bool ok = true;
+  // 容量 2 では満杯と空の境界を頻繁に通る
+  ok &= StressTest<2>(num_items / 10);
+  ok &= StressTest<64>(num_items);
+  ok &= StressTest<1024>(num_items);
+
+  Benchmark<64>(num_items);
+  Benchmark<1024>(num_items);
+  Benchmark<16384>(num_items);
+  return ok ? 0 : 1;
+}
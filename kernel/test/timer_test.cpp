@@ -0,0 +1,219 @@
+/**
+ * @file test/timer_test.cpp
+ *
+ * TimerWheel のホスト上の試験．
+ * 段 1 以上からのカスケード，コールバックの中での登録し直し，取り消しを確かめる．
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "timer_wheel.hpp"
+
+namespace {
+  bool ok = true;
+
+  void Check(bool cond, const char* what, uint64_t a, uint64_t b) {
+    if (!cond) {
+      printf("FAIL: %s (%lu, %lu)\n", what,
+             static_cast<unsigned long>(a), static_cast<unsigned long>(b));
+      ok = false;
+    }
+  }
+
+  /** @brief 試験用のタイマ．呼ばれた刻みと回数を覚える． */
+  struct Probe {
+    Timer timer{OnExpire, this};
+    uint64_t expires = 0;      // 期待する最初の期限
+    uint64_t last_fired = 0;   // 最後に呼ばれたときの Advance の now
+    uint64_t prev_now = 0;     // その Advance の直前の now
+    int count = 0;
+    void (*hook)(Probe& probe) = nullptr;
+
+    static void OnExpire(Timer& timer, void* arg);
+  };
+
+  TimerWheel* wheel;
+  uint64_t advancing_now = 0, advancing_prev = 0;
+
+  void Probe::OnExpire(Timer& timer, void* arg) {
+    auto probe = static_cast<Probe*>(arg);
+    ++probe->count;
+    probe->last_fired = advancing_now;
+    probe->prev_now = advancing_prev;
+    if (probe->hook) {
+      probe->hook(*probe);
+    }
+  }
+
+  void AdvanceTo(uint64_t now) {
+    advancing_now = now;
+    wheel->Advance(now);
+    advancing_prev = now;
+  }
+
+  /** @brief 開始の刻み start から delta 後のタイマが，1 刻みずつ進めてちょうどその刻みで呼ばれること． */
+  void TestSingle(uint64_t start, uint64_t delta) {
+    static TimerWheel w;
+    w = TimerWheel{};
+    wheel = &w;
+    w.Reset(start);
+    advancing_prev = start - 1;
+
+    Probe p;
+    w.Schedule(p.timer, start + delta, 0);
+    for (uint64_t now = start; now < start + delta; ++now) {
+      AdvanceTo(now);
+    }
+    Check(p.count == 0, "fired early", delta, p.last_fired);
+    AdvanceTo(start + delta);
+    Check(p.count == 1, "fired once at the deadline", delta, p.count);
+    Check(!p.timer.Pending() && w.Empty(), "wheel empty after one-shot", delta, 0);
+  }
+
+  /** @brief 段をまたぐ期限の多数のタイマを，ばらばらの幅で進めても期限どおりに 1 回ずつ呼ぶこと． */
+  void TestRandom() {
+    static TimerWheel w;
+    w = TimerWheel{};
+    wheel = &w;
+    std::mt19937_64 rng{12345};
+    const uint64_t start = 1000003;
+    w.Reset(start);
+    advancing_prev = start - 1;
+
+    std::vector<Probe> probes(2000);
+    uint64_t last = start;
+    for (auto& p : probes) {
+      // 段 0 から段 3 まで，それぞれの範囲から選ぶ
+      const int level = rng() % 4;
+      const uint64_t range = uint64_t{64} << (6 * level);
+      p.expires = start + rng() % range;
+      w.Schedule(p.timer, p.expires, 0);
+      last = std::max(last, p.expires);
+    }
+
+    uint64_t now = start;
+    while (now <= last) {
+      AdvanceTo(now);
+      now += 1 + rng() % 700;
+    }
+    AdvanceTo(last);
+
+    for (auto& p : probes) {
+      Check(p.count == 1, "random: fired once", p.expires, p.count);
+      Check(p.prev_now < p.expires && p.expires <= p.last_fired,
+            "random: fired in the Advance that passed the deadline", p.expires, p.last_fired);
+    }
+    Check(w.Empty(), "random: wheel empty", 0, 0);
+  }
+
+  /** @brief 周期タイマをコールバックの中から登録し直したり取り消したりできること． */
+  void TestRearm() {
+    static TimerWheel w;
+    w = TimerWheel{};
+    wheel = &w;
+    w.Reset(0);
+    advancing_prev = 0;
+
+    // 周期 3 で 5 回呼ばれたら，自分を 100 刻み後の 1 回だけのタイマに登録し直す
+    Probe periodic;
+    periodic.hook = [](Probe& p) {
+      if (p.count == 5) {
+        wheel->Schedule(p.timer, advancing_now + 100, 0);
+      }
+    };
+    w.Schedule(periodic.timer, 3, 3);
+
+    // 期限 0 で自分を登録し直し続けても Advance は終わり，1 刻みに 1 回だけ呼ばれる
+    Probe immediate;
+    immediate.hook = [](Probe& p) {
+      if (p.count < 10) {
+        wheel->Schedule(p.timer, advancing_now, 0);
+      }
+    };
+    w.Schedule(immediate.timer, 1, 0);
+
+    // 周期 7 で，3 回目のコールバックで自分を取り消す
+    Probe self_cancel;
+    self_cancel.hook = [](Probe& p) {
+      if (p.count == 3) {
+        wheel->Remove(p.timer);
+      }
+    };
+    w.Schedule(self_cancel.timer, 7, 7);
+
+    for (uint64_t now = 1; now <= 14; ++now) {
+      AdvanceTo(now);
+    }
+    Check(periodic.count == 4, "periodic: one call per period", periodic.count, 4);
+    AdvanceTo(15);
+    Check(periodic.count == 5 && periodic.timer.Pending(), "periodic: re-armed", periodic.count, 5);
+    Check(immediate.count == 10 && !immediate.timer.Pending(),
+          "immediate re-arm: once per tick", immediate.count, 10);
+
+    for (uint64_t now = 16; now < 115; ++now) {
+      AdvanceTo(now);
+    }
+    Check(periodic.count == 5, "periodic: period dropped after re-arm", periodic.count, 5);
+    AdvanceTo(115);
+    Check(periodic.count == 6 && !periodic.timer.Pending(),
+          "periodic: fired at the new deadline", periodic.count, 6);
+
+    AdvanceTo(1000);
+    Check(self_cancel.count == 3 && !self_cancel.timer.Pending(),
+          "self cancel: stopped", self_cancel.count, 3);
+    Check(w.Empty(), "rearm: wheel empty", 0, 0);
+  }
+
+  Probe* victim;
+
+  /** @brief 取り消したタイマは，期限の来たリストに入っていても呼ばれないこと． */
+  void TestCancel() {
+    static TimerWheel w;
+    w = TimerWheel{};
+    wheel = &w;
+    w.Reset(50);
+    advancing_prev = 49;
+
+    Probe far, near, killer, same_tick;
+    w.Schedule(far.timer, 50 + 5000, 0);     // 段 2
+    w.Schedule(near.timer, 50 + 70, 0);      // 段 1
+    w.Remove(far.timer);
+    w.Remove(near.timer);
+
+    // 同じ刻みに期限が来るタイマを，先に呼ばれたコールバックが取り消す
+    killer.hook = [](Probe& p) { wheel->Remove(victim->timer); };
+    w.Schedule(same_tick.timer, 60, 0);
+    w.Schedule(killer.timer, 60, 0);  // リストの先頭に入り，先に呼ばれる
+    victim = &same_tick;
+
+    AdvanceTo(6000);
+    Check(far.count == 0 && near.count == 0, "cancel: removed timers do not fire",
+          far.count, near.count);
+    Check(killer.count == 1 && same_tick.count == 0,
+          "cancel: removed from the expired list", killer.count, same_tick.count);
+    Check(w.Empty(), "cancel: wheel empty", 0, 0);
+  }
+}
+
+int main() {
+  // 段 0，段 1，段 2，段 3 の期限と，最上段を越える期限．開始を 64 の倍数からずらしたものも試す
+  const uint64_t deltas[] = {1, 63, 64, 65, 100, 4095, 4096, 5000,
+                             262143, 262144, 300000, (uint64_t{1} << 24) + 5};
+  for (uint64_t start : {uint64_t{64}, uint64_t{37}, uint64_t{4095}}) {
+    for (uint64_t delta : deltas) {
+      TestSingle(start, delta);
+    }
+  }
+  printf("%s: single timers across levels\n", ok ? "ok" : "FAIL");
+
+  TestRandom();
+  printf("%s: random deadlines\n", ok ? "ok" : "FAIL");
+  TestRearm();
+  printf("%s: re-arm from callbacks\n", ok ? "ok" : "FAIL");
+  TestCancel();
+  printf("%s: cancellation\n", ok ? "ok" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file timeline.cpp
+ *
+ * ブートローダの起動から USB デバイスの準備完了までの時刻の記録．
+ */
+
+#include "timeline.hpp"
+
+#ifdef MIKANOS_BOOT_TIMELINE
+
+#include <cstring>
+
+#include "clock.hpp"
+#include "logger.hpp"
+
+namespace {
+  BootTimeline timeline;
+  bool finished = false;
+}
+
+void InitializeBootTimeline(const BootTimeline* loader_timeline) {
+  if (loader_timeline &&
+      loader_timeline->num_entries <= BOOT_TIMELINE_MAX_ENTRIES) {
+    memcpy(&timeline, loader_timeline, sizeof(timeline));
+  }
+}
+
+void MarkBootPhase(const char* name) {
+  const uint64_t now = ClockTicks();
+  if (timeline.num_entries >= BOOT_TIMELINE_MAX_ENTRIES) {
+    return;
+  }
+  auto& entry = timeline.entries[timeline.num_entries++];
+  strncpy(entry.name, name, sizeof(entry.name) - 1);
+  entry.name[sizeof(entry.name) - 1] = '\0';
+  entry.ticks = now;
+}
+
+void FinishBootTimeline(const char* name) {
+  if (finished) {
+    return;
+  }
+  finished = true;
+  MarkBootPhase(name);
+
+  // 各行はその区切りまでの区間，つまり直前の区切りからの経過時間を表す
+  printk("%-32s %12s %12s\n", "boot phase (ends at)", "delta(us)", "total(us)");
+  const uint64_t start = timeline.entries[0].ticks;
+  for (uint32_t i = 0; i < timeline.num_entries; ++i) {
+    const auto& e = timeline.entries[i];
+    const uint64_t prev = i == 0 ? e.ticks : timeline.entries[i - 1].ticks;
+    printk("%-32s %12u %12u\n", e.name,
+           TicksToMicroseconds(e.ticks - prev),
+           TicksToMicroseconds(e.ticks - start));
+  }
+}
+
+#endif
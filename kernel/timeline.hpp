@@ -0,0 +1,31 @@
+/**
+ * @file timeline.hpp
+ *
+ * ブートローダの起動から USB デバイスの準備完了までの時刻の記録．
+ *
+ * MIKANOS_BOOT_TIMELINE を定義してビルドしたときだけ記録する．
+ * 定義しなければ各関数は空になり，呼び出しは消える．
+ */
+
+#pragma once
+
+#include "boot_timeline.hpp"
+
+#ifdef MIKANOS_BOOT_TIMELINE
+
+/** @brief ブートローダの記録 loader_timeline（nullptr でもよい）を引き継ぐ． */
+void InitializeBootTimeline(const BootTimeline* loader_timeline);
+
+/** @brief 現在時刻を name という区切りとして記録する． */
+void MarkBootPhase(const char* name);
+
+/** @brief name を記録し，初めて呼ばれたときだけ区間ごとの経過時間を表示する． */
+void FinishBootTimeline(const char* name);
+
+#else
+
+inline void InitializeBootTimeline(const BootTimeline* loader_timeline) {}
+inline void MarkBootPhase(const char* name) {}
+inline void FinishBootTimeline(const char* name) {}
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * @file timer.cpp
+ *
+ * 階層タイマホイールによるタイマと，タイムアウト付きの待ち合わせ．
+ */
+
+#include "timer.hpp"
+
+#include <cstddef>
+
+#include "timer_device.hpp"
+
+namespace {
+  TimerWheel timer_wheel;
+  uint64_t ticks_per_timer_tick = 1;
+  /** @brief EnableTimerInterrupt が呼ばれ，タイマ割り込みを使えるなら真． */
+  bool tick_available = false;
+  /** @brief タイマ割り込みを発生させているなら真．登録中のタイマが無い間は止める． */
+  bool tick_running = false;
+
+  void StartTick() {
+    if (tick_available && !tick_running) {
+      if (StartTimerDevice(ticks_per_timer_tick)) {
+        tick_available = false;
+        return;
+      }
+      tick_running = true;
+    }
+  }
+
+  void StopTick() {
+    if (tick_running) {
+      StopTimerDevice();
+      tick_running = false;
+    }
+  }
+
+  /** @brief ミリ秒を刻みに換算する．0 でなければ切り上げて 1 刻み以上にする． */
+  uint64_t MillisecondsToTimerTicks(unsigned long ms) {
+    return (static_cast<uint64_t>(ms) * kTimerFreq + 999) / 1000;
+  }
+}
+
+void InitializeTimer() {
+  ticks_per_timer_tick = ClockFrequency() / kTimerFreq;
+  if (ticks_per_timer_tick == 0) {
+    ticks_per_timer_tick = 1;
+  }
+  timer_wheel.Reset(CurrentTick());
+}
+
+uint64_t CurrentTick() {
+  return ClockTicks() / ticks_per_timer_tick;
+}
+
+Error EnableTimerInterrupt() {
+  tick_available = true;
+  if (!timer_wheel.Empty()) {
+    StartTick();
+    if (!tick_running) {
+      return MAKE_ERROR(Error::kNotImplemented);
+    }
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+bool TimerInterruptAvailable() {
+  return tick_available;
+}
+
+void SetTimer(Timer& timer, unsigned long timeout_ms, unsigned long period_ms) {
+  CancelTimer(timer);
+  timer_wheel.CatchUp(CurrentTick());
+  timer_wheel.Schedule(timer, CurrentTick() + MillisecondsToTimerTicks(timeout_ms),
+                       MillisecondsToTimerTicks(period_ms));
+  StartTick();
+}
+
+void CancelTimer(Timer& timer) {
+  if (timer.Pending()) {
+    timer_wheel.Remove(timer);
+  }
+}
+
+void ProcessTimers() {
+  timer_wheel.Advance(CurrentTick());
+  if (timer_wheel.Empty()) {
+    StopTick();
+  }
+}
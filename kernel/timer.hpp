@@ -0,0 +1,69 @@
+/**
+ * @file timer.hpp
+ *
+ * 階層タイマホイールによるタイマと，タイムアウト付きの待ち合わせ．
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "clock.hpp"
+#include "error.hpp"
+#include "timer_wheel.hpp"
+
+/** @brief タイマホイールを進める周波数（Hz）．タイマの分解能になる． */
+const unsigned long kTimerFreq = 100;
+
+/** @brief タイマホイールを現在時刻に合わせる．InitializeClock の後に呼ぶ． */
+void InitializeTimer();
+
+/** @brief タイマ割り込みでメインループを起こせるようにする．
+ *
+ * 割り込みハンドラを登録してから呼ぶ．タイマ割り込みは登録中のタイマがあるときだけ
+ * kTimerFreq Hz で発生させ，ホイールが空になれば止めて CPU を長く休ませる．
+ * タイマデバイスを使えなければエラーを返し，以後もタイマ割り込みは使わない．
+ */
+Error EnableTimerInterrupt();
+
+/** @brief タイマ割り込みでタイマの期限を知らせられるなら真．
+ *
+ * 偽の間は，登録したタイマの期限が来てもメインループが起こされない．
+ */
+bool TimerInterruptAvailable();
+
+/** @brief 起動からのホイールの刻み（1 / kTimerFreq 秒）の数． */
+uint64_t CurrentTick();
+
+/** @brief timer を timeout_ms ミリ秒後に期限が来るよう登録する．
+ *
+ * period_ms が 0 でなければ，以後 period_ms ミリ秒ごとに繰り返す．
+ * 登録中のタイマなら登録し直す．タイマの操作はメインループからだけ行う．
+ */
+void SetTimer(Timer& timer, unsigned long timeout_ms, unsigned long period_ms = 0);
+
+/** @brief timer の登録を取り消す．登録されていなければ何もしない． */
+void CancelTimer(Timer& timer);
+
+/** @brief 期限が来たタイマのコールバックを呼ぶ．メインループから繰り返し呼ぶ． */
+void ProcessTimers();
+
+/** @brief pred() が真になるか timeout_us マイクロ秒が経つまで待つ．
+ *
+ * 割り込みやメインループに頼らないので，初期化中のレジスタの待ち合わせに使える．
+ * 確認の合間は WaitForCounterEvent で CPU を休ませ，MMIO を読む頻度を抑える．
+ *
+ * @return pred() が真になれば Error::kSuccess，時間切れなら Error::kTimeout
+ */
+template <class Pred>
+Error WaitUntil(Pred pred, uint64_t timeout_us) {
+  const uint64_t deadline = ClockTicks() + MicrosecondsToTicks(timeout_us);
+  while (!pred()) {
+    if (ClockTicks() >= deadline) {
+      // 待っている間に割り込み処理などで時間が過ぎただけかもしれないので最後にもう一度確かめる
+      return pred() ? MAKE_ERROR(Error::kSuccess) : MAKE_ERROR(Error::kTimeout);
+    }
+    WaitForCounterEvent();
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
@@ -0,0 +1,171 @@
+/**
+ * @file timer_wheel.hpp
+ *
+ * 階層タイマホイールの本体．時刻の取得から切り離し，ホストでも試験できるようにする．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class TimerWheel;
+
+/** @brief 期限が来るとメインループでコールバックを呼ぶタイマ．
+ *
+ * タイマ自身がホイールのリストの要素を兼ねるので，登録にメモリ確保は要らない．
+ * 登録中のタイマを破棄してはならない．
+ */
+class Timer {
+ public:
+  using Callback = void (*)(Timer& timer, void* arg);
+
+  constexpr Timer(Callback callback, void* arg)
+      : callback_{callback}, arg_{arg} {}
+
+  /** @brief ホイールに登録されていて，まだ期限が来ていなければ真． */
+  bool Pending() const { return pprev_ != nullptr; }
+
+ private:
+  friend class TimerWheel;
+
+  Callback callback_;
+  void* arg_;
+  uint64_t expires_ = 0;  // ホイールの刻みで数えた期限
+  uint64_t period_ = 0;   // 0 なら 1 回だけ
+  Timer* next_ = nullptr;
+  Timer** pprev_ = nullptr;
+};
+
+/** @brief 64 スロットを 4 段重ねたタイマホイール．
+ *
+ * 段 n には期限まで 64^n 以上 64^(n+1) 未満の刻みを残すタイマを，
+ * 期限の 6n ビット目からの 6 ビットをスロット番号として置く．
+ * 段 0 のスロットが一周するたびに段 1 の次のスロットのタイマを段 0 へ移し（カスケード），
+ * 以下同様に上の段へ伝える．64^4 刻み（100 Hz で約 46 時間）より先のタイマは
+ * 最上段に置き，カスケードのたびに置き直す．
+ *
+ * メンバの初期値は 0 なので，静的領域に置けばコンストラクタを呼ばなくても使える．
+ * ロックを持たないので，1 つの文脈からだけ操作すること．
+ */
+class TimerWheel {
+ public:
+  /** @brief 刻み now を現在とする．タイマを登録する前に呼ぶ． */
+  void Reset(uint64_t now) {
+    current_ = now;
+  }
+
+  /** @brief 刻み expires に期限が来るよう timer を登録する．period が 0 でなければ繰り返す．
+   *
+   * 登録中のタイマなら登録し直す．コールバックの中から自分自身を登録し直してもよい．
+   */
+  void Schedule(Timer& timer, uint64_t expires, uint64_t period) {
+    if (timer.Pending()) {
+      Remove(timer);
+    }
+    timer.expires_ = expires;
+    timer.period_ = period;
+    Add(timer);
+  }
+
+  void Add(Timer& timer) {
+    uint64_t expires = timer.expires_ < current_ ? current_ : timer.expires_;
+    const uint64_t delta = expires - current_;
+
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (1ull << (kSlotBits * (level + 1)))) {
+      ++level;
+    }
+    if (delta >= (1ull << (kSlotBits * kLevels))) {
+      expires = current_ + (1ull << (kSlotBits * kLevels)) - 1;
+    }
+
+    Timer*& head = slots_[level][(expires >> (kSlotBits * level)) & kSlotMask];
+    timer.next_ = head;
+    if (head) {
+      head->pprev_ = &timer.next_;
+    }
+    head = &timer;
+    timer.pprev_ = &head;
+    ++num_timers_;
+  }
+
+  /** @brief 登録中の timer を外す． */
+  void Remove(Timer& timer) {
+    *timer.pprev_ = timer.next_;
+    if (timer.next_) {
+      timer.next_->pprev_ = timer.pprev_;
+    }
+    timer.next_ = nullptr;
+    timer.pprev_ = nullptr;
+    --num_timers_;
+  }
+
+  bool Empty() const { return num_timers_ == 0; }
+
+  /** @brief 空のホイールを刻み now まで一気に進める．
+   *
+   * 割り込みを止めている間に溜まった刻みを，次の Advance で 1 つずつ回らずに済ませる．
+   * 戻すことはしないので，コールバックの中から呼んでもよい．
+   */
+  void CatchUp(uint64_t now) {
+    if (num_timers_ == 0 && current_ < now) {
+      current_ = now;
+    }
+  }
+
+  /** @brief 刻み now までに期限が来たタイマのコールバックを呼ぶ． */
+  void Advance(uint64_t now) {
+    while (current_ <= now) {
+      if (num_timers_ == 0) {
+        current_ = now + 1;
+        return;
+      }
+
+      const size_t index = current_ & kSlotMask;
+      if (index == 0) {
+        Cascade(1);
+      }
+
+      // 期限の来たタイマをリストごと外し，刻みを進めてからコールバックを呼ぶ．
+      // コールバックが SetTimer(t, 0) で登録し直しても，処理中のスロットには入らず次の刻みになる
+      Timer* expired = slots_[0][index];
+      slots_[0][index] = nullptr;
+      if (expired) {
+        expired->pprev_ = &expired;
+      }
+      ++current_;
+      while (Timer* timer = expired) {
+        Remove(*timer);
+        if (timer->period_ > 0) {
+          timer->expires_ += timer->period_;
+          Add(*timer);
+        }
+        timer->callback_(*timer, timer->arg_);
+      }
+    }
+  }
+
+ private:
+  static const int kSlotBits = 6;
+  static const size_t kSlotMask = (1u << kSlotBits) - 1;
+  static const int kLevels = 4;
+
+  Timer* slots_[kLevels][1u << kSlotBits];
+  uint64_t current_;  // 次に処理する刻み
+  size_t num_timers_;
+
+  void Cascade(int level) {
+    if (level >= kLevels) {
+      return;
+    }
+    const size_t index = (current_ >> (kSlotBits * level)) & kSlotMask;
+    if (index == 0) {
+      Cascade(level + 1);
+    }
+    while (Timer* timer = slots_[level][index]) {
+      Remove(*timer);
+      Add(*timer);
+    }
+  }
+};
@@ -0,0 +1,69 @@
+/**
+ * @file uart.cpp
+ *
+ * UART へのバッファ付き出力．
+ */
+
+#include "uart.hpp"
+
+#include "uart_device.hpp"
+
+namespace {
+  bool uart_initialized = false;
+
+  /** @brief 送信バッファ．[head, tail) が未送信のバイト列． */
+  const size_t kTxBufferSize = 4096;  // 2 のべき乗
+  char tx_buffer[kTxBufferSize];
+  size_t tx_head = 0, tx_tail = 0;
+
+  void PushByte(char c) {
+    if (tx_tail - tx_head == kTxBufferSize) {
+      UARTFlush();
+    }
+    tx_buffer[tx_tail % kTxBufferSize] = c;
+    ++tx_tail;
+  }
+}
+
+Error InitializeUART() {
+  if (auto err = InitializeUARTDevice()) {
+    return err;
+  }
+  uart_initialized = true;
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+void UARTWrite(const char* s, size_t len) {
+  if (!uart_initialized) {
+    return;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    if (s[i] == '\n') {
+      PushByte('\r');
+    }
+    PushByte(s[i]);
+  }
+  UARTPoll();
+}
+
+void UARTPoll() {
+  while (tx_head != tx_tail) {
+    // バッファの末尾で折り返さない範囲をまとめて渡す
+    const size_t offset = tx_head % kTxBufferSize;
+    size_t len = tx_tail - tx_head;
+    if (len > kTxBufferSize - offset) {
+      len = kTxBufferSize - offset;
+    }
+    const size_t n = UARTDeviceWrite(&tx_buffer[offset], len);
+    if (n == 0) {
+      return;
+    }
+    tx_head += n;
+  }
+}
+
+void UARTFlush() {
+  while (tx_head != tx_tail) {
+    UARTPoll();
+  }
+}
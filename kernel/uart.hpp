@@ -0,0 +1,29 @@
+/**
+ * @file uart.hpp
+ *
+ * UART へのバッファ付き出力．
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "error.hpp"
+
+/** @brief UART を初期化し，以降の UARTWrite を有効にする．
+ *
+ * 失敗したら UARTWrite は何もしないままになる．
+ */
+Error InitializeUART();
+
+/** @brief s の先頭 len バイトを送信バッファに積み，FIFO が受け付けるだけ送る．
+ *
+ * 改行は CR LF に変換する．送信バッファが一杯のときだけ FIFO が空くのを待つ．
+ */
+void UARTWrite(const char* s, size_t len);
+
+/** @brief 送信バッファの内容を FIFO が受け付けるだけ送る．待たない． */
+void UARTPoll();
+
+/** @brief 送信バッファが空になるまで待つ． */
+void UARTFlush();
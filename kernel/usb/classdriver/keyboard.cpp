@@ -2,13 +2,39 @@
 
 #include <algorithm>
 #include "usb/memory.hpp"
+#include "usb/object_cache.hpp"
 #include "usb/device.hpp"
+#include "logger.hpp"
+#include "halt.hpp"
+
+namespace {
+  usb::ObjectCache<usb::HIDKeyboardDriver> keyboard_driver_cache{"HIDKeyboard"};
+}
 
 namespace usb {
   HIDKeyboardDriver::HIDKeyboardDriver(Device* dev, int interface_index)
       : HIDBaseDriver{dev, interface_index, 8} {
   }
 
+  void* HIDKeyboardDriver::operator new(size_t size) {
+    // 派生クラスはキャッシュの 1 スロットに収まらない
+    if (size > sizeof(HIDKeyboardDriver)) {
+      Log(kError, "HIDKeyboardDriver::operator new: %lu bytes do not fit in a slot\n", size);
+      while (1) halt();
+    }
+    // 例外を使わないので，確保できなければ nullptr の上でコンストラクタを走らせずに止める
+    void* p = keyboard_driver_cache.Allocate();
+    if (p == nullptr) {
+      Log(kError, "HIDKeyboardDriver::operator new: out of memory\n");
+      while (1) halt();
+    }
+    return p;
+  }
+
+  void HIDKeyboardDriver::operator delete(void* ptr) noexcept {
+    keyboard_driver_cache.Free(ptr);
+  }
+
   Error HIDKeyboardDriver::OnDataReceived() {
     for (int i = 2; i < 8; ++i) {
       const uint8_t key = Buffer()[i];
@@ -24,14 +50,6 @@ namespace usb {
     return MAKE_ERROR(Error::kSuccess);
   }
 
-  void* HIDKeyboardDriver::operator new(size_t size) {
-    return AllocMem(sizeof(HIDKeyboardDriver), 0, 0);
-  }
-
-  void HIDKeyboardDriver::operator delete(void* ptr) noexcept {
-    FreeMem(ptr);
-  }
-
   void HIDKeyboardDriver::SubscribeKeyPush(
       std::function<void (uint8_t keycode)> observer) {
     observers_[num_observers_++] = observer;
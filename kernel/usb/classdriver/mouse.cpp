@@ -2,30 +2,47 @@
 
 #include <algorithm>
 #include "usb/memory.hpp"
+#include "usb/object_cache.hpp"
 #include "usb/device.hpp"
 #include "logger.hpp"
+#include "halt.hpp"
+
+namespace {
+  usb::ObjectCache<usb::HIDMouseDriver> mouse_driver_cache{"HIDMouse"};
+}
 
 namespace usb {
   HIDMouseDriver::HIDMouseDriver(Device* dev, int interface_index)
       : HIDBaseDriver{dev, interface_index, 3} {
   }
 
+  void* HIDMouseDriver::operator new(size_t size) {
+    // 派生クラスはキャッシュの 1 スロットに収まらない
+    if (size > sizeof(HIDMouseDriver)) {
+      Log(kError, "HIDMouseDriver::operator new: %lu bytes do not fit in a slot\n", size);
+      while (1) halt();
+    }
+    // 例外を使わないので，確保できなければ nullptr の上でコンストラクタを走らせずに止める
+    void* p = mouse_driver_cache.Allocate();
+    if (p == nullptr) {
+      Log(kError, "HIDMouseDriver::operator new: out of memory\n");
+      while (1) halt();
+    }
+    return p;
+  }
+
+  void HIDMouseDriver::operator delete(void* ptr) noexcept {
+    mouse_driver_cache.Free(ptr);
+  }
+
   Error HIDMouseDriver::OnDataReceived() {
     int8_t displacement_x = Buffer()[1];
     int8_t displacement_y = Buffer()[2];
     NotifyMouseMove(displacement_x, displacement_y);
-    Log(kDebug, "%02x,(%3d,%3d)\n", Buffer()[0], displacement_x, displacement_y);
+    LogFor(kLogHID, kDebug, "%02x,(%3d,%3d)\n", Buffer()[0], displacement_x, displacement_y);
     return MAKE_ERROR(Error::kSuccess);
   }
 
-  void* HIDMouseDriver::operator new(size_t size) {
-    return AllocMem(sizeof(HIDMouseDriver), 0, 0);
-  }
-
-  void HIDMouseDriver::operator delete(void* ptr) noexcept {
-    FreeMem(ptr);
-  }
-
   void HIDMouseDriver::SubscribeMouseMove(
       std::function<void (int8_t displacement_x, int8_t displacement_y)> observer) {
     observers_[num_observers_++] = observer;
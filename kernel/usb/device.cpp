@@ -7,6 +7,7 @@
 #include "usb/classdriver/mouse.hpp"
 
 #include "logger.hpp"
+#include "timeline.hpp"
 
 namespace {
   class ConfigurationDescriptorReader {
@@ -73,35 +74,57 @@ namespace {
     return nullptr;
   }
 
-  void Log(LogLevel level, const usb::InterfaceDescriptor& if_desc) {
-    Log(level, "Interface Descriptor: class=%d, sub=%d, protocol=%d\n",
-        if_desc.interface_class,
-        if_desc.interface_sub_class,
-        if_desc.interface_protocol);
+  void LogDescriptor(LogLevel level, const usb::InterfaceDescriptor& if_desc) {
+    if (!LogEnabled(kLogUSB, level)) {
+      return;
+    }
+    LogFor(kLogUSB, level, "Interface Descriptor: class=%d, sub=%d, protocol=%d\n",
+           if_desc.interface_class,
+           if_desc.interface_sub_class,
+           if_desc.interface_protocol);
   }
 
-  void Log(LogLevel level, const usb::EndpointConfig& conf) {
-    Log(level, "EndpointConf: ep_id=%d, ep_type=%d"
-        ", max_packet_size=%d, interval=%d\n",
-        conf.ep_id.Address(), conf.ep_type,
-        conf.max_packet_size, conf.interval);
+  void LogDescriptor(LogLevel level, const usb::EndpointConfig& conf) {
+    if (!LogEnabled(kLogUSB, level)) {
+      return;
+    }
+    LogFor(kLogUSB, level, "EndpointConf: ep_id=%d, ep_type=%d"
+           ", max_packet_size=%d, interval=%d\n",
+           conf.ep_id.Address(), conf.ep_type,
+           conf.max_packet_size, conf.interval);
   }
 
-  void Log(LogLevel level, const usb::HIDDescriptor& hid_desc) {
-    Log(level, "HID Descriptor: release=0x%02x, num_desc=%d",
-        hid_desc.hid_release,
-        hid_desc.num_descriptors);
+  void LogDescriptor(LogLevel level, const usb::HIDDescriptor& hid_desc) {
+    if (!LogEnabled(kLogUSB, level)) {
+      return;
+    }
+    LogFor(kLogUSB, level, "HID Descriptor: release=0x%02x, num_desc=%d",
+           hid_desc.hid_release,
+           hid_desc.num_descriptors);
     for (int i = 0; i < hid_desc.num_descriptors; ++i) {
-      Log(level, ", desc_type=%d, len=%d",
-          hid_desc.GetClassDescriptor(i)->descriptor_type,
-          hid_desc.GetClassDescriptor(i)->descriptor_length);
+      LogFor(kLogUSB, level, ", desc_type=%d, len=%d",
+             hid_desc.GetClassDescriptor(i)->descriptor_type,
+             hid_desc.GetClassDescriptor(i)->descriptor_length);
     }
-    Log(level, "\n");
+    LogFor(kLogUSB, level, "\n");
   }
 }
 
 namespace usb {
   Device::~Device() {
+    // 1 つのクラスドライバが複数のエンドポイントに登録されていることがある
+    for (size_t i = 0; i < class_drivers_.size(); ++i) {
+      auto driver = class_drivers_[i];
+      if (driver == nullptr) {
+        continue;
+      }
+      for (size_t j = i; j < class_drivers_.size(); ++j) {
+        if (class_drivers_[j] == driver) {
+          class_drivers_[j] = nullptr;
+        }
+      }
+      delete driver;
+    }
   }
 
   Error Device::ControlIn(EndpointID ep_id, SetupData setup_data,
@@ -148,8 +171,8 @@ namespace usb {
 
   Error Device::OnControlCompleted(EndpointID ep_id, SetupData setup_data,
                                    const void* buf, int len) {
-    Log(kDebug, "Device::OnControlCompleted: buf 0x%08x, len %d, dir %d\n",
-        buf, len, setup_data.request_type.bits.direction);
+    LogFor(kLogUSB, kDebug, "Device::OnControlCompleted: buf 0x%08x, len %d, dir %d\n",
+           buf, len, setup_data.request_type.bits.direction);
     if (is_initialized_) {
       if (auto w = event_waiters_.Get(setup_data)) {
         return w.value()->OnControlCompleted(ep_id, setup_data, buf, len);
@@ -181,7 +204,7 @@ namespace usb {
   }
 
   Error Device::OnInterruptCompleted(EndpointID ep_id, const void* buf, int len) {
-    Log(kDebug, "Device::OnInterruptCompleted: ep addr %d\n", ep_id.Address());
+    LogFor(kLogUSB, kDebug, "Device::OnInterruptCompleted: ep addr %d\n", ep_id.Address());
     if (auto w = class_drivers_[ep_id.Number()]) {
       return w->OnInterruptCompleted(ep_id, buf, len);
     }
@@ -193,7 +216,7 @@ namespace usb {
     num_configurations_ = device_desc->num_configurations;
     config_index_ = 0;
     initialize_phase_ = 2;
-    Log(kDebug, "issuing GetDesc(Config): index=%d)\n", config_index_);
+    LogFor(kLogUSB, kDebug, "issuing GetDesc(Config): index=%d)\n", config_index_);
     return GetDescriptor(*this, kDefaultControlPipeID,
                          ConfigurationDescriptor::kType, config_index_,
                          buf_.data(), buf_.size(), true);
@@ -208,7 +231,7 @@ namespace usb {
 
     ClassDriver* class_driver = nullptr;
     while (auto if_desc = config_reader.Next<InterfaceDescriptor>()) {
-      Log(kDebug, *if_desc);
+      LogDescriptor(kDebug, *if_desc);
 
       class_driver = NewClassDriver(this, *if_desc);
       if (class_driver == nullptr) {
@@ -222,13 +245,13 @@ namespace usb {
         auto desc = config_reader.Next();
         if (auto ep_desc = DescriptorDynamicCast<EndpointDescriptor>(desc)) {
           auto conf = MakeEPConfig(*ep_desc);
-          Log(kDebug, conf);
+          LogDescriptor(kDebug, conf);
 
           ep_configs_[num_ep_configs_] = conf;
           ++num_ep_configs_;
           class_drivers_[conf.ep_id.Number()] = class_driver;
         } else if (auto hid_desc = DescriptorDynamicCast<HIDDescriptor>(desc)) {
-          Log(kDebug, *hid_desc);
+          LogDescriptor(kDebug, *hid_desc);
         }
       }
 
@@ -239,8 +262,8 @@ namespace usb {
       return MAKE_ERROR(Error::kSuccess);
     }
     initialize_phase_ = 3;
-    Log(kDebug, "issuing SetConfiguration: conf_val=%d\n",
-        conf_desc->configuration_value);
+    LogFor(kLogUSB, kDebug, "issuing SetConfiguration: conf_val=%d\n",
+           conf_desc->configuration_value);
     return SetConfiguration(*this, kDefaultControlPipeID,
                             conf_desc->configuration_value, true);
   }
@@ -251,6 +274,7 @@ namespace usb {
     }
     initialize_phase_ = 4;
     is_initialized_ = true;
+    FinishBootTimeline("usb: first device ready");
     return MAKE_ERROR(Error::kSuccess);
   }
 
@@ -1,43 +1,337 @@
 #include "usb/memory.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <new>
+
+#include "logger.hpp"
+#include "memory_manager.hpp"
 
 namespace {
-  template <class T>
-  T Ceil(T value, unsigned int alignment) {
-    return (value + alignment - 1) & ~static_cast<T>(alignment - 1);
+  /** @brief バディ方式で切り分ける最小のブロック（バイト）．xHCI の構造体の境界に合わせる． */
+  const size_t kMinBlockBytes = 64;
+  /** @brief アリーナの大きさ（バイト）．自然な境界に置くので 64 KiB 境界を跨がない． */
+  const size_t kArenaBytes = 64 * 1024;
+  /** @brief 64 バイトから 64 KiB までのブロックの大きさの種類 */
+  const int kNumOrders = 11;
+  const size_t kBlocksPerArena = kArenaBytes / kMinBlockBytes;
+  const size_t kArenaFrames = kArenaBytes / kBytesPerFrame;
+
+  size_t BlockBytes(int order) {
+    return kMinBlockBytes << order;
+  }
+
+  /** @brief 空きブロックの先頭に置くリストの要素 */
+  struct FreeBlock {
+    FreeBlock* next;
+    FreeBlock* prev;
+  };
+
+  /** @brief 64 KiB の DMA 用メモリをバディ方式で管理する．
+   *
+   * 大きさ 2^n のブロックは 2^n の境界に置かれるので，
+   * 要求を alignment 以上の 2 のべき乗に切り上げれば alignment と boundary の制約を両方満たす．
+   * 管理情報はデバイスから見えるメモリに置かないよう，アリーナの外（ヒープ）に持つ．
+   */
+  struct Arena {
+    uintptr_t base;
+    Arena* next;
+    size_t free_bytes;
+    std::array<FreeBlock*, kNumOrders> free_lists;
+    /** @brief 最小ブロック単位の先頭ごとの状態．0 ならブロックの先頭ではない．
+     * 先頭なら order + 1 で，空いていれば kFreeHead を足す．
+     */
+    std::array<uint8_t, kBlocksPerArena> heads;
+    /** @brief 使用中ブロックの先頭ごとの要求バイト数 - 1．内部断片化の集計に使う． */
+    std::array<uint16_t, kBlocksPerArena> requested;
+  };
+
+  const uint8_t kFreeHead = 0x80;
+
+  struct LargeBlock {
+    uintptr_t base;
+    size_t num_frames;
+    size_t requested;
+    LargeBlock* next;
+  };
+
+  struct Stats {
+    size_t num_arenas = 0, max_arenas = 0;
+    size_t used_bytes = 0, max_used_bytes = 0;            // ブロックやフレーム単位で使用中のバイト数
+    size_t requested_bytes = 0, max_requested_bytes = 0;  // 呼び出し側が要求したバイト数
+    uint64_t num_allocs = 0, num_frees = 0, num_failures = 0;
+  } stats;
+
+  Arena* arenas = nullptr;
+  LargeBlock* large_blocks = nullptr;
+
+  void PushFree(Arena& arena, size_t index, int order) {
+    auto block = reinterpret_cast<FreeBlock*>(arena.base + index * kMinBlockBytes);
+    block->prev = nullptr;
+    block->next = arena.free_lists[order];
+    if (block->next) {
+      block->next->prev = block;
+    }
+    arena.free_lists[order] = block;
+    arena.heads[index] = (order + 1) | kFreeHead;
   }
 
-  template <class T, class U>
-  T MaskBits(T value, U mask) {
-    return value & ~static_cast<T>(mask - 1);
+  void EraseFree(Arena& arena, size_t index, int order) {
+    auto block = reinterpret_cast<FreeBlock*>(arena.base + index * kMinBlockBytes);
+    if (block->prev) {
+      block->prev->next = block->next;
+    } else {
+      arena.free_lists[order] = block->next;
+    }
+    if (block->next) {
+      block->next->prev = block->prev;
+    }
+    arena.heads[index] = 0;
+  }
+
+  Arena* NewArena() {
+    auto [ frame, err ] = memory_manager->Allocate(kArenaFrames, kArenaFrames);
+    if (err) {
+      return nullptr;
+    }
+    auto arena = new(std::nothrow) Arena;
+    if (arena == nullptr) {
+      memory_manager->Free(frame, kArenaFrames);
+      return nullptr;
+    }
+
+    arena->base = reinterpret_cast<uintptr_t>(frame.Frame());
+    arena->free_bytes = kArenaBytes;
+    arena->free_lists.fill(nullptr);
+    arena->heads.fill(0);
+    PushFree(*arena, 0, kNumOrders - 1);
+
+    arena->next = arenas;
+    arenas = arena;
+    stats.num_arenas += 1;
+    stats.max_arenas = std::max(stats.max_arenas, stats.num_arenas);
+    return arena;
+  }
+
+  void DeleteArena(Arena* arena) {
+    for (Arena** p = &arenas; *p; p = &(*p)->next) {
+      if (*p == arena) {
+        *p = arena->next;
+        break;
+      }
+    }
+    stats.num_arenas -= 1;
+    memory_manager->Free(FrameID{arena->base / kBytesPerFrame}, kArenaFrames);
+    delete arena;
+  }
+
+  void* AllocFromArena(Arena& arena, int order, size_t requested) {
+    int o = order;
+    while (o < kNumOrders && arena.free_lists[o] == nullptr) {
+      ++o;
+    }
+    if (o == kNumOrders) {
+      return nullptr;
+    }
+
+    size_t index = (reinterpret_cast<uintptr_t>(arena.free_lists[o]) - arena.base) / kMinBlockBytes;
+    EraseFree(arena, index, o);
+    // 余った後ろ半分を 1 段ずつ空きリストへ戻す
+    while (o > order) {
+      --o;
+      PushFree(arena, index + (BlockBytes(o) / kMinBlockBytes), o);
+    }
+
+    arena.heads[index] = order + 1;
+    arena.requested[index] = requested - 1;
+    arena.free_bytes -= BlockBytes(order);
+    return reinterpret_cast<void*>(arena.base + index * kMinBlockBytes);
+  }
+
+  /** @brief p を解放して要求バイト数を返す．arena の先頭でなければ 0． */
+  size_t FreeToArena(Arena& arena, uintptr_t p) {
+    size_t index = (p - arena.base) / kMinBlockBytes;
+    const uint8_t head = arena.heads[index];
+    if ((p - arena.base) % kMinBlockBytes != 0 || head == 0 || (head & kFreeHead)) {
+      return 0;
+    }
+
+    int order = head - 1;
+    const size_t requested = arena.requested[index] + 1;
+    arena.free_bytes += BlockBytes(order);
+    stats.used_bytes -= BlockBytes(order);
+
+    // 相方も同じ大きさで空いていれば 1 つ大きなブロックにまとめる
+    while (order < kNumOrders - 1) {
+      const size_t buddy = index ^ (BlockBytes(order) / kMinBlockBytes);
+      if (arena.heads[buddy] != ((order + 1) | kFreeHead)) {
+        break;
+      }
+      EraseFree(arena, buddy, order);
+      arena.heads[index] = 0;
+      index = std::min(index, buddy);
+      ++order;
+    }
+    PushFree(arena, index, order);
+    return requested;
+  }
+
+  int OrderFor(size_t bytes) {
+    int order = 0;
+    while (BlockBytes(order) < bytes) {
+      ++order;
+    }
+    return order;
+  }
+
+  size_t RoundUpPowerOf2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  /** @brief アリーナに収まらない要求はフレームから直接切り出す． */
+  void* AllocLarge(size_t size, unsigned int alignment, unsigned int boundary) {
+    size_t align_bytes = std::max<size_t>(alignment, kBytesPerFrame);
+    if (boundary > 0 && size <= boundary) {
+      align_bytes = std::max(align_bytes, RoundUpPowerOf2(size));
+    }
+    const size_t num_frames = (size + kBytesPerFrame - 1) / kBytesPerFrame;
+
+    auto node = new(std::nothrow) LargeBlock;
+    if (node == nullptr) {
+      return nullptr;
+    }
+    auto [ frame, err ] = memory_manager->Allocate(num_frames, align_bytes / kBytesPerFrame);
+    if (err) {
+      delete node;
+      return nullptr;
+    }
+
+    node->base = reinterpret_cast<uintptr_t>(frame.Frame());
+    node->num_frames = num_frames;
+    node->requested = size;
+    node->next = large_blocks;
+    large_blocks = node;
+    stats.used_bytes += num_frames * kBytesPerFrame;
+    return frame.Frame();
+  }
+
+  /** @brief p がフレームから直接切り出したものなら解放して要求バイト数を返す．違えば 0． */
+  size_t FreeLarge(uintptr_t p) {
+    for (LargeBlock** node = &large_blocks; *node; node = &(*node)->next) {
+      if ((*node)->base != p) {
+        continue;
+      }
+      LargeBlock* block = *node;
+      *node = block->next;
+      const size_t requested = block->requested;
+      stats.used_bytes -= block->num_frames * kBytesPerFrame;
+      memory_manager->Free(FrameID{p / kBytesPerFrame}, block->num_frames);
+      delete block;
+      return requested;
+    }
+    return 0;
   }
 }
 
 namespace usb {
-  alignas(64) uint8_t memory_pool[kMemoryPoolSize];
-  uintptr_t alloc_ptr = reinterpret_cast<uintptr_t>(memory_pool);
-
   void* AllocMem(size_t size, unsigned int alignment, unsigned int boundary) {
-    if (alignment > 0) {
-      alloc_ptr = Ceil(alloc_ptr, alignment);
+    if (memory_manager == nullptr) {
+      return nullptr;
     }
-    if (boundary > 0) {
-      auto next_boundary = Ceil(alloc_ptr, boundary);
-      if (next_boundary < alloc_ptr + size) {
-        alloc_ptr = next_boundary;
+    if (size == 0) {
+      size = 1;
+    }
+
+    void* p = nullptr;
+    const size_t block_bytes = std::max<size_t>(size, alignment);
+    if (block_bytes <= kArenaBytes) {
+      const int order = OrderFor(block_bytes);
+      for (Arena* arena = arenas; arena && p == nullptr; arena = arena->next) {
+        p = AllocFromArena(*arena, order, size);
       }
+      if (p == nullptr) {
+        if (Arena* arena = NewArena()) {
+          p = AllocFromArena(*arena, order, size);
+        }
+      }
+      if (p) {
+        stats.used_bytes += BlockBytes(order);
+      }
+    } else {
+      p = AllocLarge(size, alignment, boundary);
     }
 
-    if (reinterpret_cast<uintptr_t>(memory_pool) + kMemoryPoolSize
-        < alloc_ptr + size) {
+    if (p == nullptr) {
+      ++stats.num_failures;
       return nullptr;
     }
+    // 再利用したブロックやフレームには前の内容が残っている．xHCI の構造体は 0 で始める前提
+    memset(p, 0, size);
+    ++stats.num_allocs;
+    stats.requested_bytes += size;
+    stats.max_used_bytes = std::max(stats.max_used_bytes, stats.used_bytes);
+    stats.max_requested_bytes = std::max(stats.max_requested_bytes, stats.requested_bytes);
+    return p;
+  }
+
+  void FreeMem(void* p) {
+    if (p == nullptr) {
+      return;
+    }
 
-    auto p = alloc_ptr;
-    alloc_ptr += size;
-    return reinterpret_cast<void*>(p);
+    const auto addr = reinterpret_cast<uintptr_t>(p);
+    size_t requested = 0;
+    for (Arena* arena = arenas; arena; arena = arena->next) {
+      if (arena->base <= addr && addr < arena->base + kArenaBytes) {
+        requested = FreeToArena(*arena, addr);
+        // 空になったアリーナは 1 つだけ残してページアロケータへ返す
+        if (requested && arena->free_bytes == kArenaBytes && stats.num_arenas > 1) {
+          DeleteArena(arena);
+        }
+        break;
+      }
+    }
+    if (requested == 0) {
+      requested = FreeLarge(addr);
+    }
+
+    if (requested == 0) {
+      Log(kError, "usb::FreeMem: invalid or already freed pointer %p\n", p);
+      return;
+    }
+    ++stats.num_frees;
+    stats.requested_bytes -= requested;
   }
 
-  void FreeMem(void* p) {}
+  void DumpMemStats() {
+    size_t free_bytes = 0, largest_free = 0;
+    for (Arena* arena = arenas; arena; arena = arena->next) {
+      free_bytes += arena->free_bytes;
+      for (int order = kNumOrders - 1; order >= 0; --order) {
+        if (arena->free_lists[order]) {
+          largest_free = std::max(largest_free, BlockBytes(order));
+          break;
+        }
+      }
+    }
+
+    printk("usb mem: %lu arenas (max %lu), allocs %lu, frees %lu, failures %lu\n",
+           stats.num_arenas, stats.max_arenas,
+           stats.num_allocs, stats.num_frees, stats.num_failures);
+    printk("usb mem: used %lu B (max %lu B), requested %lu B (max %lu B)\n",
+           stats.used_bytes, stats.max_used_bytes,
+           stats.requested_bytes, stats.max_requested_bytes);
+    // 内部断片化はブロックへの切り上げで失った割合，
+    // 外部断片化はアリーナの空きのうち最大の空きブロックに収まらない割合
+    printk("usb mem: internal frag %lu%%, arena free %lu B, largest free block %lu B, external frag %lu%%\n",
+           stats.used_bytes ? 100 * (stats.used_bytes - stats.requested_bytes) / stats.used_bytes : 0,
+           free_bytes, largest_free,
+           free_bytes ? 100 * (free_bytes - largest_free) / free_bytes : 0);
+  }
 }
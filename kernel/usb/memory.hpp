@@ -9,14 +9,14 @@
 #include <cstddef>
 
 namespace usb {
-  /** @brief 動的メモリ確保のためのメモリプールの最大容量（バイト） */
-  static const size_t kMemoryPoolSize = 4096 * 32;
-
   /** @brief 指定されたバイト数のメモリ領域を確保して先頭ポインタを返す．
    *
+   * 64 KiB 境界に置いたアリーナをバディ方式で切り分け，足りなくなれば
+   * メモリマネージャからアリーナを足す．64 KiB を超える要求はフレームから直接切り出す．
    * 先頭アドレスが alignment に揃ったメモリ領域を確保する．
    * size <= boundary ならメモリ領域が boundary を跨がないことを保証する．
    * boundary は典型的にはページ境界を跨がないように 4096 を指定する．
+   * 確保した領域は size バイトすべてを 0 で埋めてから返す．
    *
    * @param size        確保するメモリ領域のサイズ（バイト単位）
    * @param alignment   メモリ領域のアライメント制約．0 なら制約しない．
@@ -31,9 +31,12 @@ namespace usb {
         AllocMem(sizeof(T) * num_obj, alignment, boundary));
   }
 
-  /** @brief 指定されたメモリ領域を解放する．本当に解放することは保証されない． */
+  /** @brief AllocMem で確保したメモリ領域を解放する．nullptr なら何もしない． */
   void FreeMem(void* p);
 
+  /** @brief 使用量とその最大値，断片化の度合いを printk で表示する． */
+  void DumpMemStats();
+
   /** @brief 標準コンテナ用のメモリアロケータ */
   template <class T, unsigned int Alignment = 64, unsigned int Boundary = 4096>
   class Allocator {
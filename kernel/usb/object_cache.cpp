@@ -0,0 +1,57 @@
+#include "usb/object_cache.hpp"
+
+#include "logger.hpp"
+#include "usb/memory.hpp"
+
+namespace {
+  usb::ObjectCacheBase* cache_list = nullptr;
+}
+
+namespace usb {
+  void* ObjectCacheBase::Allocate() {
+    if (!registered_) {
+      registered_ = true;
+      next_ = cache_list;
+      cache_list = this;
+    }
+
+    if (free_list_ == nullptr) {
+      auto slab = reinterpret_cast<uint8_t*>(AllocMem(slab_bytes_, slab_alignment_, 0));
+      if (slab == nullptr) {
+        return nullptr;
+      }
+      ++num_slabs_;
+      // 先頭のスロットから順に使われるよう，後ろから積む
+      for (size_t i = slab_bytes_ / stride_; i > 0; --i) {
+        void* slot = slab + (i - 1) * stride_;
+        *reinterpret_cast<void**>(slot) = free_list_;
+        free_list_ = slot;
+      }
+    }
+
+    void* p = free_list_;
+    free_list_ = *reinterpret_cast<void**>(p);
+    ++num_used_;
+    ++num_allocs_;
+    return p;
+  }
+
+  void ObjectCacheBase::Free(void* p) {
+    if (p == nullptr) {
+      return;
+    }
+    *reinterpret_cast<void**>(p) = free_list_;
+    free_list_ = p;
+    --num_used_;
+  }
+
+  void DumpObjectCaches() {
+    printk("%-16s %8s %8s %8s %10s %10s\n",
+           "cache", "stride", "slabs", "in use", "capacity", "allocs");
+    for (auto c = cache_list; c; c = c->next_) {
+      printk("%-16s %8lu %8lu %8lu %10lu %10lu\n",
+             c->name_, c->stride_, c->num_slabs_, c->num_used_,
+             c->num_slabs_ * (c->slab_bytes_ / c->stride_), c->num_allocs_);
+    }
+  }
+}
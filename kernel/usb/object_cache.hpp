@@ -0,0 +1,95 @@
+/**
+ * @file usb/object_cache.hpp
+ *
+ * 同じ型のオブジェクトを繰り返し確保・解放するための型ごとのキャッシュ．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace usb {
+  /** @brief ObjectCache の型に依存しない部分．
+   *
+   * usb::AllocMem から確保したスラブを同じ大きさのスロットに分け，空きスロットを
+   * 単方向リストで持つ．確保と解放はリストの先頭の出し入れだけなので定数時間で，
+   * 解放したスロットは同じ型に使い回されるので DMA 用のプールを断片化させない．
+   * スラブはピーク時の数のまま保持し，プールへは返さない．
+   */
+  class ObjectCacheBase {
+   public:
+    constexpr ObjectCacheBase(const char* name, size_t stride, size_t slab_bytes,
+                              size_t slab_alignment)
+        : name_{name}, stride_{stride}, slab_bytes_{slab_bytes},
+          slab_alignment_{slab_alignment} {}
+
+    /** @brief 構築前のスロットを 1 つ取り出す．確保できなければ nullptr． */
+    void* Allocate();
+    /** @brief Allocate で取り出したスロットを返す．nullptr なら何もしない． */
+    void Free(void* p);
+
+   private:
+    friend void DumpObjectCaches();
+
+    const char* name_;
+    size_t stride_, slab_bytes_, slab_alignment_;
+    void* free_list_ = nullptr;
+    size_t num_slabs_ = 0, num_used_ = 0;
+    uint64_t num_allocs_ = 0;
+    ObjectCacheBase* next_ = nullptr;
+    bool registered_ = false;
+  };
+
+  /** @brief T 型のオブジェクトのキャッシュ．
+   *
+   * 各オブジェクトの先頭は Alignment に揃い，Boundary が 0 でなければ
+   * sizeof(T) <= Boundary のときオブジェクトが Boundary を跨がない．
+   * コンストラクタは constexpr なので，名前空間スコープに置いても
+   * 初期化のためのコードは生成されない．
+   */
+  template <class T, unsigned int Alignment = alignof(T), unsigned int Boundary = 0>
+  class ObjectCache : public ObjectCacheBase {
+   public:
+    constexpr ObjectCache(const char* name)
+        : ObjectCacheBase{name, kStride, kSlabBytes, kSlabAlignment} {}
+
+    template <class... Args>
+    T* New(Args&&... args) {
+      void* p = Allocate();
+      return p ? new(p) T(std::forward<Args>(args)...) : nullptr;
+    }
+
+    void Delete(T* p) {
+      if (p) {
+        p->~T();
+        Free(p);
+      }
+    }
+
+   private:
+    static constexpr size_t RoundUpPowerOf2(size_t value) {
+      size_t result = 1;
+      while (result < value) {
+        result <<= 1;
+      }
+      return result;
+    }
+
+    static constexpr size_t kAlign =
+      Alignment > sizeof(void*) ? Alignment : sizeof(void*);
+    static constexpr size_t kPackedStride = (sizeof(T) + kAlign - 1) / kAlign * kAlign;
+    // 境界の制約があればスロットを 2 のべき乗にして自然な境界に置き，境界を跨がせない
+    static constexpr size_t kStride =
+      Boundary > 0 ? RoundUpPowerOf2(kPackedStride) : kPackedStride;
+    static constexpr size_t kMinSlabBytes = 16 * 1024;
+    static constexpr size_t kSlabBytes =
+      kStride > kMinSlabBytes ? RoundUpPowerOf2(kStride) : kMinSlabBytes;
+    static constexpr size_t kSlabAlignment = Boundary > 0 ? kSlabBytes : kAlign;
+  };
+
+  /** @brief 使われたことのあるすべてのキャッシュの使用状況を printk で表示する． */
+  void DumpObjectCaches();
+}
@@ -1,12 +1,17 @@
 #include "usb/xhci/device.hpp"
 
+#include <cstring>
+
 #include "logger.hpp"
 #include "usb/memory.hpp"
+#include "usb/object_cache.hpp"
 #include "usb/xhci/ring.hpp"
 
 namespace {
   using namespace usb::xhci;
 
+  usb::ObjectCache<Ring> transfer_ring_cache{"xhci::Ring"};
+
   SetupStageTRB MakeSetupStageTRB(usb::SetupData setup_data, int transfer_type) {
     SetupStageTRB setup{};
     setup.bits.request_type = setup_data.request_type.data;
@@ -27,51 +32,60 @@ namespace {
     return data;
   }
 
-  void Log(LogLevel level, const DataStageTRB& trb) {
-    Log(level,
-        "DataStageTRB: len %d, buf 0x%08lx, dir %d, attr 0x%02x\n",
-        trb.bits.trb_transfer_length,
-        trb.bits.data_buffer_pointer,
-        trb.bits.direction,
-        trb.data[3] & 0x7fu);
+  void LogTRB(LogLevel level, const DataStageTRB& trb) {
+    if (!LogEnabled(kLogXHCI, level)) {
+      return;
+    }
+    LogFor(kLogXHCI, level,
+           "DataStageTRB: len %d, buf 0x%08lx, dir %d, attr 0x%02x\n",
+           trb.bits.trb_transfer_length,
+           trb.bits.data_buffer_pointer,
+           trb.bits.direction,
+           trb.data[3] & 0x7fu);
   }
 
-  void Log(LogLevel level, const SetupStageTRB& trb) {
-    Log(level,
-        "  SetupStage TRB: req_type %02x, req %02x, val %02x, ind %02x, len %02x\n",
-        trb.bits.request_type,
-        trb.bits.request,
-        trb.bits.value,
-        trb.bits.index,
-        trb.bits.length);
+  void LogTRB(LogLevel level, const SetupStageTRB& trb) {
+    if (!LogEnabled(kLogXHCI, level)) {
+      return;
+    }
+    LogFor(kLogXHCI, level,
+           "  SetupStage TRB: req_type %02x, req %02x, val %02x, ind %02x, len %02x\n",
+           trb.bits.request_type,
+           trb.bits.request,
+           trb.bits.value,
+           trb.bits.index,
+           trb.bits.length);
   }
 
-  void Log(LogLevel level, const TransferEventTRB& trb) {
+  void LogTRB(LogLevel level, const TransferEventTRB& trb) {
+    if (!LogEnabled(kLogXHCI, level)) {
+      return;
+    }
     if (trb.bits.event_data) {
-      Log(level,
-          "Transfer (value %08lx) completed: %s, residual length %d, slot %d, ep addr %d\n",
-          reinterpret_cast<uint64_t>(trb.Pointer()),
-          kTRBCompletionCodeToName[trb.bits.completion_code],
-          trb.bits.trb_transfer_length,
-          trb.bits.slot_id,
-          trb.EndpointID().Address());
+      LogFor(kLogXHCI, level,
+             "Transfer (value %08lx) completed: %s, residual length %d, slot %d, ep addr %d\n",
+             reinterpret_cast<uint64_t>(trb.Pointer()),
+             kTRBCompletionCodeToName[trb.bits.completion_code],
+             trb.bits.trb_transfer_length,
+             trb.bits.slot_id,
+             trb.EndpointID().Address());
       return;
     }
 
     TRB* issuer_trb = trb.Pointer();
-    Log(level,
-        "%s completed: %s, residual length %d, slot %d, ep addr %d\n",
-        kTRBTypeToName[issuer_trb->bits.trb_type],
-        kTRBCompletionCodeToName[trb.bits.completion_code],
-        trb.bits.trb_transfer_length,
-        trb.bits.slot_id,
-        trb.EndpointID().Address());
+    LogFor(kLogXHCI, level,
+           "%s completed: %s, residual length %d, slot %d, ep addr %d\n",
+           kTRBTypeToName[issuer_trb->bits.trb_type],
+           kTRBCompletionCodeToName[trb.bits.completion_code],
+           trb.bits.trb_transfer_length,
+           trb.bits.slot_id,
+           trb.EndpointID().Address());
     if (auto data_trb = TRBDynamicCast<DataStageTRB>(issuer_trb)) {
-      Log(level, "  ");
-      Log(level, *data_trb);
+      LogFor(kLogXHCI, level, "  ");
+      LogTRB(level, *data_trb);
     } else if (auto setup_trb = TRBDynamicCast<SetupStageTRB>(issuer_trb)) {
-      Log(level, "  ");
-      Log(level, *setup_trb);
+      LogFor(kLogXHCI, level, "  ");
+      LogTRB(level, *setup_trb);
     }
   }
 }
@@ -79,6 +93,15 @@ namespace {
 namespace usb::xhci {
   Device::Device(uint8_t slot_id, DoorbellRegister* dbreg)
       : slot_id_{slot_id}, dbreg_{dbreg} {
+    // オブジェクトキャッシュのスロットは再利用されるので，xHC に渡すコンテキストを 0 から始める
+    memset(&ctx_, 0, sizeof(ctx_));
+    memset(&input_ctx_, 0, sizeof(input_ctx_));
+  }
+
+  Device::~Device() {
+    for (auto tr : transfer_rings_) {
+      transfer_ring_cache.Delete(tr);
+    }
   }
 
   Error Device::Initialize() {
@@ -96,9 +119,12 @@ namespace usb::xhci {
 
   Ring* Device::AllocTransferRing(DeviceContextIndex index, size_t buf_size) {
     int i = index.value - 1;
-    auto tr = AllocArray<Ring>(1, 64, 4096);
-    if (tr) {
-      tr->Initialize(buf_size);
+    transfer_ring_cache.Delete(transfer_rings_[i]);
+
+    auto tr = transfer_ring_cache.New();
+    if (tr && tr->Initialize(buf_size)) {
+      transfer_ring_cache.Delete(tr);
+      tr = nullptr;
     }
     transfer_rings_[i] = tr;
     return tr;
@@ -110,8 +136,8 @@ namespace usb::xhci {
       return err;
     }
 
-    Log(kDebug, "Device::ControlIn: ep addr %d, buf 0x%08x, len %d\n",
-        ep_id.Address(), buf, len);
+    LogFor(kLogXHCI, kDebug, "Device::ControlIn: ep addr %d, buf 0x%08x, len %d\n",
+           ep_id.Address(), buf, len);
     if (ep_id.Number() < 0 || 15 < ep_id.Number()) {
       return MAKE_ERROR(Error::kInvalidEndpointNumber);
     }
@@ -157,8 +183,8 @@ namespace usb::xhci {
       return err;
     }
 
-    Log(kDebug, "Device::ControlOut: ep addr %d, buf 0x%08x, len %d\n",
-        ep_id.Address(), buf, len);
+    LogFor(kLogXHCI, kDebug, "Device::ControlOut: ep addr %d, buf 0x%08x, len %d\n",
+           ep_id.Address(), buf, len);
     if (ep_id.Number() < 0 || 15 < ep_id.Number()) {
       return MAKE_ERROR(Error::kInvalidEndpointNumber);
     }
@@ -227,8 +253,8 @@ namespace usb::xhci {
       return err;
     }
 
-    Log(kDebug, "Device::InterrutpOut: ep addr %d, buf %08lx, len %d, dev %08lx\n",
-        ep_id.Address(), buf, len, this);
+    LogFor(kLogXHCI, kDebug, "Device::InterrutpOut: ep addr %d, buf %08lx, len %d, dev %08lx\n",
+           ep_id.Address(), buf, len, this);
     return MAKE_ERROR(Error::kNotImplemented);
   }
 
@@ -237,10 +263,10 @@ namespace usb::xhci {
 
     if (trb.bits.completion_code != 1 /* Success */ &&
         trb.bits.completion_code != 13 /* Short Packet */) {
-      Log(kDebug, trb);
+      LogTRB(kDebug, trb);
       return MAKE_ERROR(Error::kTransferFailed);
     }
-    Log(kDebug, trb);
+    LogTRB(kDebug, trb);
 
     TRB* issuer_trb = trb.Pointer();
     if (auto normal_trb = TRBDynamicCast<NormalTRB>(issuer_trb)) {
@@ -252,10 +278,10 @@ namespace usb::xhci {
 
     auto opt_setup_stage_trb = setup_stage_map_.Get(issuer_trb);
     if (!opt_setup_stage_trb) {
-      Log(kDebug, "No Corresponding Setup Stage for issuer %s\n",
-          kTRBTypeToName[issuer_trb->bits.trb_type]);
+      LogFor(kLogXHCI, kDebug, "No Corresponding Setup Stage for issuer %s\n",
+             kTRBTypeToName[issuer_trb->bits.trb_type]);
       if (auto data_trb = TRBDynamicCast<DataStageTRB>(issuer_trb)) {
-        Log(kDebug, *data_trb);
+        LogTRB(kDebug, *data_trb);
       }
       return MAKE_ERROR(Error::kNoCorrespondingSetupStage);
     }
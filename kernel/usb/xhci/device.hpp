@@ -34,6 +34,7 @@ namespace usb::xhci {
         TRB* issue_trb);
 
     Device(uint8_t slot_id, DoorbellRegister* dbreg);
+    ~Device() override;
 
     Error Initialize();
 
@@ -65,7 +66,7 @@ namespace usb::xhci {
     DoorbellRegister* const dbreg_;
 
     enum State state_;
-    std::array<Ring*, 31> transfer_rings_; // index = dci - 1
+    std::array<Ring*, 31> transfer_rings_{}; // index = dci - 1
 
     /** コントロール転送が完了した際に DataStageTRB や StatusStageTRB
      * から対応する SetupStageTRB を検索するためのマップ．
@@ -1,6 +1,12 @@
 #include "usb/xhci/devmgr.hpp"
 
 #include "usb/memory.hpp"
+#include "usb/object_cache.hpp"
+
+namespace {
+  // デバイスコンテキストを含むので DMA 用のメモリに置き，ページ境界を跨がせない
+  usb::ObjectCache<usb::xhci::Device, 64, 4096> device_cache{"xhci::Device"};
+}
 
 namespace usb::xhci {
   Error DeviceManager::Initialize(size_t max_slots) {
@@ -76,8 +82,10 @@ namespace usb::xhci {
       return MAKE_ERROR(Error::kAlreadyAllocated);
     }
 
-    devices_[slot_id] = AllocArray<Device>(1, 64, 4096);
-    new(devices_[slot_id]) Device(slot_id, dbreg);
+    devices_[slot_id] = device_cache.New(slot_id, dbreg);
+    if (devices_[slot_id] == nullptr) {
+      return MAKE_ERROR(Error::kNoEnoughMemory);
+    }
     return MAKE_ERROR(Error::kSuccess);
   }
 
@@ -93,7 +101,7 @@ namespace usb::xhci {
 
   Error DeviceManager::Remove(uint8_t slot_id) {
     device_context_pointers_[slot_id] = nullptr;
-    FreeMem(devices_[slot_id]);
+    device_cache.Delete(devices_[slot_id]);
     devices_[slot_id] = nullptr;
     return MAKE_ERROR(Error::kSuccess);
   }
@@ -2,6 +2,8 @@
 
 #include "usb/xhci/xhci.hpp"
 #include "usb/xhci/registers.hpp"
+#include "profile.hpp"
+#include "timer.hpp"
 
 namespace usb::xhci {
   uint8_t Port::Number() const {
@@ -29,12 +31,16 @@ namespace usb::xhci {
   }
 
   Error Port::Reset() {
+    PROFILE_SCOPE("xhci::Port::Reset");
     auto portsc = port_reg_set_.PORTSC.Read();
     portsc.data[0] &= 0x0e00c3e0u;
     portsc.data[0] |= 0x00020010u; // Write 1 to PR and CSC
     port_reg_set_.PORTSC.Write(portsc);
-    while (port_reg_set_.PORTSC.Read().bits.port_reset);
-    return MAKE_ERROR(Error::kSuccess);
+
+    const uint64_t kPortResetTimeout = 500 * 1000;  // マイクロ秒
+    return WaitUntil([this] {
+      return !port_reg_set_.PORTSC.Read().bits.port_reset;
+    }, kPortResetTimeout);
   }
 
   Device* Port::Initialize() {
@@ -58,6 +58,9 @@ namespace usb::xhci {
     if (buf_ != nullptr) {
       FreeMem(buf_);
     }
+    if (erst_ != nullptr) {
+      FreeMem(erst_);
+    }
 
     cycle_bit_ = true;
     buf_size_ = buf_size;
@@ -72,6 +75,7 @@ namespace usb::xhci {
     erst_ = AllocArray<EventRingSegmentTableEntry>(1, 64, 64 * 1024);
     if (erst_ == nullptr) {
       FreeMem(buf_);
+      buf_ = nullptr;
       return MAKE_ERROR(Error::kNoEnoughMemory);
     }
     memset(erst_, 0, 1 * sizeof(EventRingSegmentTableEntry));
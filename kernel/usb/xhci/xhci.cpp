@@ -1,6 +1,8 @@
 #include "usb/xhci/xhci.hpp"
 
 #include "logger.hpp"
+#include "profile.hpp"
+#include "timer.hpp"
 #include "usb/setupdata.hpp"
 #include "usb/device.hpp"
 #include "usb/descriptor.hpp"
@@ -9,6 +11,11 @@
 namespace {
   using namespace usb::xhci;
 
+  // レジスタの状態変化を待つ上限（マイクロ秒）．仕様上の値より十分長くとる
+  const uint64_t kHaltTimeout = 100 * 1000;        // HCHalted は 16 ms 以内
+  const uint64_t kResetTimeout = 1000 * 1000;      // HCRST と CNR
+  const uint64_t kHandoffTimeout = 1000 * 1000;    // BIOS からの所有権の移譲
+
   Error RegisterCommandRing(Ring* ring, MemMapRegister<CRCR_Bitmap>* crcr) {
     CRCR_Bitmap value = crcr->Read();
     value.bits.ring_cycle_state = true;
@@ -97,8 +104,8 @@ namespace {
 
   Error ResetPort(Controller& xhc, Port& port) {
     const bool is_connected = port.IsConnected();
-    Log(kDebug, "ResetPort: port.IsConnected() = %s\n",
-        is_connected ? "true" : "false");
+    LogFor(kLogXHCI, kDebug, "ResetPort: port.IsConnected() = %s\n",
+           is_connected ? "true" : "false");
 
     if (!is_connected) {
       return MAKE_ERROR(Error::kSuccess);
@@ -114,7 +121,12 @@ namespace {
       }
       addressing_port = port.Number();
       port_config_phase[port.Number()] = ConfigPhase::kResettingPort;
-      port.Reset();
+      if (auto err = port.Reset()) {
+        // 次のポートがアドレス割り当てを始められるよう元に戻す
+        addressing_port = 0;
+        port_config_phase[port.Number()] = ConfigPhase::kNotConnected;
+        return err;
+      }
     }
     return MAKE_ERROR(Error::kSuccess);
   }
@@ -122,9 +134,9 @@ namespace {
   Error EnableSlot(Controller& xhc, Port& port) {
     const bool is_enabled = port.IsEnabled();
     const bool reset_completed = port.IsPortResetChanged();
-    Log(kDebug, "EnableSlot: port.IsEnabled() = %s, port.IsPortResetChanged() = %s\n",
-        is_enabled ? "true" : "false",
-        reset_completed ? "true" : "false");
+    LogFor(kLogXHCI, kDebug, "EnableSlot: port.IsEnabled() = %s, port.IsPortResetChanged() = %s\n",
+           is_enabled ? "true" : "false",
+           reset_completed ? "true" : "false");
 
     if (is_enabled && reset_completed) {
       port.ClearPortResetChange();
@@ -139,7 +151,7 @@ namespace {
   }
 
   Error AddressDevice(Controller& xhc, uint8_t port_id, uint8_t slot_id) {
-    Log(kDebug, "AddressDevice: port_id = %d, slot_id = %d\n", port_id, slot_id);
+    LogFor(kLogXHCI, kDebug, "AddressDevice: port_id = %d, slot_id = %d\n", port_id, slot_id);
 
     xhc.DeviceManager()->AllocDevice(slot_id, xhc.DoorbellRegisterAt(slot_id));
 
@@ -174,7 +186,7 @@ namespace {
   }
 
   Error InitializeDevice(Controller& xhc, uint8_t port_id, uint8_t slot_id) {
-    Log(kDebug, "InitializeDevice: port_id = %d, slot_id = %d\n", port_id, slot_id);
+    LogFor(kLogXHCI, kDebug, "InitializeDevice: port_id = %d, slot_id = %d\n", port_id, slot_id);
 
     auto dev = xhc.DeviceManager()->FindBySlot(slot_id);
     if (dev == nullptr) {
@@ -188,7 +200,7 @@ namespace {
   }
 
   Error CompleteConfiguration(Controller& xhc, uint8_t port_id, uint8_t slot_id) {
-    Log(kDebug, "CompleteConfiguration: port_id = %d, slot_id = %d\n", port_id, slot_id);
+    LogFor(kLogXHCI, kDebug, "CompleteConfiguration: port_id = %d, slot_id = %d\n", port_id, slot_id);
 
     auto dev = xhc.DeviceManager()->FindBySlot(slot_id);
     if (dev == nullptr) {
@@ -202,7 +214,7 @@ namespace {
   }
 
   Error OnEvent(Controller& xhc, PortStatusChangeEventTRB& trb) {
-    Log(kDebug, "PortStatusChangeEvent: port_id = %d\n", trb.bits.port_id);
+    LogFor(kLogXHCI, kDebug, "PortStatusChangeEvent: port_id = %d\n", trb.bits.port_id);
     auto port_id = trb.bits.port_id;
     auto port = xhc.PortAt(port_id);
 
@@ -237,8 +249,8 @@ namespace {
   Error OnEvent(Controller& xhc, CommandCompletionEventTRB& trb) {
     const auto issuer_type = trb.Pointer()->bits.trb_type;
     const auto slot_id = trb.bits.slot_id;
-    Log(kDebug, "CommandCompletionEvent: slot_id = %d, issuer = %s\n",
-        trb.bits.slot_id, kTRBTypeToName[issuer_type]);
+    LogFor(kLogXHCI, kDebug, "CommandCompletionEvent: slot_id = %d, issuer = %s\n",
+           trb.bits.slot_id, kTRBTypeToName[issuer_type]);
 
     if (issuer_type == EnableSlotCommandTRB::Type) {
       if (port_config_phase[addressing_port] != ConfigPhase::kEnablingSlot) {
@@ -309,14 +321,19 @@ namespace {
     }
 
     r.bits.hc_os_owned_semaphore = 1;
-    Log(kDebug, "waiting until OS owns xHC...\n");
+    LogFor(kLogXHCI, kDebug, "waiting until OS owns xHC...\n");
     reg.Write(r);
 
-    do {
-      r = reg.Read();
-    } while (r.bits.hc_bios_owned_semaphore ||
-             !r.bits.hc_os_owned_semaphore);
-    Log(kDebug, "OS has owned xHC\n");
+    auto err = WaitUntil([&reg] {
+      auto r = reg.Read();
+      return !r.bits.hc_bios_owned_semaphore && r.bits.hc_os_owned_semaphore;
+    }, kHandoffTimeout);
+    if (err) {
+      // BIOS が応答しなくても，OS 側の要求は出してあるのでそのまま使う
+      LogFor(kLogXHCI, kWarn, "BIOS did not release xHC: %s\n", err.Name());
+      return;
+    }
+    LogFor(kLogXHCI, kDebug, "OS has owned xHC\n");
   }
 }
 
@@ -332,6 +349,7 @@ namespace usb::xhci {
   }
 
   Error Controller::Initialize() {
+    PROFILE_SCOPE("xhci::Controller::Initialize");
     if (auto err = devmgr_.Initialize(kDeviceSize)) {
       return err;
     }
@@ -348,16 +366,24 @@ namespace usb::xhci {
     }
 
     op_->USBCMD.Write(usbcmd);
-    while (!op_->USBSTS.Read().bits.host_controller_halted);
+    if (auto err = WaitUntil([this] {
+          return op_->USBSTS.Read().bits.host_controller_halted; },
+          kHaltTimeout)) {
+      return err;
+    }
 
     // Reset controller
     usbcmd = op_->USBCMD.Read();
     usbcmd.bits.host_controller_reset = true;
     op_->USBCMD.Write(usbcmd);
-    while (op_->USBCMD.Read().bits.host_controller_reset);
-    while (op_->USBSTS.Read().bits.controller_not_ready);
+    if (auto err = WaitUntil([this] {
+          return !op_->USBCMD.Read().bits.host_controller_reset &&
+                 !op_->USBSTS.Read().bits.controller_not_ready; },
+          kResetTimeout)) {
+      return err;
+    }
 
-    Log(kDebug, "MaxSlots: %u\n", cap_->HCSPARAMS1.Read().bits.max_device_slots);
+    LogFor(kLogXHCI, kDebug, "MaxSlots: %u\n", cap_->HCSPARAMS1.Read().bits.max_device_slots);
     // Set "Max Slots Enabled" field in CONFIG.
     auto config = op_->CONFIG.Read();
     config.bits.max_device_slots_enabled = kDeviceSize;
@@ -371,12 +397,12 @@ namespace usb::xhci {
       auto scratchpad_buf_arr = AllocArray<void*>(max_scratchpad_buffers, 64, 4096);
       for (int i = 0; i < max_scratchpad_buffers; ++i) {
         scratchpad_buf_arr[i] = AllocMem(4096, 4096, 4096);
-        Log(kDebug, "scratchpad buffer array %d = %p\n",
-            i, scratchpad_buf_arr[i]);
+        LogFor(kLogXHCI, kDebug, "scratchpad buffer array %d = %p\n",
+               i, scratchpad_buf_arr[i]);
       }
       devmgr_.DeviceContexts()[0] = reinterpret_cast<DeviceContext*>(scratchpad_buf_arr);
-      Log(kInfo, "wrote scratchpad buffer array %p to dev ctx array 0\n",
-          scratchpad_buf_arr);
+      LogFor(kLogXHCI, kInfo, "wrote scratchpad buffer array %p to dev ctx array 0\n",
+             scratchpad_buf_arr);
     }
 
     DCBAAP_Bitmap dcbaap{};
@@ -395,13 +421,13 @@ namespace usb::xhci {
 
     // Enable interrupt for the primary interrupter
     auto iman = primary_interrupter->IMAN.Read();
-    Log(kInfo, "IMAN(read):%x\n", iman);
+    LogFor(kLogXHCI, kInfo, "IMAN(read):%x\n", iman.data[0]);
     iman.bits.interrupt_pending = true;
     iman.bits.interrupt_enable = true;
     primary_interrupter->IMAN.Write(iman);
-    Log(kInfo, "IMAN(write):%x\n", iman);
+    LogFor(kLogXHCI, kInfo, "IMAN(write):%x\n", iman.data[0]);
     auto iman2 = primary_interrupter->IMAN.Read();
-    Log(kInfo, "IMAN(read again) ip:%d ie:%d\n", iman2.bits.interrupt_pending, iman2.bits.interrupt_enable);
+    LogFor(kLogXHCI, kInfo, "IMAN(read again) ip:%d ie:%d\n", iman2.bits.interrupt_pending, iman2.bits.interrupt_enable);
 
     // Enable interrupt for the controller
     usbcmd = op_->USBCMD.Read();
@@ -418,9 +444,21 @@ namespace usb::xhci {
     op_->USBCMD.Write(usbcmd);
     op_->USBCMD.Read();
 
-    while (op_->USBSTS.Read().bits.host_controller_halted);
+    return WaitUntil([this] {
+      return !op_->USBSTS.Read().bits.host_controller_halted;
+    }, kHaltTimeout);
+  }
 
-    return MAKE_ERROR(Error::kSuccess);
+  void Controller::AcknowledgeInterrupt() {
+    auto primary_interrupter = &InterrupterRegisterSets()[0];
+    auto iman = primary_interrupter->IMAN.Read();
+    iman.bits.interrupt_pending = true;  // RW1C
+    iman.bits.interrupt_enable = true;
+    primary_interrupter->IMAN.Write(iman);
+
+    USBSTS_Bitmap usbsts{};
+    usbsts.bits.event_interrupt = true;  // RW1C．ほかのビットには 0 を書く
+    op_->USBSTS.Write(usbsts);
   }
 
   DoorbellRegister* Controller::DoorbellRegisterAt(uint8_t index) {
@@ -428,6 +466,7 @@ namespace usb::xhci {
   }
 
   Error ConfigurePort(Controller& xhc, Port& port) {
+    PROFILE_SCOPE("xhci::ConfigurePort");
     if (port_config_phase[port.Number()] == ConfigPhase::kNotConnected) {
       return ResetPort(xhc, port);
     }
@@ -500,29 +539,36 @@ namespace usb::xhci {
   }
 
   Error ProcessEvent(Controller& xhc) {
-    auto front = xhc.PrimaryEventRing()->Front();
     if (!xhc.PrimaryEventRing()->HasFront()) {
       return MAKE_ERROR(Error::kSuccess);
     }
 
 #if 0
-    Log(kInfo, "front 1:%x\n", front->data[0]);
-    Log(kInfo, "front 2:%x\n", front->data[1]);
-    Log(kInfo, "front 3:%x\n", front->data[2]);
-    Log(kInfo, "front 4:%x\n", front->data[3]);
+    auto front = xhc.PrimaryEventRing()->Front();
+    LogFor(kLogXHCI, kInfo, "front 1:%x\n", front->data[0]);
+    LogFor(kLogXHCI, kInfo, "front 2:%x\n", front->data[1]);
+    LogFor(kLogXHCI, kInfo, "front 3:%x\n", front->data[2]);
+    LogFor(kLogXHCI, kInfo, "front 4:%x\n", front->data[3]);
 #endif
 
+    auto err = ProcessEvent(xhc, *xhc.PrimaryEventRing()->Front());
+    xhc.PrimaryEventRing()->Pop();
+
+    return err;
+  }
+
+  Error ProcessEvent(Controller& xhc, TRB& event_trb) {
+    PROFILE_SCOPE("xhci::ProcessEvent");
+    PMU_SCOPE("xhci::ProcessEvent");
+
     Error err = MAKE_ERROR(Error::kNotImplemented);
-    auto event_trb = xhc.PrimaryEventRing()->Front();
-    if (auto trb = TRBDynamicCast<TransferEventTRB>(event_trb)) {
+    if (auto trb = TRBDynamicCast<TransferEventTRB>(&event_trb)) {
       err = OnEvent(xhc, *trb);
-    } else if (auto trb = TRBDynamicCast<PortStatusChangeEventTRB>(event_trb)) {
+    } else if (auto trb = TRBDynamicCast<PortStatusChangeEventTRB>(&event_trb)) {
       err = OnEvent(xhc, *trb);
-    } else if (auto trb = TRBDynamicCast<CommandCompletionEventTRB>(event_trb)) {
+    } else if (auto trb = TRBDynamicCast<CommandCompletionEventTRB>(&event_trb)) {
       err = OnEvent(xhc, *trb);
     }
-    xhc.PrimaryEventRing()->Pop();
-
     return err;
   }
 }
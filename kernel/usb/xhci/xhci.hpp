@@ -19,6 +19,12 @@ namespace usb::xhci {
     Controller(uintptr_t mmio_base);
     Error Initialize();
     Error Run();
+    /** @brief プライマリインタラプタの割り込み要求を取り下げる．
+     *
+     * 割り込みハンドラから呼ぶ．IMAN.IP と USBSTS.EINT を 1 書き込みでクリアする．
+     * イベントそのものは ProcessEvent で処理する．
+     */
+    void AcknowledgeInterrupt();
     Ring* CommandRing() { return &cr_; }
     EventRing* PrimaryEventRing() { return &er_; }
     DoorbellRegister* DoorbellRegisterAt(uint8_t index);
@@ -64,4 +70,11 @@ namespace usb::xhci {
    * @return イベントを正常に処理できたら Error::kSuccess
    */
   Error ProcessEvent(Controller& xhc);
+
+  /** @brief イベントリングから取り出し済みのイベント event_trb を処理する．
+   *
+   * 割り込みハンドラがイベントリングからコピーしたイベントを
+   * メインループで処理するために使う．
+   */
+  Error ProcessEvent(Controller& xhc, TRB& event_trb);
 }